@@ -1,874 +1,8712 @@
-#include <iostream>
-#include <string>
-#include <unordered_map>
-#include <fstream>
-#include <cstdlib> 
-
-using namespace std;
-
-const int MAX_USERS = 100;
-const int MAX_FOLLOWERS = 100;
-const int MAX_REPOSITORIES = 100;
-const int MAX_COMMITS = 100;
-const int MAX_FILES = 100;
-
-class Commit {
-private:
-    string message;
-    Commit* next;
-public:
-    Commit(string msg) : message(msg), next(nullptr) {}
-    string getMessage() const { return message; }
-    Commit* getNext() const { return next; }
-    void setNext(Commit* nextCommit) { next = nextCommit; }
-};
-
-class File {
-private:
-    string name;
-    File* next;
-public:
-    File(string filename) : name(filename), next(nullptr) {}
-    string getName() const { return name; }
-    File* getNext() const { return next; }
-    void setNext(File* nextFile) { next = nextFile; }
-};
-
-class Repository {
-private:
-    string name;
-    Commit* commits[MAX_COMMITS];
-    File* files[MAX_FILES];
-    int commitCount;
-    int fileCount;
-    bool isPublic;
-    int forkCount;
-
-
-public:
-    Repository(string repoName, bool public_) : name(repoName), isPublic(public_), commitCount(0), fileCount(0), forkCount(0) {}
-    string getName() const { return name; }
-
-    bool addCommit(Commit* commit) {
-        if (commitCount < MAX_COMMITS) {
-            commits[commitCount++] = commit;
-            return true;
-        }
-        return false; // Unable to add commit
-    }
-
-    bool addFile(File* file) {
-        if (fileCount < MAX_FILES) {
-            files[fileCount++] = file;
-            return true;
-        }
-        return false;
-    }
-
-
-    bool deleteFile(const string& fileName) {
-        for (int i = 0; i < fileCount; i++) {
-            if (files[i]->getName() == fileName) {
-                delete files[i];
-                files[i] = files[fileCount - 1];
-                fileCount--;
-                return true;
-            }
-        }
-        return false; 
-    }
-
-   
-
-
-    void setPublic(bool isPublic) {
-        this->isPublic = isPublic;
-    }
-
-
-    const Commit** getCommits() const { return (const Commit**)commits; }
-
-    const File** getFiles() const { return (const File**)files; }
-
-    int getCommitCount() const { return commitCount; }
-
-    int getFileCount() const { return fileCount; }
-
-    bool isRepositoryPublic() const { return isPublic; }
-
-    int getForkCount() const { return forkCount; }
-
-    void incrementForkCount() { forkCount++; }
-
-};
-
-class Tree {
-private:
-    struct TreeNode {
-        Repository* repository;
-        TreeNode* left;
-        TreeNode* right;
-
-        TreeNode(Repository* repo) : repository(repo), left(nullptr), right(nullptr) {}
-    };
-
-    TreeNode* root;
-
-    void deleteTree(TreeNode* node) {
-        if (node) {
-            deleteTree(node->left);
-            deleteTree(node->right);
-            delete node->repository;
-            delete node;
-        }
-    }
-
-public:
-    Tree() : root(nullptr) {}
-
-    ~Tree() {
-        deleteTree(root);
-    }
-
-    bool addRepository(Repository* repository) {
-        TreeNode* newNode = new TreeNode(repository);
-        if (!root) {
-            root = newNode;
-            return true;
-        }
-
-        TreeNode* current = root;
-        TreeNode* parent = nullptr;
-
-        while (current) {
-            parent = current;
-            if (repository->getName() < current->repository->getName()) {
-                current = current->left;
-            }
-            else if (repository->getName() > current->repository->getName()) {
-                current = current->right;
-            }
-            else {
-                delete newNode;
-                return false;
-            }
-        }
-
-        if (repository->getName() < parent->repository->getName()) {
-            parent->left = newNode;
-        }
-        else {
-            parent->right = newNode;
-        }
-
-        return true;
-    }
-
-    Repository* searchRepository(const string& repoName) const {
-        TreeNode* current = root;
-        while (current) {
-            if (repoName == current->repository->getName()) {
-                return current->repository;
-            }
-            else if (repoName < current->repository->getName()) {
-                current = current->left;
-            }
-            else {
-                current = current->right;
-            }
-        }
-        return nullptr;
-    }
-    bool deleteRepository(const string& repoName) {
-        TreeNode* current = root;
-        TreeNode* parent = nullptr;
-
-        while (current) {
-            if (repoName == current->repository->getName()) {
-                if (parent) {
-                    if (current == parent->left) {
-                        parent->left = nullptr;
-                    }
-                    else {
-                        parent->right = nullptr;
-                    }
-                }
-                else {
-                    root = nullptr;
-                }
-
-                delete current->repository;
-                delete current;
-                return true;
-            }
-
-            parent = current;
-            if (repoName < current->repository->getName()) {
-                current = current->left;
-            }
-            else {
-                current = current->right;
-            }
-        }
-
-        return false; 
-    }
-
-};
-
-class User {
-private:
-    string username;
-    string password;
-    string followers[MAX_FOLLOWERS]; // Array to store followers
-    int followerCount;
-    unordered_map<string, Repository*> repositories; // Map to store user's repositories
-    unordered_map<string, Repository*> forkedRepositories; // Map to store user's forked repositories
-
-public:
-    // Default constructor
-    User() : username(""), password(""), followerCount(0) {}
-
-    User(string uname, string pwd) : username(uname), password(pwd), followerCount(0) {}
-
-    string getUsername() const { return username; }
-    string getPassword() const { return password; }
-    const string* getFollowers() const { return followers; }
-    int getFollowerCount() const { return followerCount; }
-    bool addFollower(const string& follower) {
-        if (followerCount < MAX_FOLLOWERS) {
-            followers[followerCount++] = follower;
-            return true;
-        }
-        return false; 
-    }
-
-    void addRepository(Repository* repo) {
-        repositories[repo->getName()] = repo;
-    }
-
-
-    void forkRepository(Repository* repo) {
-        forkedRepositories[repo->getName()] = new Repository(repo->getName(), repo->isRepositoryPublic());
-        repo->incrementForkCount();
-        for (int i = 0; i < repo->getCommitCount(); i++) {
-            forkedRepositories[repo->getName()]->addCommit(new Commit(repo->getCommits()[i]->getMessage()));
-        }
-        for (int i = 0; i < repo->getFileCount(); i++) {
-            forkedRepositories[repo->getName()]->addFile(new File(repo->getFiles()[i]->getName()));
-        }
-    }
-
-
-
-    bool deleteRepository(const string& repoName) {
-        auto it = repositories.find(repoName);
-        if (it != repositories.end()) {
-            repositories.erase(it);
-            return true;
-        }
-        return false; 
-    }
-
-
-    const unordered_map<string, Repository*>& getRepositories() const {
-        return repositories;
-    }
-    const unordered_map<string, Repository*>& getForkedRepositories() const {
-        return forkedRepositories;
-    }
-};
-
-
-
-class UserRepository {
-private:
-    string name;
-    string commits[MAX_FOLLOWERS]; 
-    string files[MAX_FOLLOWERS];  
-    int commitCount;
-    int fileCount;
-
-public:
-    UserRepository(string repoName) : name(repoName), commitCount(0), fileCount(0) {}
-    string getName() const { return name; }
-    const string* getCommits() const { return commits; }
-    const string* getFiles() const { return files; }
-    int getCommitCount() const { return commitCount; }
-    int getFileCount() const { return fileCount; }
-    bool addCommit(const string& commit) {
-        if (commitCount < MAX_FOLLOWERS) {
-            commits[commitCount++] = commit;
-            return true;
-        }
-        return false;
-    }
-    bool addFile(const string& file) {
-        if (fileCount < MAX_FOLLOWERS) {
-            files[fileCount++] = file;
-            return true;
-        }
-        return false; 
-    }
-};
-
-class SocialGraph {
-private:
-    string users[MAX_USERS];    
-    int userCount;
-    int followMatrix[MAX_USERS][MAX_USERS];
-
-public:
-    SocialGraph() : userCount(0) {
-        for (int i = 0; i < MAX_USERS; ++i) {
-            for (int j = 0; j < MAX_USERS; ++j) {
-                followMatrix[i][j] = 0; 
-            }
-        }
-    }
-
-    bool addUser(const string& username) {
-        if (userCount < MAX_USERS) {
-            users[userCount++] = username;
-            return true;
-        }
-        return false; 
-    }
-
-    bool followUser(int followerIndex, int followeeIndex) {
-        if (followerIndex < userCount && followeeIndex < userCount) {
-            followMatrix[followerIndex][followeeIndex] = 1;
-            return true;
-        }
-        return false; 
-    }
-
-    bool unfollowUser(int followerIndex, int followeeIndex) {
-        if (followerIndex < userCount && followeeIndex < userCount) {
-            followMatrix[followerIndex][followeeIndex] = 0;
-            return true;
-        }
-        return false; 
-    }
-
-    const string* getUsernames() const { return users; }
-    int getUserCount() const { return userCount; }
-    const int* getFollowMatrix() const { return *followMatrix; }
-};
-
-class UserManager {
-private:
-
-    unordered_map<string, User*> users;
-
-    string dataFile = "data.xlsx"; 
-    string datafile = "user_data.txt";
-
-public:
-    bool registerUser(const string& username, const string& password) {
-        if (users.count(username) == 0) {
-            users[username] = new User(username, password);
-            return true;
-        }
-        return false; 
-    }
-
-    User* loginUser(const string& username, const string& password) {
-        if (users.count(username) && users[username]->getPassword() == password) {
-            return users[username];
-        }
-        return nullptr;
-    }
-
-    User* getUser(const string& username) {
-        if (users.count(username)) {
-            return users[username];
-        }
-        return nullptr; 
-    }
-
-    void saveUserData() {
-        ofstream file(dataFile);
-        if (file.is_open()) {
-            for (auto it = users.begin(); it != users.end(); ++it) {
-                file << it->first << "," << it->second->getPassword() << endl;
-            }
-            file.close();
-            cout << "User data saved to file: " << dataFile << endl;
-        }
-        else {
-            cout << "Unable to open file: " << dataFile << endl;
-        }
-    }
-
-
-    void loadUserData() {
-        ifstream file(dataFile);
-        if (file.is_open()) {
-            string line;
-            while (getline(file, line)) {
-                size_t pos = line.find(",");
-                if (pos != string::npos) {
-                    string username = line.substr(0, pos);
-                    string password = line.substr(pos + 1);
-                    users[username] = new User(username, password);
-                }
-            }
-            file.close();
-            cout << "User data loaded from file: " << dataFile << endl;
-        }
-        else {
-            cout << "Unable to open file: " << dataFile << endl;
-        }
-    }
-
-    ////////////////////////////////////////////////////////////////////
-
-
-    void saveAllDataToFile() {
-        ofstream file(datafile);
-        if (file.is_open()) {
-            for (const auto& pair : users) {
-                User* user = pair.second;
-                file << "Username: " << user->getUsername() << endl;
-               
-                const unordered_map<string, Repository*>& repositories = user->getRepositories();
-                for (const auto& repoPair : repositories) {
-                    Repository* repo = repoPair.second;
-                    file << "Repository: " << repo->getName() << endl;
-
-                    // Save commits
-                    const Commit** commits = repo->getCommits();
-                    for (int i = 0; i < repo->getCommitCount(); i++) {
-                        file << "Commit: " << commits[i]->getMessage() << endl;
-                    }
-
-                    // Save files
-                    const File** files = repo->getFiles();
-                    for (int i = 0; i < repo->getFileCount(); i++) {
-                        file << "File: " << files[i]->getName() << endl;
-                    }
-                }
-            }
-            file.close();
-            cout << "All user data saved to file: " << datafile << endl;
-        }
-        else {
-            cout << "Unable to open file for saving all user data." << endl;
-        }
-    }
-
-    void loadAllDataFromFile() {
-        ifstream file(datafile);
-        if (file.is_open()) {
-            string line;
-            User* currentUser = nullptr;
-            Repository* currentRepo = nullptr;
-
-            while (getline(file, line)) {
-                if (line.find("Username: ") == 0) {
-                    string username = line.substr(10);
-                    currentUser = users[username];
-                }
-                else if (line.find("Repository: ") == 0) {
-                    string repoName = line.substr(12);
-                    currentRepo = new Repository(repoName, false);
-                    currentUser->addRepository(currentRepo);
-                }
-                else if (line.find("Commit: ") == 0 && currentRepo) {
-                    string commitMessage = line.substr(8);
-                    currentRepo->addCommit(new Commit(commitMessage));
-                }
-                else if (line.find("File: ") == 0 && currentRepo) {
-                    string fileName = line.substr(6);
-                    currentRepo->addFile(new File(fileName));
-                }
-            }
-
-            file.close();
-            cout << "All user data loaded from file: " << datafile << endl;
-        }
-        else {
-            cout << "Unable to open file for loading all user data." << endl;
-        }
-    }
-
-
-};
-
-int main() {
-    UserManager userManager;
-    SocialGraph socialGraph;
-    Tree repositoryTree;
-    User* loggedInUser = nullptr;
-
-
-    userManager.loadUserData(); 
-
-
-    userManager.loadAllDataFromFile();
-
-
-
-    while (true) 
-    {
-
-        cout << "\n===== GitHub-like Platform =====\n";
-        cout << "1. Create Account\n";
-        cout << "2. Login\n";
-        cout << "3. Exit\n";
-        cout << "Enter your choice: ";
-
-        int choice;
-        cin >> choice;
-        if (choice == 1) 
-        {
-           
-
-            // Create Account
-            string username, password;
-            cout << "Enter username: ";
-            cin >> username;
-            cout << "Enter password: ";
-            cin >> password;
-            if (userManager.registerUser(username, password)) {
-                cout << "Account created successfully!\n";
-                socialGraph.addUser(username);
-            }
-            else {
-                cout << "Unable to create account. Maximum users reached.\n";
-            }
-        }
-        else if (choice == 2)
-        {
-
-            // Login
-            string username, password;
-            cout << "Enter username: ";
-            cin >> username;
-            cout << "Enter password: ";
-            cin >> password;
-            loggedInUser = userManager.loginUser(username, password);
-            if (loggedInUser) {
-                cout << "Login successful! Welcome, " << username << "!\n";
-                while (true) {
-                    cout << "\n===== User Menu =====\n";
-                    cout << "1. View Profile\n";
-                    cout << "2. Follow User\n";
-                    cout << "3. Unfollow User\n";
-                    cout << "4. Create Repository\n";
-                    cout << "5. Add Commit\n";
-                    cout << "6. Add File\n";
-                    cout << "7. View Repository Details\n";
-                    cout << "8. Fork Repository\n";
-                    cout << "9. Delete Repository\n";
-                    cout << "10. Change Repository Visibility\n";
-                    cout << "11. Delete File\n";
-                    cout << "12. Return to Main Menu\n";
-                    cout << "Enter your choice: ";
-
-                    int userChoice;
-                    cin >> userChoice;
-
-                    if (userChoice == 1) {
-                        // View profile
-                        if (loggedInUser) {
-                            cout << "Username: " << loggedInUser->getUsername() << endl;
-                            cout << "Followers: " << loggedInUser->getFollowerCount() << endl;
-                            cout << "Repositories: " << loggedInUser->getRepositories().size() << endl;
-                            cout << "Forked Repositories: " << loggedInUser->getForkedRepositories().size() << endl;
-                        }
-                        else {
-                            cout << "Please log in to view your profile.\n";
-                        }
-                    }
-                    else if (userChoice == 2) {
-                        // Follow user
-                        if (loggedInUser) {
-                            string followeeUsername;
-                            cout << "Enter the username of the user you want to follow: ";
-                            cin >> followeeUsername;
-                            User* followee = userManager.getUser(followeeUsername);
-                            if (followee) {
-                                if (loggedInUser->addFollower(followeeUsername)) {
-                                    cout << "You are now following " << followeeUsername << ".\n";
-                                }
-                                else {
-                                    cout << "Unable to follow " << followeeUsername << ". Maximum followers reached.\n";
-                                }
-                            }
-                            else {
-                                cout << "User not found.\n";
-                            }
-                        }
-                        else {
-                            cout << "Please log in to follow a user.\n";
-                        }
-                    }
-                    else if (userChoice == 3) {
-                        // Unfollow user
-                        if (loggedInUser) {
-                            string unfolloweeUsername;
-                            cout << "Enter the username of the user you want to unfollow: ";
-                            cin >> unfolloweeUsername;
-
-                            // Find the index of the unfollowee in the social graph
-                            int unfolloweeIndex = -1;
-                            const string* usernames = socialGraph.getUsernames();
-                            for (int i = 0; i < socialGraph.getUserCount(); i++) {
-                                if (usernames[i] == unfolloweeUsername) {
-                                    unfolloweeIndex = i;
-                                    break;
-                                }
-                            }
-
-                            int followerIndex = -1;
-                            for (int i = 0; i < socialGraph.getUserCount(); i++) {
-                                if (usernames[i] == loggedInUser->getUsername()) {
-                                    followerIndex = i;
-                                    break;
-                                }
-                            }
-
-                            if (followerIndex != -1 && unfolloweeIndex != -1) {
-                                if (socialGraph.unfollowUser(followerIndex, unfolloweeIndex)) {
-                                    cout << "You have unfollowed " << unfolloweeUsername << ".\n";
-                                }
-                                else {
-                                    cout << "Failed to unfollow " << unfolloweeUsername << ". Invalid follower or followee index.\n";
-                                }
-                            }
-                            else {
-                                cout << "User not found.\n";
-                            }
-                        }
-                        else {
-                            cout << "Please log in to unfollow a user.\n";
-                        }
-                    }
-                    else if (userChoice == 4) {
-                        system("cls");
-
-                        // Create Repository
-                        string repoName;
-                        bool isPublic;
-                        cout << "Enter repository name: ";
-                        cin >> repoName;
-                        cout << "Make the repository public? (1 for yes, 0 for no): ";
-                        cin >> isPublic;
-                        Repository* newRepo = new Repository(repoName, isPublic);
-                        if (repositoryTree.addRepository(newRepo)) {
-                            cout << "Repository created successfully!\n";
-                        }
-                        else {
-                            cout << "Repository with the same name already exists.\n";
-                            delete newRepo; 
-                        }
-                    }
-                    else if (userChoice == 5) {
-                        system("cls");
-
-
-                        // Add Commit
-                        string repoName, commitMessage;
-                        cout << "Enter repository name: ";
-                        cin >> repoName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            cout << "Enter commit message: ";
-                            cin.ignore(); 
-                            getline(cin, commitMessage);
-                            Commit* newCommit = new Commit(commitMessage);
-                            if (repo->addCommit(newCommit)) {
-                                cout << "Commit added successfully!\n";
-                            }
-                            else {
-                                cout << "Failed to add commit. Maximum commits reached.\n";
-                                delete newCommit; 
-                            }
-                        }
-                        else {
-                            cout << "Repository not found.\n";
-                        }
-                    }
-                    else if (userChoice == 6) {
-                        system("cls");
-
-                        // Add File
-                        string repoName, fileName;
-                        cout << "Enter repository name: ";
-                        cin >> repoName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            cout << "Enter file name: ";
-                            cin >> fileName;
-                            File* newFile = new File(fileName);
-                            if (repo->addFile(newFile)) {
-                                cout << "File added successfully!\n";
-                            }
-                            else {
-                                cout << "Failed to add file. Maximum files reached.\n";
-                                delete newFile; 
-                            }
-                        }
-                        else {
-                            cout << "Repository not found.\n";
-                        }
-                    }
-                    else if (userChoice == 7) {
-                        // View Repository Details
-                        string repoName;
-                        cout << "Enter repository name: ";
-                        cin >> repoName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            cout << "Repository Name: " << repo->getName() << endl;
-                            cout << "Repo Visibility: " << (repo->isRepositoryPublic() ? "Public" : "Private") << endl;
-                            cout << "Repo Fork Count: " << repo->getForkCount() << endl;
-                            cout << "Commits:" << endl;
-                            const Commit** commits = repo->getCommits();
-                            for (int i = 0; i < repo->getCommitCount(); ++i) {
-                                cout << "- " << commits[i]->getMessage() << endl;
-                            }
-                            cout << "Files:" << endl;
-                            const File** files = repo->getFiles();
-                            for (int i = 0; i < repo->getFileCount(); ++i) {
-                                cout << "- " << files[i]->getName() << endl;
-                            }
-                        }
-                        else {
-                            cout << "Repository not found.\n";
-                        }
-                    }
-
-
-
-                    else if (userChoice == 8) {
-                        system("cls");
-
-                        // Fork Repository
-                        string repoName;
-                        cout << "Enter the name of the repository you want to fork: ";
-                        cin >> repoName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            if (loggedInUser) {
-                                loggedInUser->forkRepository(repo);
-                                cout << "Repository forked successfully!\n";
-                            }
-                            else {
-                                cout << "Please log in to fork a repository.\n";
-                            }
-                        }
-                        else {
-                            cout << "Repository not found.\n";
-                        }
-                    }
-                    else if (userChoice == 9) {
-                        system("cls");
-
-                        // Delete Repository
-                        string repoName;
-                        cout << "Enter the name of the repository you want to delete: ";
-                        cin >> repoName;
-                        if (loggedInUser) {
-                            if (loggedInUser->deleteRepository(repoName)) {
-                                if (repositoryTree.deleteRepository(repoName)) {
-                                    cout << "Repository deleted successfully!\n";
-                                }
-                                else {
-                                    // This should not happen, as the repository was just deleted from the user's list
-                                    cout << "Error deleting repository from the tree.\n";
-                                }
-                            }
-                            else {
-                                cout << "Repository not found in your repositories.\n";
-                            }
-                        }
-                        else {
-                            cout << "Please log in to delete a repository.\n";
-                        }
-                    }
-                    else if (userChoice == 10) {
-                        // Change Repository Visibility
-                        string repoName;
-                        cout << "Enter the name of the repository you want to change the visibility: ";
-                        cin >> repoName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            bool newVisibility;
-                            cout << "Enter the new visibility (1 for public, 0 for private): ";
-                            cin >> newVisibility;
-                            repo->setPublic(newVisibility);
-                            cout << "Repository visibility updated successfully.\n";
-                        }
-                        else {
-                            cout << "Repository not found.\n";
-                        }
-                    }
-
-                   
-
-
-                    else if (userChoice == 11) {
-                        // Delete File
-                        string repoName, fileName;
-                        cout << "Enter the name of the repository: ";
-                        cin >> repoName;
-                        cout << "Enter the name of the file you want to delete: ";
-                        cin >> fileName;
-                        Repository* repo = repositoryTree.searchRepository(repoName);
-                        if (repo) {
-                            if (repo->deleteFile(fileName)) {
-                                cout << "File '" << fileName << "' deleted successfully from repository '" << repoName << "'.\n";
-                                if (!repositoryTree.deleteRepository(repoName) || !repositoryTree.addRepository(repo)) {
-                                    cout << "Error updating the repository in the tree.\n";
-                                }
-                            }
-                            else {
-                                cout << "File '" << fileName << "' not found in repository '" << repoName << "'.\n";
-                            }
-                        }
-                        else {
-                            cout << "Repository '" << repoName << "' not found.\n";
-                        }
-                        }
-
-
-
-                    else if (userChoice == 12) {
-                        cout << "Returning  to Main Menu" << endl;
-                        system("cls");
-
-
-                        break; 
-                    }
-
-
-
-                    else {
-                        cout << "Invalid choice. Please enter a valid option.\n";
-                    }
-                }
-            }
-            else {
-                cout << "Invalid username or password. Please try again.\n";
-            }
-        }
-        else if (choice == 3)
-        {
-            userManager.saveUserData(); 
-
-
-            userManager.saveAllDataToFile();
-
-            cout << "Exiting program...\n";
-            return 0;
-        }
-        else {
-            cout << "Invalid choice. Please enter a valid option.\n";
-        }
-    }
-
-    return 0;
-}
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <fstream>
+#include <cstdlib> 
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+#include <functional>
+#include <chrono>
+#include <algorithm>
+#include <random>
+#include <set>
+#include <map>
+#include <cctype>
+#include <ctime>
+#include <cmath>
+
+#include <filesystem>
+#include <initializer_list>
+#include <thread>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <iomanip>
+#include <queue>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <csignal>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#endif
+
+using namespace std;
+
+const int MAX_FOLLOWERS = 100;
+const int MAX_REPOSITORIES = 100;
+
+struct AllocatorStats {
+    string name;
+    size_t objectSize;
+    size_t liveObjects;
+    size_t peakObjects;
+    size_t totalAllocations;
+    size_t blocks;
+    size_t bytesReserved;
+};
+
+// Common base so every slab can be listed without knowing its type.
+class SlabAllocatorBase {
+public:
+    virtual ~SlabAllocatorBase() {}
+    virtual AllocatorStats stats() const = 0;
+
+    static vector<const SlabAllocatorBase*>& registry() {
+        static vector<const SlabAllocatorBase*> allocators;
+        return allocators;
+    }
+};
+
+// Allocator for objects of one type. Slots are carved out of blocks that
+// double in size up to MAX_BLOCK_OBJECTS and recycled through a free list,
+// so creating and destroying millions of objects costs a handful of real
+// allocations. Classes opt in with member operator new/delete.
+template <typename T>
+class SlabAllocator : public SlabAllocatorBase {
+private:
+    static constexpr size_t FIRST_BLOCK_OBJECTS = 64;
+    static constexpr size_t MAX_BLOCK_OBJECTS = 4096;
+
+    union Slot {
+        Slot* next;
+        alignas(T) unsigned char storage[sizeof(T)];
+    };
+
+    string name;
+    mutable mutex lock;
+    vector<unique_ptr<Slot[]>> blocks;
+    Slot* freeList;
+    Slot* blockCursor;
+    Slot* blockEnd;
+    size_t nextBlockObjects;
+    size_t bytesReserved;
+    size_t liveObjects;
+    size_t peakObjects;
+    size_t totalAllocations;
+
+    SlabAllocator(const string& typeName) : name(typeName), freeList(nullptr), blockCursor(nullptr), blockEnd(nullptr),
+        nextBlockObjects(FIRST_BLOCK_OBJECTS), bytesReserved(0), liveObjects(0), peakObjects(0), totalAllocations(0) {
+        registry().push_back(this);
+    }
+
+public:
+    // The first call names the slab; the name only shows up in statistics.
+    static SlabAllocator& instance(const char* typeName) {
+        static SlabAllocator allocator(typeName);
+        return allocator;
+    }
+
+    void* allocate(size_t size) {
+        if (size != sizeof(T)) {
+            return ::operator new(size);
+        }
+        lock_guard<mutex> guard(lock);
+        Slot* slot = freeList;
+        if (slot) {
+            freeList = slot->next;
+        }
+        else {
+            if (blockCursor == blockEnd) {
+                blocks.emplace_back(new Slot[nextBlockObjects]);
+                blockCursor = blocks.back().get();
+                blockEnd = blockCursor + nextBlockObjects;
+                bytesReserved += nextBlockObjects * sizeof(Slot);
+                nextBlockObjects = min(nextBlockObjects * 2, MAX_BLOCK_OBJECTS);
+            }
+            slot = blockCursor++;
+        }
+        liveObjects++;
+        totalAllocations++;
+        peakObjects = max(peakObjects, liveObjects);
+        return slot;
+    }
+
+    void deallocate(void* pointer, size_t size) {
+        if (!pointer) {
+            return;
+        }
+        if (size != sizeof(T)) {
+            ::operator delete(pointer);
+            return;
+        }
+        lock_guard<mutex> guard(lock);
+        Slot* slot = (Slot*)pointer;
+        slot->next = freeList;
+        freeList = slot;
+        liveObjects--;
+    }
+
+    AllocatorStats stats() const override {
+        lock_guard<mutex> guard(lock);
+        return AllocatorStats{ name, sizeof(T), liveObjects, peakObjects, totalAllocations, blocks.size(), bytesReserved };
+    }
+};
+
+// Append-only byte arena. Chunks are never moved or freed before the pool
+// itself, so the views it hands out stay valid for the pool's lifetime.
+class StringPool {
+private:
+    static constexpr size_t FIRST_CHUNK_SIZE = 1024;
+    static constexpr size_t MAX_CHUNK_SIZE = 1 << 20;
+
+    vector<unique_ptr<char[]>> chunks;
+    char* cursor;
+    size_t remaining;
+    size_t nextChunkSize;
+    size_t bytesStored;
+    size_t bytesReserved;
+
+    void releaseChunks() {
+        totalChunks -= chunks.size();
+        totalBytesReserved -= bytesReserved;
+        chunks.clear();
+        bytesReserved = 0;
+    }
+
+public:
+    // Totals across every live pool, for allocator statistics.
+    static atomic<size_t> totalChunks;
+    static atomic<size_t> totalBytesReserved;
+
+    StringPool() : cursor(nullptr), remaining(0), nextChunkSize(FIRST_CHUNK_SIZE), bytesStored(0), bytesReserved(0) {}
+
+    StringPool(const StringPool&) = delete;
+    StringPool& operator=(const StringPool&) = delete;
+    StringPool(StringPool&& other) noexcept : chunks(move(other.chunks)), cursor(other.cursor), remaining(other.remaining),
+        nextChunkSize(other.nextChunkSize), bytesStored(other.bytesStored), bytesReserved(other.bytesReserved) {
+        other.chunks.clear();
+        other.cursor = nullptr;
+        other.remaining = 0;
+        other.bytesStored = 0;
+        other.bytesReserved = 0;
+    }
+
+    StringPool& operator=(StringPool&& other) noexcept {
+        releaseChunks();
+        chunks = move(other.chunks);
+        cursor = other.cursor;
+        remaining = other.remaining;
+        nextChunkSize = other.nextChunkSize;
+        bytesStored = other.bytesStored;
+        bytesReserved = other.bytesReserved;
+        other.chunks.clear();
+        other.cursor = nullptr;
+        other.remaining = 0;
+        other.bytesStored = 0;
+        other.bytesReserved = 0;
+        return *this;
+    }
+
+    ~StringPool() {
+        releaseChunks();
+    }
+
+    string_view store(string_view text) {
+        if (text.size() > remaining) {
+            // Chunks double up to MAX_CHUNK_SIZE; anything larger gets a chunk of its own.
+            size_t chunkSize = max(nextChunkSize, text.size());
+            chunks.emplace_back(new char[chunkSize]);
+            bytesReserved += chunkSize;
+            totalChunks++;
+            totalBytesReserved += chunkSize;
+            cursor = chunks.back().get();
+            remaining = chunkSize;
+            nextChunkSize = min(nextChunkSize * 2, MAX_CHUNK_SIZE);
+        }
+        char* start = cursor;
+        if (!text.empty()) {
+            memcpy(start, text.data(), text.size());
+        }
+        cursor += text.size();
+        remaining -= text.size();
+        bytesStored += text.size();
+        return string_view(start, text.size());
+    }
+
+    size_t getBytesStored() const { return bytesStored; }
+};
+
+atomic<size_t> StringPool::totalChunks(0);
+atomic<size_t> StringPool::totalBytesReserved(0);
+
+// Array indexed by dense ids whose elements never move. Pages are
+// allocated on first use and published through an atomic directory, so
+// readers need no lock while other threads append.
+template <typename T>
+class PagedArray {
+private:
+    static constexpr size_t PAGE_BITS = 12;
+    static constexpr size_t PAGE_SIZE = (size_t)1 << PAGE_BITS;
+    static constexpr size_t MAX_PAGES = (size_t)1 << 16;
+
+    unique_ptr<atomic<T*>[]> pages;
+    mutex growLock;
+    atomic<size_t> count; // one past the highest index handed out by at()
+
+public:
+    PagedArray() : pages(new atomic<T*>[MAX_PAGES]()), count(0) {}
+
+    PagedArray(const PagedArray&) = delete;
+    PagedArray& operator=(const PagedArray&) = delete;
+
+    ~PagedArray() {
+        for (size_t i = 0; i < MAX_PAGES; i++) {
+            delete[] pages[i].load();
+        }
+    }
+
+    // Element at index, value-initialized the first time its page is used.
+    T& at(size_t index) {
+        atomic<T*>& slot = pages[index >> PAGE_BITS];
+        T* page = slot.load(memory_order_acquire);
+        if (!page) {
+            lock_guard<mutex> guard(growLock);
+            page = slot.load(memory_order_relaxed);
+            if (!page) {
+                page = new T[PAGE_SIZE]();
+                slot.store(page, memory_order_release);
+            }
+        }
+        size_t seen = count.load(memory_order_relaxed);
+        while (seen <= index && !count.compare_exchange_weak(seen, index + 1)) {
+        }
+        return page[index & (PAGE_SIZE - 1)];
+    }
+
+    // Element at index, or nullptr if its page was never allocated.
+    const T* find(size_t index) const {
+        if ((index >> PAGE_BITS) >= MAX_PAGES) {
+            return nullptr;
+        }
+        const T* page = pages[index >> PAGE_BITS].load(memory_order_acquire);
+        return page ? &page[index & (PAGE_SIZE - 1)] : nullptr;
+    }
+
+    size_t size() const { return count.load(); }
+};
+
+// Open-addressing hash map keyed by strings, laid out like FileIndex:
+// entries stay dense for iteration, and the probe table holds only entry
+// numbers, so a lookup touches one small array and at most a couple of
+// entries. Lookups take a string_view and never build a temporary key.
+// Callers that already hashed a key can pass the hash to skip rehashing.
+template <typename Key, typename Value>
+class FlatHashMap {
+public:
+    struct Entry {
+        Key first;
+        Value second;
+    };
+
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    vector<Entry> entries;
+    vector<uint32_t> hashes; // parallel to entries
+    vector<uint32_t> slots;  // entry number + 1, or 0 for empty
+
+    size_t mask() const { return slots.size() - 1; }
+
+    size_t findSlot(string_view key, uint32_t keyHash) const {
+        size_t slot = keyHash & mask();
+        while (slots[slot] != 0) {
+            uint32_t index = slots[slot] - 1;
+            if (hashes[index] == keyHash && string_view(entries[index].first) == key) {
+                return slot;
+            }
+            slot = (slot + 1) & mask();
+        }
+        return slot;
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, 0);
+        for (size_t i = 0; i < entries.size(); i++) {
+            size_t slot = hashes[i] & mask();
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & mask();
+            }
+            slots[slot] = (uint32_t)i + 1;
+        }
+    }
+
+public:
+    static uint32_t hashKey(string_view key) {
+        return (uint32_t)hash<string_view>()(key);
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+    typename vector<Entry>::const_iterator begin() const { return entries.begin(); }
+    typename vector<Entry>::const_iterator end() const { return entries.end(); }
+
+    Value* find(string_view key, uint32_t keyHash) {
+        if (slots.empty()) {
+            return nullptr;
+        }
+        size_t slot = findSlot(key, keyHash);
+        return slots[slot] != 0 ? &entries[slots[slot] - 1].second : nullptr;
+    }
+
+    const Value* find(string_view key, uint32_t keyHash) const { return const_cast<FlatHashMap*>(this)->find(key, keyHash); }
+    Value* find(string_view key) { return find(key, hashKey(key)); }
+    const Value* find(string_view key) const { return find(key, hashKey(key)); }
+
+    // The value for the key, inserted value-initialized if the key is new;
+    // inserted is set to whether that happened. The reference stays valid
+    // until the next insert or erase.
+    Value& findOrInsert(string_view key, uint32_t keyHash, bool* inserted = nullptr) {
+        if (slots.empty() || (entries.size() + 1) * 10 > slots.size() * 7) {
+            rehash(max(MIN_CAPACITY, slots.size() * 2));
+        }
+        size_t slot = findSlot(key, keyHash);
+        if (inserted) {
+            *inserted = slots[slot] == 0;
+        }
+        if (slots[slot] == 0) {
+            entries.push_back(Entry{ Key(key), Value() });
+            hashes.push_back(keyHash);
+            slots[slot] = (uint32_t)entries.size();
+        }
+        return entries[slots[slot] - 1].second;
+    }
+
+    Value& operator[](string_view key) { return findOrInsert(key, hashKey(key)); }
+
+    bool erase(string_view key) {
+        if (slots.empty()) {
+            return false;
+        }
+        size_t hole = findSlot(key, hashKey(key));
+        if (slots[hole] == 0) {
+            return false;
+        }
+        uint32_t index = slots[hole] - 1;
+
+        // Backward-shift deletion, as in FileIndex::erase.
+        size_t next = hole;
+        while (true) {
+            next = (next + 1) & mask();
+            if (slots[next] == 0) {
+                break;
+            }
+            size_t home = hashes[slots[next] - 1] & mask();
+            if (((next - home) & mask()) >= ((next - hole) & mask())) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+        slots[hole] = 0;
+
+        uint32_t last = (uint32_t)entries.size() - 1;
+        if (index != last) {
+            size_t slot = hashes[last] & mask();
+            while (slots[slot] != last + 1) {
+                slot = (slot + 1) & mask();
+            }
+            slots[slot] = index + 1;
+            entries[index] = move(entries[last]);
+            hashes[index] = hashes[last];
+        }
+        entries.pop_back();
+        hashes.pop_back();
+        return true;
+    }
+};
+
+// Hands out dense 32-bit ids for usernames. Each name is stored once in
+// a string pool and the lookup table is keyed by views into that pool, so
+// a name is hashed once at the API boundary and everything behind it
+// (user table, follow graph) works on the integer id.
+//
+// The name table is split into shards, each with its own reader-writer
+// lock, so lookups of different names never contend and lookups of the
+// same name only share a read lock.
+class StringInterner {
+private:
+    static constexpr size_t SHARDS = 16; // shardFor takes the top 4 bits of the hash
+
+    struct Shard {
+        mutable shared_mutex lock;
+        StringPool pool;
+        FlatHashMap<string_view, uint32_t> ids;
+    };
+
+    Shard shards[SHARDS];
+    PagedArray<string_view> names;
+    atomic<uint32_t> nextId;
+
+    // The name is hashed once: the top bits pick the shard and the shard's
+    // table probes with the low bits.
+    Shard& shardFor(uint32_t nameHash) const { return const_cast<Shard&>(shards[nameHash >> 28]); }
+
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    StringInterner() : nextId(0) {}
+
+    // Id of the name, assigning the next free id if it is new.
+    uint32_t intern(string_view name) {
+        uint32_t nameHash = FlatHashMap<string_view, uint32_t>::hashKey(name);
+        Shard& shard = shardFor(nameHash);
+        {
+            shared_lock<shared_mutex> guard(shard.lock);
+            const uint32_t* id = shard.ids.find(name, nameHash);
+            if (id) {
+                return *id;
+            }
+        }
+        unique_lock<shared_mutex> guard(shard.lock);
+        const uint32_t* existing = shard.ids.find(name, nameHash); // another thread may have won
+        if (existing) {
+            return *existing;
+        }
+        uint32_t id = nextId++;
+        string_view stored = shard.pool.store(name);
+        names.at(id) = stored;
+        shard.ids.findOrInsert(stored, nameHash) = id;
+        return id;
+    }
+
+    // Id of the name, or NONE if it was never interned.
+    uint32_t find(string_view name) const {
+        uint32_t nameHash = FlatHashMap<string_view, uint32_t>::hashKey(name);
+        const Shard& shard = shardFor(nameHash);
+        shared_lock<shared_mutex> guard(shard.lock);
+        const uint32_t* id = shard.ids.find(name, nameHash);
+        return id ? *id : NONE;
+    }
+
+    string_view name(uint32_t id) const { return *names.find(id); }
+    size_t size() const { return nextId.load(); }
+};
+
+class Commit {
+private:
+    string_view message;
+    uint32_t author;   // interned username, or StringInterner::NONE if not known
+    uint32_t node;     // this commit in the CommitGraph, which holds its parents
+    int64_t timestamp; // seconds since the epoch, or 0 if not known
+public:
+    Commit(string_view msg, uint32_t authorId, int64_t time, uint32_t graphNode) : message(msg), author(authorId), node(graphNode), timestamp(time) {}
+    string_view getMessage() const { return message; }
+    uint32_t getAuthor() const { return author; }
+    uint32_t getNode() const { return node; }
+    int64_t getTimestamp() const { return timestamp; }
+};
+
+// A repository's history, stored as a chain of segments. Each segment
+// keeps its commit records back to back in a growable array and packs the
+// messages into its own string pool. Forking seals the current segment so
+// that both repositories share it read-only and append to fresh segments
+// of their own: a fork costs O(1) however long the history is.
+class CommitLog {
+private:
+    struct Segment {
+        shared_ptr<const Segment> parent;
+        int baseCount; // commits in all the segments before this one
+        vector<Commit> commits;
+        StringPool messages;
+        vector<shared_ptr<const void>> borrowed; // external buffers that messages point into
+
+        Segment(shared_ptr<const Segment> parentSegment, int base) : parent(parentSegment), baseCount(base) {}
+    };
+
+    shared_ptr<Segment> head; // only ever referenced by this log, so safe to append to
+    int count;
+
+public:
+    class const_iterator {
+    private:
+        vector<const Segment*> segments; // oldest first
+        size_t segment;
+        const Commit* current;
+        const Commit* segmentEnd;
+
+        void skipEmpty() {
+            while (current == segmentEnd && segment + 1 < segments.size()) {
+                segment++;
+                current = segments[segment]->commits.data();
+                segmentEnd = current + segments[segment]->commits.size();
+            }
+        }
+
+    public:
+        const_iterator() : segment(0), current(nullptr), segmentEnd(nullptr) {}
+
+        const_iterator(const Segment* newest) : segment(0), current(nullptr), segmentEnd(nullptr) {
+            for (const Segment* s = newest; s; s = s->parent.get()) {
+                segments.push_back(s);
+            }
+            reverse(segments.begin(), segments.end());
+            if (!segments.empty()) {
+                current = segments[0]->commits.data();
+                segmentEnd = current + segments[0]->commits.size();
+                skipEmpty();
+            }
+        }
+
+        const Commit& operator*() const { return *current; }
+        const Commit* operator->() const { return current; }
+
+        const_iterator& operator++() {
+            ++current;
+            skipEmpty();
+            return *this;
+        }
+
+        // Only comparisons against end() are supported.
+        bool operator!=(const const_iterator&) const { return current != segmentEnd; }
+        bool operator==(const const_iterator& other) const { return !(*this != other); }
+    };
+
+    CommitLog() : head(make_shared<Segment>(nullptr, 0)), count(0) {}
+
+    // With no storage the message is copied into the log. Otherwise it is
+    // referenced in place and the log keeps the storage alive.
+    void append(string_view message, uint32_t author, int64_t timestamp, uint32_t node, const shared_ptr<const void>& storage = nullptr) {
+        if (storage) {
+            if (head->borrowed.empty() || head->borrowed.back() != storage) {
+                head->borrowed.push_back(storage);
+            }
+            head->commits.push_back(Commit(message, author, timestamp, node));
+        }
+        else {
+            head->commits.push_back(Commit(head->messages.store(message), author, timestamp, node));
+        }
+        count++;
+    }
+
+    // Returns a log with the same history that shares all existing commits.
+    CommitLog share() {
+        shared_ptr<const Segment> sealed = head->parent;
+        if (!head->commits.empty()) {
+            sealed = head;
+            head = make_shared<Segment>(sealed, count);
+        }
+        CommitLog copy;
+        copy.head = make_shared<Segment>(sealed, count);
+        copy.count = count;
+        return copy;
+    }
+
+    int size() const { return count; }
+
+    const Commit& operator[](int index) const {
+        const Segment* segment = head.get();
+        while (index < segment->baseCount) {
+            segment = segment->parent.get();
+        }
+        return segment->commits[index - segment->baseCount];
+    }
+
+    const_iterator begin() const { return const_iterator(head.get()); }
+    const_iterator end() const { return const_iterator(); }
+};
+
+// Name of a blob of file content: the 128-bit MurmurHash3 (x64 variant)
+// of its bytes. Fast rather than cryptographic; 128 bits keeps accidental
+// collisions out of reach for any store this size. All zeros is both the
+// hash of empty content and the id of files added before contents were
+// kept; either way the file reads back empty.
+struct BlobId {
+    uint64_t high = 0;
+    uint64_t low = 0;
+
+    bool isNull() const { return high == 0 && low == 0; }
+    bool operator==(const BlobId& other) const { return high == other.high && low == other.low; }
+    bool operator!=(const BlobId& other) const { return !(*this == other); }
+
+    static BlobId of(string_view content) {
+        const uint64_t c1 = 0x87c37b91114253d5ULL;
+        const uint64_t c2 = 0x4cf5ad432745937fULL;
+        auto rotl = [](uint64_t x, int r) { return (x << r) | (x >> (64 - r)); };
+        auto mix = [](uint64_t k) {
+            k ^= k >> 33;
+            k *= 0xff51afd7ed558ccdULL;
+            k ^= k >> 33;
+            k *= 0xc4ceb9fe1a85ec53ULL;
+            k ^= k >> 33;
+            return k;
+        };
+        const unsigned char* data = (const unsigned char*)content.data();
+        size_t length = content.size();
+        uint64_t h1 = 0;
+        uint64_t h2 = 0;
+        size_t blocks = length / 16;
+        for (size_t i = 0; i < blocks; i++) {
+            uint64_t k1 = 0;
+            uint64_t k2 = 0;
+            for (int b = 7; b >= 0; b--) {
+                k1 = (k1 << 8) | data[i * 16 + b];
+                k2 = (k2 << 8) | data[i * 16 + 8 + b];
+            }
+            k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+            h1 = rotl(h1, 27); h1 += h2; h1 = h1 * 5 + 0x52dce729;
+            k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+            h2 = rotl(h2, 31); h2 += h1; h2 = h2 * 5 + 0x38495ab5;
+        }
+        const unsigned char* tail = data + blocks * 16;
+        size_t rest = length & 15;
+        uint64_t k1 = 0;
+        uint64_t k2 = 0;
+        for (size_t b = rest; b > 8; b--) {
+            k2 = (k2 << 8) | tail[b - 1];
+        }
+        for (size_t b = min(rest, (size_t)8); b > 0; b--) {
+            k1 = (k1 << 8) | tail[b - 1];
+        }
+        if (rest > 8) {
+            k2 *= c2; k2 = rotl(k2, 33); k2 *= c1; h2 ^= k2;
+        }
+        if (rest > 0) {
+            k1 *= c1; k1 = rotl(k1, 31); k1 *= c2; h1 ^= k1;
+        }
+        h1 ^= length;
+        h2 ^= length;
+        h1 += h2;
+        h2 += h1;
+        h1 = mix(h1);
+        h2 = mix(h2);
+        h1 += h2;
+        h2 += h1;
+        return BlobId{ h1, h2 };
+    }
+
+    string toHex() const {
+        char text[33];
+        snprintf(text, sizeof(text), "%016llx%016llx", (unsigned long long)high, (unsigned long long)low);
+        return text;
+    }
+
+    static bool fromHex(string_view text, BlobId& id) {
+        if (text.size() != 32 || text.find_first_not_of("0123456789abcdef") != string_view::npos) {
+            return false;
+        }
+        id.high = stoull(string(text.substr(0, 16)), nullptr, 16);
+        id.low = stoull(string(text.substr(16)), nullptr, 16);
+        return true;
+    }
+};
+
+struct BlobIdHash {
+    size_t operator()(const BlobId& id) const { return (size_t)id.low; }
+};
+
+class File {
+private:
+    string_view name;
+    BlobId content;
+public:
+    File(string_view filename, const BlobId& contentId) : name(filename), content(contentId) {}
+    string_view getName() const { return name; }
+    const BlobId& getContent() const { return content; }
+};
+
+// Set of file names for one repository. Files live densely in `files` and
+// an open-addressing table (linear probing, backward-shift deletion, no
+// tombstones) maps each name to its position, storing position + 1 so
+// that 0 marks an empty slot. Names are packed into a string pool that is
+// compacted once deleted names outweigh live ones.
+class FileIndex {
+private:
+    static constexpr size_t MIN_CAPACITY = 16;
+
+    vector<File> files;
+    vector<uint32_t> hashes; // parallel to files
+    vector<uint32_t> slots;
+    StringPool names;
+    vector<shared_ptr<const void>> borrowed; // external buffers that names point into
+    size_t liveBytes;
+
+    static uint32_t hashName(string_view name) {
+        return (uint32_t)hash<string_view>()(name);
+    }
+
+    size_t mask() const { return slots.size() - 1; }
+
+    // Slot holding the name, or the empty slot where it would go.
+    size_t findSlot(string_view name, uint32_t nameHash) const {
+        size_t slot = nameHash & mask();
+        while (slots[slot] != 0) {
+            uint32_t index = slots[slot] - 1;
+            if (hashes[index] == nameHash && files[index].getName() == name) {
+                return slot;
+            }
+            slot = (slot + 1) & mask();
+        }
+        return slot;
+    }
+
+    void rehash(size_t capacity) {
+        slots.assign(capacity, 0);
+        for (size_t i = 0; i < files.size(); i++) {
+            size_t slot = hashes[i] & mask();
+            while (slots[slot] != 0) {
+                slot = (slot + 1) & mask();
+            }
+            slots[slot] = (uint32_t)i + 1;
+        }
+    }
+
+    void compactNames() {
+        StringPool compacted;
+        for (File& file : files) {
+            file = File(compacted.store(file.getName()), file.getContent());
+        }
+        names = move(compacted);
+    }
+
+public:
+    FileIndex() : liveBytes(0) {}
+
+    // Copies share no storage with the original; names are repacked into a fresh pool.
+    FileIndex(const FileIndex& other) : hashes(other.hashes), slots(other.slots), liveBytes(0) {
+        files.reserve(other.files.size());
+        for (const File& file : other.files) {
+            files.push_back(File(names.store(file.getName()), file.getContent()));
+            liveBytes += file.getName().size();
+        }
+    }
+
+    FileIndex& operator=(const FileIndex&) = delete;
+
+    int size() const { return (int)files.size(); }
+    const File* data() const { return files.data(); }
+
+    bool contains(string_view name) const {
+        return !slots.empty() && slots[findSlot(name, hashName(name))] != 0;
+    }
+
+    const File* find(string_view name) const {
+        if (slots.empty()) {
+            return nullptr;
+        }
+        uint32_t position = slots[findSlot(name, hashName(name))];
+        return position != 0 ? &files[position - 1] : nullptr;
+    }
+
+    // With no storage the name is copied into the index's pool. Otherwise it
+    // is referenced in place and the index keeps the storage alive.
+    bool insert(string_view name, const BlobId& content, const shared_ptr<const void>& storage = nullptr) {
+        if (slots.empty() || (files.size() + 1) * 10 > slots.size() * 7) {
+            rehash(max(MIN_CAPACITY, slots.size() * 2));
+        }
+        uint32_t nameHash = hashName(name);
+        size_t slot = findSlot(name, nameHash);
+        if (slots[slot] != 0) {
+            return false;
+        }
+        if (storage) {
+            if (borrowed.empty() || borrowed.back() != storage) {
+                borrowed.push_back(storage);
+            }
+            files.push_back(File(name, content));
+        }
+        else {
+            files.push_back(File(names.store(name), content));
+            liveBytes += name.size();
+        }
+        hashes.push_back(nameHash);
+        slots[slot] = (uint32_t)files.size();
+        return true;
+    }
+
+    bool erase(string_view name) {
+        if (slots.empty()) {
+            return false;
+        }
+        size_t hole = findSlot(name, hashName(name));
+        if (slots[hole] == 0) {
+            return false;
+        }
+        uint32_t index = slots[hole] - 1;
+        if (borrowed.empty()) {
+            liveBytes -= files[index].getName().size();
+        }
+
+        // Backward-shift: pull later entries of the probe run into the hole
+        // unless that would move them in front of their home slot.
+        size_t next = hole;
+        while (true) {
+            next = (next + 1) & mask();
+            if (slots[next] == 0) {
+                break;
+            }
+            size_t home = hashes[slots[next] - 1] & mask();
+            if (((next - home) & mask()) >= ((next - hole) & mask())) {
+                slots[hole] = slots[next];
+                hole = next;
+            }
+        }
+        slots[hole] = 0;
+
+        // Keep files dense by moving the last one into the freed position.
+        uint32_t last = (uint32_t)files.size() - 1;
+        if (index != last) {
+            size_t slot = hashes[last] & mask();
+            while (slots[slot] != last + 1) {
+                slot = (slot + 1) & mask();
+            }
+            slots[slot] = index + 1;
+            files[index] = files[last];
+            hashes[index] = hashes[last];
+        }
+        files.pop_back();
+        hashes.pop_back();
+
+        if (borrowed.empty() && names.getBytesStored() > 4096 && names.getBytesStored() > liveBytes * 2) {
+            compactNames();
+        }
+        return true;
+    }
+
+    // Files whose path starts with the prefix, e.g. "src/" for a directory.
+    vector<const File*> listWithPrefix(string_view prefix) const {
+        vector<const File*> result;
+        for (const File& file : files) {
+            if (file.getName().substr(0, prefix.size()) == prefix) {
+                result.push_back(&file);
+            }
+        }
+        return result;
+    }
+};
+
+// The commits of every repository as one DAG. Each commit is a node with
+// up to two parents, its first parent being the head it was committed on
+// and its second the head a merge brought in. Forks share the nodes of
+// their source's history, so the graph never copies a commit. A node's id
+// hashes its parents' ids with its own author, time and message, so
+// identical histories collapse into the same nodes when loaded twice. A
+// root commit has no parent, so its repository's origin stands in.
+//
+// Ancestry queries avoid walking commit by commit. Nodes are grouped into
+// chains, runs where each node's first parent is the one before it, and a
+// query moves between chains through each chain's base (the first parent
+// of its first node) and its merges, so a long linear history costs the
+// same as a single commit. Generation numbers (one more than the highest
+// parent's) prune chains that are too old to matter, and each node keeps
+// a 64-bit bloom filter of the chains it can reach, which answers most
+// "not an ancestor" queries without any walk. Nodes are never removed.
+class CommitGraph {
+public:
+    static constexpr uint32_t NONE = UINT32_MAX;
+
+    struct Node {
+        BlobId id;
+        uint32_t parents[2]; // NONE where absent
+        uint32_t generation; // 1 for a root commit
+        uint32_t chain;
+        uint32_t position;   // within the chain
+        uint64_t reach;      // bloom filter of chains this node can reach
+    };
+
+private:
+    struct Chain {
+        uint32_t base;                             // first parent of nodes[0], or NONE
+        vector<uint32_t> nodes;
+        vector<pair<uint32_t, uint32_t>> merges;   // position of each merge and its second parent, by position
+    };
+
+    // Part of a chain known to be reachable: every node up to position.
+    struct Segment {
+        uint32_t chain;
+        uint32_t position;
+    };
+
+    mutable shared_mutex lock;
+    vector<Node> nodes;
+    vector<Chain> chains;
+    unordered_map<BlobId, uint32_t, BlobIdHash> byId;
+
+    static uint64_t chainBit(uint32_t chain) {
+        uint64_t mixed = chain * 0x9e3779b97f4a7c15ULL;
+        return 1ULL << (mixed >> 58);
+    }
+
+    uint32_t insertLocked(const BlobId& id, uint32_t firstParent, uint32_t secondParent) {
+        auto found = byId.find(id);
+        if (found != byId.end()) {
+            return found->second;
+        }
+        Node node = { id, { firstParent, secondParent }, 1, 0, 0, 0 };
+        if (firstParent != NONE) {
+            const Node& parent = nodes[firstParent];
+            node.generation = parent.generation + 1;
+            node.reach = parent.reach;
+            // Extend the parent's chain unless another commit already did.
+            if (chains[parent.chain].nodes.back() == firstParent) {
+                node.chain = parent.chain;
+                node.position = parent.position + 1;
+            }
+        }
+        if (firstParent == NONE || node.position == 0) {
+            node.chain = (uint32_t)chains.size();
+            chains.push_back({ firstParent, {}, {} });
+        }
+        if (secondParent != NONE) {
+            node.generation = max(node.generation, nodes[secondParent].generation + 1);
+            node.reach |= nodes[secondParent].reach;
+            chains[node.chain].merges.push_back({ node.position, secondParent });
+        }
+        node.reach |= chainBit(node.chain);
+        uint32_t index = (uint32_t)nodes.size();
+        chains[node.chain].nodes.push_back(index);
+        nodes.push_back(node);
+        byId.emplace(id, index);
+        return index;
+    }
+
+    // Visits every segment reachable from node, each chain once per new
+    // high position. visit returns false to stop; keep returns false for
+    // segments not worth entering. Returns false if visit stopped it.
+    template <typename Visit, typename Keep>
+    bool walkSegments(uint32_t start, Visit visit, Keep keep) const {
+        unordered_map<uint32_t, uint32_t> expanded; // chain -> one past the highest position expanded
+        vector<Segment> pending = { { nodes[start].chain, nodes[start].position } };
+        while (!pending.empty()) {
+            Segment segment = pending.back();
+            pending.pop_back();
+            auto seen = expanded.find(segment.chain);
+            uint32_t from = seen != expanded.end() ? seen->second : 0;
+            if (seen != expanded.end() && segment.position < from) {
+                continue;
+            }
+            expanded[segment.chain] = segment.position + 1;
+            if (!visit(segment)) {
+                return false;
+            }
+            const Chain& chain = chains[segment.chain];
+            if (from == 0 && chain.base != NONE && keep(chain.base)) {
+                pending.push_back({ nodes[chain.base].chain, nodes[chain.base].position });
+            }
+            auto merge = lower_bound(chain.merges.begin(), chain.merges.end(), make_pair(from, (uint32_t)0));
+            for (; merge != chain.merges.end() && merge->first <= segment.position; ++merge) {
+                if (keep(merge->second)) {
+                    pending.push_back({ nodes[merge->second].chain, nodes[merge->second].position });
+                }
+            }
+        }
+        return true;
+    }
+
+    bool isAncestorLocked(uint32_t ancestor, uint32_t descendant) const {
+        if (ancestor == descendant) {
+            return true;
+        }
+        const Node& target = nodes[ancestor];
+        if (target.generation >= nodes[descendant].generation || !(nodes[descendant].reach & chainBit(target.chain))) {
+            return false;
+        }
+        bool found = false;
+        walkSegments(descendant, [&](Segment segment) {
+            found = segment.chain == target.chain && segment.position >= target.position;
+            return !found;
+        }, [&](uint32_t node) {
+            return nodes[node].generation >= target.generation && (nodes[node].reach & chainBit(target.chain));
+        });
+        return found;
+    }
+
+    // Every chain reachable from node, with the highest reachable position in it.
+    unordered_map<uint32_t, uint32_t> reachLocked(uint32_t node) const {
+        unordered_map<uint32_t, uint32_t> reached;
+        walkSegments(node, [&](Segment segment) {
+            reached[segment.chain] = segment.position;
+            return true;
+        }, [](uint32_t) { return true; });
+        return reached;
+    }
+
+public:
+    static BlobId commitId(const BlobId& firstParent, const BlobId& secondParent, string_view message, uint32_t author, int64_t timestamp) {
+        string key;
+        key.reserve(48 + message.size());
+        for (uint64_t word : { firstParent.high, firstParent.low, secondParent.high, secondParent.low, (uint64_t)author, (uint64_t)timestamp }) {
+            key.append((const char*)&word, sizeof(word));
+        }
+        key.append(message.data(), message.size());
+        return BlobId::of(key);
+    }
+
+    // Adds a commit and returns its node; an identical commit on the same
+    // parents is the node already there. A root commit hashes origin in
+    // place of its first parent, so the first commits of different
+    // repositories stay apart even when their message, author and time agree.
+    uint32_t add(uint32_t firstParent, uint32_t secondParent, string_view message, uint32_t author, int64_t timestamp, const BlobId& origin = BlobId()) {
+        unique_lock<shared_mutex> guard(lock);
+        BlobId id = commitId(firstParent != NONE ? nodes[firstParent].id : origin, secondParent != NONE ? nodes[secondParent].id : BlobId(),
+            message, author, timestamp);
+        return insertLocked(id, firstParent, secondParent);
+    }
+
+    // Adds a node whose id is already known, as when loading a snapshot.
+    uint32_t insert(const BlobId& id, uint32_t firstParent, uint32_t secondParent) {
+        unique_lock<shared_mutex> guard(lock);
+        return insertLocked(id, firstParent, secondParent);
+    }
+
+    Node get(uint32_t node) const {
+        shared_lock<shared_mutex> guard(lock);
+        return nodes[node];
+    }
+
+    size_t size() const {
+        shared_lock<shared_mutex> guard(lock);
+        return nodes.size();
+    }
+
+    size_t chainCount() const {
+        shared_lock<shared_mutex> guard(lock);
+        return chains.size();
+    }
+
+    // True if ancestor is descendant or reachable from it through parents.
+    bool isAncestor(uint32_t ancestor, uint32_t descendant) const {
+        if (ancestor == NONE || descendant == NONE) {
+            return ancestor == NONE;
+        }
+        shared_lock<shared_mutex> guard(lock);
+        return isAncestorLocked(ancestor, descendant);
+    }
+
+    // Calls emit(index, node, fromFirst) for each commit reachable from
+    // exactly one of first and second, highest generation first, until emit
+    // returns false. The walk stops once every commit still queued is
+    // reachable from both, so it costs about the size of the difference
+    // rather than of the histories. The graph stays locked; emit must not
+    // call into it.
+    template <typename Emit>
+    void difference(uint32_t first, uint32_t second, Emit emit) const {
+        enum : uint8_t { FIRST = 1, SECOND = 2, BOTH = 3 };
+        if (first == second) {
+            return;
+        }
+        shared_lock<shared_mutex> guard(lock);
+        // A commit's parents have lower generations than it, so by the time
+        // one is popped every path to it from either side has painted it.
+        unordered_map<uint32_t, uint8_t> paint;
+        priority_queue<pair<uint32_t, uint32_t>> queue; // generation, node
+        size_t undecided = 0; // queued commits painted by one side only
+        auto reach = [&](uint32_t node, uint8_t side) {
+            auto painted = paint.emplace(node, side);
+            if (painted.second) {
+                queue.push({ nodes[node].generation, node });
+                undecided += side != BOTH;
+            }
+            else if (painted.first->second != BOTH && (painted.first->second | side) == BOTH) {
+                painted.first->second = BOTH;
+                undecided--;
+            }
+        };
+        if (first != NONE) {
+            reach(first, FIRST);
+        }
+        if (second != NONE) {
+            reach(second, SECOND);
+        }
+        while (undecided > 0) {
+            uint32_t node = queue.top().second;
+            queue.pop();
+            uint8_t side = paint[node];
+            if (side != BOTH) {
+                undecided--;
+                if (!emit(node, nodes[node], side == FIRST)) {
+                    return;
+                }
+            }
+            for (uint32_t parent : nodes[node].parents) {
+                if (parent != NONE) {
+                    reach(parent, side);
+                }
+            }
+        }
+    }
+
+    // The best common ancestors of a and b: common ancestors that are not
+    // ancestors of another common ancestor, highest generation first.
+    // Usually one; criss-cross merges can leave several.
+    vector<uint32_t> mergeBases(uint32_t a, uint32_t b) const {
+        if (a == NONE || b == NONE) {
+            return {};
+        }
+        shared_lock<shared_mutex> guard(lock);
+        unordered_map<uint32_t, uint32_t> fromA = reachLocked(a);
+        unordered_map<uint32_t, uint32_t> fromB = reachLocked(b);
+        if (fromA.size() > fromB.size()) {
+            swap(fromA, fromB);
+        }
+        // In each chain both reach, the common ancestors are the nodes up
+        // to the lower of the two positions.
+        vector<uint32_t> candidates;
+        for (const auto& reached : fromA) {
+            auto other = fromB.find(reached.first);
+            if (other != fromB.end()) {
+                candidates.push_back(chains[reached.first].nodes[min(reached.second, other->second)]);
+            }
+        }
+        sort(candidates.begin(), candidates.end(), [this](uint32_t x, uint32_t y) {
+            return nodes[x].generation != nodes[y].generation ? nodes[x].generation > nodes[y].generation : x < y;
+        });
+        vector<uint32_t> bases;
+        for (uint32_t candidate : candidates) {
+            bool covered = false;
+            for (size_t i = 0; i < bases.size() && !covered; i++) {
+                covered = isAncestorLocked(candidate, bases[i]);
+            }
+            if (!covered) {
+                bases.push_back(candidate);
+            }
+        }
+        return bases;
+    }
+};
+
+class Repository {
+private:
+    string name;
+    CommitLog commits;
+    shared_ptr<FileIndex> files; // shared with forks until one side modifies it
+    bool isPublic;
+    int forkCount;
+    uint32_t ownerId; // interned username of the owner, or of the forking user for a fork
+    mutable mutex lock;
+
+    // A fork remembers the repository it was forked from. Repositories that
+    // are forks or have been forked also keep the names of the files they
+    // add or delete, so comparing a fork with its upstream only has to look
+    // at files that changed on either side since the fork.
+    uint64_t serial;           // tells apart repositories that had the same name at different times
+    uint64_t upstreamSerial;   // the upstream's serial, 0 if this is not a fork
+    uint32_t upstreamOwner;    // the upstream's owner, StringInterner::NONE if this is not a fork
+    size_t upstreamChangeMark; // how many file changes the upstream had recorded at the fork
+    StringPool changedNames;
+    vector<string_view> fileChanges;
+
+    static uint64_t newSerial() {
+        static atomic<uint64_t> next(1);
+        return next++;
+    }
+
+    void fileChanged(string_view fileName) {
+        if (upstreamOwner != StringInterner::NONE || forkCount > 0) {
+            fileChanges.push_back(changedNames.store(fileName));
+        }
+    }
+
+    // A fork shares the source's file index until either side writes to it.
+    FileIndex& writableFiles() {
+        if (files.use_count() > 1) {
+            files = make_shared<FileIndex>(*files);
+        }
+        return *files;
+    }
+
+public:
+    static void* operator new(size_t size) { return SlabAllocator<Repository>::instance("Repository").allocate(size); }
+    static void operator delete(void* pointer, size_t size) { SlabAllocator<Repository>::instance("Repository").deallocate(pointer, size); }
+
+    Repository(string repoName, bool public_) : name(repoName), files(make_shared<FileIndex>()), isPublic(public_), forkCount(0), ownerId(StringInterner::NONE),
+        serial(newSerial()), upstreamSerial(0), upstreamOwner(StringInterner::NONE), upstreamChangeMark(0) {}
+    const string& getName() const { return name; }
+
+    // Repositories do no locking of their own. Threads sharing one hold
+    // this around every call after construction; the name never changes.
+    mutex& getLock() const { return lock; }
+
+    // Appends a commit on top of the head and returns its node in graph.
+    // A merge also names the head of the history it brings in. See Commit
+    // for the author and timestamp, and CommitLog::append for the storage.
+    uint32_t addCommit(CommitGraph& graph, string_view message, uint32_t author, int64_t timestamp,
+        const shared_ptr<const void>& storage = nullptr, uint32_t mergedHead = CommitGraph::NONE) {
+        uint32_t head = getHead();
+        uint32_t node = graph.add(head, mergedHead, message, author, timestamp, head == CommitGraph::NONE ? origin() : BlobId());
+        commits.append(message, author, timestamp, node, storage);
+        return node;
+    }
+
+    // Appends a commit whose node is already in the graph, as when loading.
+    void restoreCommit(uint32_t node, string_view message, uint32_t author, int64_t timestamp, const shared_ptr<const void>& storage = nullptr) {
+        commits.append(message, author, timestamp, node, storage);
+    }
+
+    // Identity of this repository's history, for its root commit: the owner
+    // and name, which no other repository shares while this one exists.
+    BlobId origin() const {
+        string key((const char*)&ownerId, sizeof(ownerId));
+        key += name;
+        return BlobId::of(key);
+    }
+
+    // Node of the newest commit, or CommitGraph::NONE with no history.
+    uint32_t getHead() const { return commits.size() > 0 ? commits[commits.size() - 1].getNode() : CommitGraph::NONE; }
+
+    // Returns false if a file with this name already exists. The content
+    // itself lives in a BlobStore; the repository only keeps its id.
+    bool addFile(string_view fileName, const BlobId& content, const shared_ptr<const void>& storage = nullptr) {
+        if (!writableFiles().insert(fileName, content, storage)) {
+            return false;
+        }
+        fileChanged(fileName);
+        return true;
+    }
+
+    bool hasFile(string_view fileName) const {
+        return files->contains(fileName);
+    }
+
+    const File* getFile(string_view fileName) const {
+        return files->find(fileName);
+    }
+
+    bool deleteFile(string_view fileName) {
+        if (!files->contains(fileName)) {
+            return false;
+        }
+        fileChanged(fileName);
+        return writableFiles().erase(fileName);
+    }
+
+    vector<const File*> listFiles(string_view pathPrefix) const {
+        return files->listWithPrefix(pathPrefix);
+    }
+
+   
+
+
+    void setPublic(bool isPublic) {
+        this->isPublic = isPublic;
+    }
+
+
+    const CommitLog& getCommits() const { return commits; }
+
+    const File* getFiles() const { return files->data(); }
+
+    int getCommitCount() const { return commits.size(); }
+
+    int getFileCount() const { return files->size(); }
+
+    bool isRepositoryPublic() const { return isPublic; }
+
+    int getForkCount() const { return forkCount; }
+
+    void incrementForkCount() { forkCount++; }
+
+    void setForkCount(int count) { forkCount = count; }
+
+    uint32_t getOwnerId() const { return ownerId; }
+    void setOwnerId(uint32_t id) { ownerId = id; }
+
+    uint64_t getSerial() const { return serial; }
+    uint64_t getUpstreamSerial() const { return upstreamSerial; }
+    uint32_t getUpstreamOwner() const { return upstreamOwner; }
+    bool isFork() const { return upstreamOwner != StringInterner::NONE; }
+
+    // New repository with the same name, visibility, history and files.
+    // Nothing is copied: both sides share storage until they diverge.
+    Repository* fork() {
+        Repository* forked = new Repository(name, isPublic);
+        forked->commits = commits.share();
+        forked->files = files;
+        forked->upstreamSerial = serial;
+        forked->upstreamOwner = ownerId;
+        forked->upstreamChangeMark = fileChanges.size();
+        return forked;
+    }
+
+    // Names of the files that may differ between this fork and upstream:
+    // those either side added or deleted since the fork, possibly repeated.
+    // The views last while both repositories are locked.
+    vector<string_view> filesChangedSinceFork(const Repository& upstream) const {
+        vector<string_view> changed = fileChanges;
+        if (files != upstream.files) {
+            changed.insert(changed.end(), upstream.fileChanges.begin() + min(upstreamChangeMark, upstream.fileChanges.size()), upstream.fileChanges.end());
+        }
+        return changed;
+    }
+
+    // Forgets the file changes recorded so far, as after a load, where
+    // they only repeat the files themselves.
+    void clearFileChanges() {
+        fileChanges.clear();
+        changedNames = StringPool();
+    }
+
+    // Makes this a fork of upstream as it is now, for forks loaded without
+    // their change history: every file in which the two differ counts as
+    // changed on this side. Clear upstream's changes first.
+    void resetUpstream(const Repository& upstream) {
+        clearFileChanges();
+        upstreamSerial = upstream.serial;
+        upstreamOwner = upstream.ownerId;
+        upstreamChangeMark = upstream.fileChanges.size();
+        if (files == upstream.files) {
+            return;
+        }
+        for (int i = 0; i < files->size(); i++) {
+            const File& file = files->data()[i];
+            const File* counterpart = upstream.files->find(file.getName());
+            if (!counterpart || counterpart->getContent() != file.getContent()) {
+                fileChanges.push_back(changedNames.store(file.getName()));
+            }
+        }
+        for (int i = 0; i < upstream.files->size(); i++) {
+            const File& file = upstream.files->data()[i];
+            if (!files->contains(file.getName())) {
+                fileChanges.push_back(changedNames.store(file.getName()));
+            }
+        }
+    }
+
+    // Stops treating this as a fork, when its upstream is gone.
+    void clearUpstream() {
+        upstreamSerial = 0;
+        upstreamOwner = StringInterner::NONE;
+        upstreamChangeMark = 0;
+    }
+
+};
+
+class Tree {
+private:
+    // B+ tree keyed on the repository name. Every node keeps the first
+    // eight bytes of each key packed big-endian into a uint64_t, so the
+    // search loop compares integers in a contiguous array and only touches
+    // the full name when two prefixes tie.
+    static constexpr int ORDER = 32;
+    static constexpr int MIN_KEYS = ORDER / 2;
+
+    struct Node {
+        bool isLeaf;
+        int keyCount;
+        uint64_t prefixes[ORDER + 1];
+
+        Node(bool leaf) : isLeaf(leaf), keyCount(0) {}
+    };
+
+    struct LeafNode : Node {
+        Repository* repositories[ORDER + 1];
+        LeafNode* next;
+
+        LeafNode() : Node(true), next(nullptr) {}
+
+        static void* operator new(size_t size) { return SlabAllocator<LeafNode>::instance("Tree leaf node").allocate(size); }
+        static void operator delete(void* pointer, size_t size) { SlabAllocator<LeafNode>::instance("Tree leaf node").deallocate(pointer, size); }
+    };
+
+    // children[i] holds keys below separators[i]; children[i + 1] holds keys at or above it.
+    struct InnerNode : Node {
+        string separators[ORDER + 1];
+        Node* children[ORDER + 2];
+
+        // Inner nodes are few and large, so they stay on the general heap.
+        InnerNode() : Node(false) {}
+    };
+
+    Node* root;
+    int repositoryCount;
+
+    static uint64_t keyPrefix(const string& key) {
+        uint64_t prefix = 0;
+        for (size_t i = 0; i < 8; i++) {
+            prefix <<= 8;
+            if (i < key.size()) {
+                prefix |= (unsigned char)key[i];
+            }
+        }
+        return prefix;
+    }
+
+    static int leafLowerBound(const LeafNode* leaf, uint64_t prefix, const string& key) {
+        int i = 0;
+        while (i < leaf->keyCount && leaf->prefixes[i] < prefix) {
+            i++;
+        }
+        while (i < leaf->keyCount && leaf->prefixes[i] == prefix && leaf->repositories[i]->getName() < key) {
+            i++;
+        }
+        return i;
+    }
+
+    static int childIndex(const InnerNode* node, uint64_t prefix, const string& key) {
+        int i = 0;
+        while (i < node->keyCount && node->prefixes[i] < prefix) {
+            i++;
+        }
+        while (i < node->keyCount && node->prefixes[i] == prefix && node->separators[i] <= key) {
+            i++;
+        }
+        return i;
+    }
+
+    // Leaf holding the first key that is not less than the given key.
+    const LeafNode* findLeaf(uint64_t prefix, const string& key) const {
+        const Node* node = root;
+        while (node && !node->isLeaf) {
+            const InnerNode* inner = static_cast<const InnerNode*>(node);
+            node = inner->children[childIndex(inner, prefix, key)];
+        }
+        return static_cast<const LeafNode*>(node);
+    }
+
+    bool insert(Node* node, Repository* repository, uint64_t prefix, Node*& splitNode, string& splitKey) {
+        if (node->isLeaf) {
+            LeafNode* leaf = static_cast<LeafNode*>(node);
+            const string& key = repository->getName();
+            int pos = leafLowerBound(leaf, prefix, key);
+            if (pos < leaf->keyCount && leaf->repositories[pos]->getName() == key) {
+                return false;
+            }
+            for (int i = leaf->keyCount; i > pos; i--) {
+                leaf->prefixes[i] = leaf->prefixes[i - 1];
+                leaf->repositories[i] = leaf->repositories[i - 1];
+            }
+            leaf->prefixes[pos] = prefix;
+            leaf->repositories[pos] = repository;
+            leaf->keyCount++;
+
+            if (leaf->keyCount > ORDER) {
+                LeafNode* right = new LeafNode();
+                int mid = leaf->keyCount / 2;
+                for (int i = mid; i < leaf->keyCount; i++) {
+                    right->prefixes[i - mid] = leaf->prefixes[i];
+                    right->repositories[i - mid] = leaf->repositories[i];
+                }
+                right->keyCount = leaf->keyCount - mid;
+                leaf->keyCount = mid;
+                right->next = leaf->next;
+                leaf->next = right;
+                splitNode = right;
+                splitKey = right->repositories[0]->getName();
+            }
+            return true;
+        }
+
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        int idx = childIndex(inner, prefix, repository->getName());
+        Node* childSplit = nullptr;
+        string childKey;
+        if (!insert(inner->children[idx], repository, prefix, childSplit, childKey)) {
+            return false;
+        }
+        if (!childSplit) {
+            return true;
+        }
+
+        for (int i = inner->keyCount; i > idx; i--) {
+            inner->prefixes[i] = inner->prefixes[i - 1];
+            inner->separators[i].swap(inner->separators[i - 1]);
+            inner->children[i + 1] = inner->children[i];
+        }
+        inner->prefixes[idx] = keyPrefix(childKey);
+        inner->separators[idx].swap(childKey);
+        inner->children[idx + 1] = childSplit;
+        inner->keyCount++;
+
+        if (inner->keyCount > ORDER) {
+            InnerNode* right = new InnerNode();
+            int mid = inner->keyCount / 2;
+            for (int i = mid + 1; i < inner->keyCount; i++) {
+                right->prefixes[i - mid - 1] = inner->prefixes[i];
+                right->separators[i - mid - 1].swap(inner->separators[i]);
+                right->children[i - mid - 1] = inner->children[i];
+            }
+            right->children[inner->keyCount - mid - 1] = inner->children[inner->keyCount];
+            right->keyCount = inner->keyCount - mid - 1;
+            splitKey.swap(inner->separators[mid]);
+            inner->keyCount = mid;
+            splitNode = right;
+        }
+        return true;
+    }
+
+    void removeFromInner(InnerNode* node, int sepIndex) {
+        for (int i = sepIndex; i < node->keyCount - 1; i++) {
+            node->prefixes[i] = node->prefixes[i + 1];
+            node->separators[i].swap(node->separators[i + 1]);
+            node->children[i + 1] = node->children[i + 2];
+        }
+        node->keyCount--;
+    }
+
+    // Restores the minimum occupancy of parent->children[idx] by borrowing
+    // from a sibling, or merging with one when neither can spare a key.
+    void rebalance(InnerNode* parent, int idx) {
+        Node* child = parent->children[idx];
+        Node* left = idx > 0 ? parent->children[idx - 1] : nullptr;
+        Node* right = idx < parent->keyCount ? parent->children[idx + 1] : nullptr;
+
+        if (child->isLeaf) {
+            LeafNode* leaf = static_cast<LeafNode*>(child);
+            if (left && left->keyCount > MIN_KEYS) {
+                LeafNode* donor = static_cast<LeafNode*>(left);
+                for (int i = leaf->keyCount; i > 0; i--) {
+                    leaf->prefixes[i] = leaf->prefixes[i - 1];
+                    leaf->repositories[i] = leaf->repositories[i - 1];
+                }
+                donor->keyCount--;
+                leaf->prefixes[0] = donor->prefixes[donor->keyCount];
+                leaf->repositories[0] = donor->repositories[donor->keyCount];
+                leaf->keyCount++;
+                parent->separators[idx - 1] = leaf->repositories[0]->getName();
+                parent->prefixes[idx - 1] = leaf->prefixes[0];
+            }
+            else if (right && right->keyCount > MIN_KEYS) {
+                LeafNode* donor = static_cast<LeafNode*>(right);
+                leaf->prefixes[leaf->keyCount] = donor->prefixes[0];
+                leaf->repositories[leaf->keyCount] = donor->repositories[0];
+                leaf->keyCount++;
+                for (int i = 0; i < donor->keyCount - 1; i++) {
+                    donor->prefixes[i] = donor->prefixes[i + 1];
+                    donor->repositories[i] = donor->repositories[i + 1];
+                }
+                donor->keyCount--;
+                parent->separators[idx] = donor->repositories[0]->getName();
+                parent->prefixes[idx] = donor->prefixes[0];
+            }
+            else {
+                int sepIndex = left ? idx - 1 : idx;
+                LeafNode* into = static_cast<LeafNode*>(parent->children[sepIndex]);
+                LeafNode* from = static_cast<LeafNode*>(parent->children[sepIndex + 1]);
+                for (int i = 0; i < from->keyCount; i++) {
+                    into->prefixes[into->keyCount + i] = from->prefixes[i];
+                    into->repositories[into->keyCount + i] = from->repositories[i];
+                }
+                into->keyCount += from->keyCount;
+                into->next = from->next;
+                removeFromInner(parent, sepIndex);
+                delete from;
+            }
+            return;
+        }
+
+        InnerNode* inner = static_cast<InnerNode*>(child);
+        if (left && left->keyCount > MIN_KEYS) {
+            InnerNode* donor = static_cast<InnerNode*>(left);
+            inner->children[inner->keyCount + 1] = inner->children[inner->keyCount];
+            for (int i = inner->keyCount; i > 0; i--) {
+                inner->prefixes[i] = inner->prefixes[i - 1];
+                inner->separators[i].swap(inner->separators[i - 1]);
+                inner->children[i] = inner->children[i - 1];
+            }
+            inner->prefixes[0] = parent->prefixes[idx - 1];
+            inner->separators[0].swap(parent->separators[idx - 1]);
+            inner->children[0] = donor->children[donor->keyCount];
+            inner->keyCount++;
+            donor->keyCount--;
+            parent->prefixes[idx - 1] = donor->prefixes[donor->keyCount];
+            parent->separators[idx - 1].swap(donor->separators[donor->keyCount]);
+        }
+        else if (right && right->keyCount > MIN_KEYS) {
+            InnerNode* donor = static_cast<InnerNode*>(right);
+            inner->prefixes[inner->keyCount] = parent->prefixes[idx];
+            inner->separators[inner->keyCount].swap(parent->separators[idx]);
+            inner->children[inner->keyCount + 1] = donor->children[0];
+            inner->keyCount++;
+            parent->prefixes[idx] = donor->prefixes[0];
+            parent->separators[idx].swap(donor->separators[0]);
+            for (int i = 0; i < donor->keyCount - 1; i++) {
+                donor->prefixes[i] = donor->prefixes[i + 1];
+                donor->separators[i].swap(donor->separators[i + 1]);
+                donor->children[i] = donor->children[i + 1];
+            }
+            donor->children[donor->keyCount - 1] = donor->children[donor->keyCount];
+            donor->keyCount--;
+        }
+        else {
+            int sepIndex = left ? idx - 1 : idx;
+            InnerNode* into = static_cast<InnerNode*>(parent->children[sepIndex]);
+            InnerNode* from = static_cast<InnerNode*>(parent->children[sepIndex + 1]);
+            into->prefixes[into->keyCount] = parent->prefixes[sepIndex];
+            into->separators[into->keyCount].swap(parent->separators[sepIndex]);
+            into->keyCount++;
+            for (int i = 0; i < from->keyCount; i++) {
+                into->prefixes[into->keyCount + i] = from->prefixes[i];
+                into->separators[into->keyCount + i].swap(from->separators[i]);
+                into->children[into->keyCount + i] = from->children[i];
+            }
+            into->children[into->keyCount + from->keyCount] = from->children[from->keyCount];
+            into->keyCount += from->keyCount;
+            removeFromInner(parent, sepIndex);
+            delete from;
+        }
+    }
+
+    Repository* erase(Node* node, uint64_t prefix, const string& key) {
+        if (node->isLeaf) {
+            LeafNode* leaf = static_cast<LeafNode*>(node);
+            int pos = leafLowerBound(leaf, prefix, key);
+            if (pos == leaf->keyCount || leaf->repositories[pos]->getName() != key) {
+                return nullptr;
+            }
+            Repository* removed = leaf->repositories[pos];
+            for (int i = pos; i < leaf->keyCount - 1; i++) {
+                leaf->prefixes[i] = leaf->prefixes[i + 1];
+                leaf->repositories[i] = leaf->repositories[i + 1];
+            }
+            leaf->keyCount--;
+            return removed;
+        }
+
+        InnerNode* inner = static_cast<InnerNode*>(node);
+        int idx = childIndex(inner, prefix, key);
+        Repository* removed = erase(inner->children[idx], prefix, key);
+        if (removed && inner->children[idx]->keyCount < MIN_KEYS) {
+            rebalance(inner, idx);
+        }
+        return removed;
+    }
+
+    // Frees the nodes of a subtree; the repositories are left alone when
+    // deleteRepositories is false.
+    void freeNodes(Node* node, bool deleteRepositories = false) {
+        if (!node) {
+            return;
+        }
+        if (node->isLeaf) {
+            LeafNode* leaf = static_cast<LeafNode*>(node);
+            if (deleteRepositories) {
+                for (int i = 0; i < leaf->keyCount; i++) {
+                    delete leaf->repositories[i];
+                }
+            }
+            delete leaf;
+        }
+        else {
+            InnerNode* inner = static_cast<InnerNode*>(node);
+            for (int i = 0; i <= inner->keyCount; i++) {
+                freeNodes(inner->children[i], deleteRepositories);
+            }
+            delete inner;
+        }
+    }
+
+    void deleteTree(Node* node) {
+        freeNodes(node, true);
+    }
+
+    // Rebuilds the index bottom-up from entries already in name order, with
+    // every node evenly filled so that no node falls below MIN_KEYS.
+    void bulkLoad(const vector<pair<uint64_t, Repository*>>& entries) {
+        root = nullptr;
+        repositoryCount = (int)entries.size();
+        if (entries.empty()) {
+            return;
+        }
+
+        vector<Node*> level;
+        vector<string> levelKeys; // smallest key under each node of the current level
+        size_t leafCount = (entries.size() + ORDER - 1) / ORDER;
+        size_t offset = 0;
+        LeafNode* previous = nullptr;
+        for (size_t i = 0; i < leafCount; i++) {
+            size_t take = (entries.size() - offset) / (leafCount - i);
+            LeafNode* leaf = new LeafNode();
+            for (size_t j = 0; j < take; j++) {
+                leaf->prefixes[j] = entries[offset + j].first;
+                leaf->repositories[j] = entries[offset + j].second;
+            }
+            leaf->keyCount = (int)take;
+            offset += take;
+            if (previous) {
+                previous->next = leaf;
+            }
+            previous = leaf;
+            level.push_back(leaf);
+            levelKeys.push_back(leaf->repositories[0]->getName());
+        }
+
+        while (level.size() > 1) {
+            vector<Node*> parents;
+            vector<string> parentKeys;
+            size_t parentCount = (level.size() + ORDER) / (ORDER + 1);
+            offset = 0;
+            for (size_t i = 0; i < parentCount; i++) {
+                size_t take = (level.size() - offset) / (parentCount - i);
+                InnerNode* inner = new InnerNode();
+                inner->children[0] = level[offset];
+                for (size_t j = 1; j < take; j++) {
+                    inner->prefixes[j - 1] = keyPrefix(levelKeys[offset + j]);
+                    inner->separators[j - 1].swap(levelKeys[offset + j]);
+                    inner->children[j] = level[offset + j];
+                }
+                inner->keyCount = (int)take - 1;
+                parents.push_back(inner);
+                parentKeys.push_back(move(levelKeys[offset]));
+                offset += take;
+            }
+            level.swap(parents);
+            levelKeys.swap(parentKeys);
+        }
+        root = level[0];
+    }
+
+    const LeafNode* firstLeaf() const {
+        const Node* node = root;
+        while (node && !node->isLeaf) {
+            node = static_cast<const InnerNode*>(node)->children[0];
+        }
+        return static_cast<const LeafNode*>(node);
+    }
+
+    // Up to limit repositories with from <= name < to, in name order.
+    vector<Repository*> collectRange(const string& from, const string& to, size_t limit) const {
+        vector<Repository*> result;
+        uint64_t fromPrefix = keyPrefix(from);
+        uint64_t toPrefix = keyPrefix(to);
+        const LeafNode* leaf = findLeaf(fromPrefix, from);
+        int pos = leaf ? leafLowerBound(leaf, fromPrefix, from) : 0;
+        while (leaf && result.size() < limit) {
+            for (; pos < leaf->keyCount && result.size() < limit; pos++) {
+                if (leaf->prefixes[pos] > toPrefix ||
+                    (leaf->prefixes[pos] == toPrefix && leaf->repositories[pos]->getName() >= to)) {
+                    return result;
+                }
+                result.push_back(leaf->repositories[pos]);
+            }
+            leaf = leaf->next;
+            pos = 0;
+        }
+        return result;
+    }
+
+    // Swaps in a bulk-loaded index of the survivors and frees the victims.
+    int rebuildWithout(const vector<pair<uint64_t, Repository*>>& survivors, const vector<Repository*>& victims) {
+        if (victims.empty()) {
+            return 0;
+        }
+        freeNodes(root);
+        bulkLoad(survivors);
+        for (Repository* repository : victims) {
+            delete repository;
+        }
+        return (int)victims.size();
+    }
+
+    // Drops every matching repository in one pass over the leaves, then
+    // restores balance with a single bulk load of the survivors.
+    int filterAndRebuild(const function<bool(const Repository*)>& shouldDelete) {
+        vector<pair<uint64_t, Repository*>> survivors;
+        vector<Repository*> victims;
+        survivors.reserve(repositoryCount);
+
+        for (const LeafNode* leaf = firstLeaf(); leaf; leaf = leaf->next) {
+            for (int i = 0; i < leaf->keyCount; i++) {
+                if (shouldDelete(leaf->repositories[i])) {
+                    victims.push_back(leaf->repositories[i]);
+                }
+                else {
+                    survivors.push_back(make_pair(leaf->prefixes[i], leaf->repositories[i]));
+                }
+            }
+        }
+        return rebuildWithout(survivors, victims);
+    }
+
+    // Same as filterAndRebuild for a contiguous [from, to) range. Entries
+    // outside the range are copied without touching the repositories, and
+    // inside it the inline prefixes settle the upper bound without a name
+    // comparison for all but the last few keys.
+    int filterRangeAndRebuild(const string& from, const string& to) {
+        vector<pair<uint64_t, Repository*>> survivors;
+        vector<Repository*> victims;
+        survivors.reserve(repositoryCount);
+
+        uint64_t fromPrefix = keyPrefix(from);
+        uint64_t toPrefix = keyPrefix(to);
+        const LeafNode* start = findLeaf(fromPrefix, from);
+        int startPos = start ? leafLowerBound(start, fromPrefix, from) : 0;
+        bool pastRange = false;
+
+        for (const LeafNode* leaf = firstLeaf(); leaf; leaf = leaf->next) {
+            int i = 0;
+            if (leaf == start) {
+                for (; i < startPos; i++) {
+                    survivors.push_back(make_pair(leaf->prefixes[i], leaf->repositories[i]));
+                }
+                start = nullptr;
+            }
+            else if (start) {
+                for (; i < leaf->keyCount; i++) {
+                    survivors.push_back(make_pair(leaf->prefixes[i], leaf->repositories[i]));
+                }
+                continue;
+            }
+            for (; i < leaf->keyCount; i++) {
+                if (!pastRange) {
+                    pastRange = leaf->prefixes[i] > toPrefix ||
+                        (leaf->prefixes[i] == toPrefix && leaf->repositories[i]->getName() >= to);
+                }
+                if (pastRange) {
+                    survivors.push_back(make_pair(leaf->prefixes[i], leaf->repositories[i]));
+                }
+                else {
+                    victims.push_back(leaf->repositories[i]);
+                }
+            }
+        }
+        return rebuildWithout(survivors, victims);
+    }
+
+public:
+    Tree() : root(nullptr), repositoryCount(0) {}
+
+    ~Tree() {
+        deleteTree(root);
+    }
+
+    Tree(const Tree&) = delete;
+    Tree& operator=(const Tree&) = delete;
+
+    int size() const { return repositoryCount; }
+
+    bool addRepository(Repository* repository) {
+        if (!root) {
+            root = new LeafNode();
+        }
+
+        Node* splitNode = nullptr;
+        string splitKey;
+        if (!insert(root, repository, keyPrefix(repository->getName()), splitNode, splitKey)) {
+            return false;
+        }
+        if (splitNode) {
+            InnerNode* newRoot = new InnerNode();
+            newRoot->prefixes[0] = keyPrefix(splitKey);
+            newRoot->separators[0].swap(splitKey);
+            newRoot->children[0] = root;
+            newRoot->children[1] = splitNode;
+            newRoot->keyCount = 1;
+            root = newRoot;
+        }
+        repositoryCount++;
+        return true;
+    }
+
+    Repository* searchRepository(const string& repoName) const {
+        uint64_t prefix = keyPrefix(repoName);
+        const LeafNode* leaf = findLeaf(prefix, repoName);
+        if (!leaf) {
+            return nullptr;
+        }
+        int pos = leafLowerBound(leaf, prefix, repoName);
+        if (pos < leaf->keyCount && leaf->repositories[pos]->getName() == repoName) {
+            return leaf->repositories[pos];
+        }
+        return nullptr;
+    }
+
+    bool deleteRepository(const string& repoName) {
+        if (!root) {
+            return false;
+        }
+        Repository* removed = erase(root, keyPrefix(repoName), repoName);
+        if (!removed) {
+            return false;
+        }
+
+        if (!root->isLeaf && root->keyCount == 0) {
+            InnerNode* oldRoot = static_cast<InnerNode*>(root);
+            root = oldRoot->children[0];
+            delete oldRoot;
+        }
+        delete removed;
+        repositoryCount--;
+        return true;
+    }
+
+    // Removes every repository with from <= name < to. Small ranges are
+    // erased key by key; once the range is a sizeable share of the index it
+    // is cheaper to filter the leaves and bulk load the survivors once.
+    int deleteRepositories(const string& from, const string& to) {
+        if (!(from < to)) {
+            return 0;
+        }
+        size_t bulkThreshold = (size_t)repositoryCount / 8;
+        vector<Repository*> victims = collectRange(from, to, bulkThreshold);
+        if (victims.size() >= bulkThreshold) {
+            return filterRangeAndRebuild(from, to);
+        }
+        vector<string> names;
+        names.reserve(victims.size());
+        for (Repository* repository : victims) {
+            names.push_back(repository->getName());
+        }
+        for (const string& name : names) {
+            deleteRepository(name);
+        }
+        return (int)names.size();
+    }
+
+    // Removes every repository the predicate selects, in a single pass.
+    int deleteRepositories(const function<bool(const Repository*)>& shouldDelete) {
+        return filterAndRebuild(shouldDelete);
+    }
+
+    // Repositories with from <= name < to, in name order.
+    vector<Repository*> rangeScan(const string& from, const string& to) const {
+        return collectRange(from, to, (size_t)repositoryCount);
+    }
+
+    // Repositories whose name starts with the given prefix, in name order.
+    vector<Repository*> prefixScan(const string& namePrefix) const {
+        vector<Repository*> result;
+        uint64_t prefix = keyPrefix(namePrefix);
+        const LeafNode* leaf = findLeaf(prefix, namePrefix);
+        int pos = leaf ? leafLowerBound(leaf, prefix, namePrefix) : 0;
+        while (leaf) {
+            for (; pos < leaf->keyCount; pos++) {
+                if (leaf->repositories[pos]->getName().compare(0, namePrefix.size(), namePrefix) != 0) {
+                    return result;
+                }
+                result.push_back(leaf->repositories[pos]);
+            }
+            leaf = leaf->next;
+            pos = 0;
+        }
+        return result;
+    }
+
+};
+
+// The follow graph in compressed sparse row form: for each id, its out
+// edges (whom it follows) are outEdges[outOffsets[id] .. outOffsets[id + 1])
+// and its in edges (its followers) likewise. Ids are interned usernames,
+// so some are names that never became users; those have no edges.
+struct CompactFollowGraph {
+    vector<uint32_t> outOffsets;
+    vector<uint32_t> outEdges;
+    vector<uint32_t> inOffsets;
+    vector<uint32_t> inEdges;
+    vector<uint8_t> isUser;
+    uint32_t userCount = 0;
+
+    uint32_t nodeCount() const { return (uint32_t)isUser.size(); }
+    uint32_t outDegree(uint32_t id) const { return outOffsets[id + 1] - outOffsets[id]; }
+    uint32_t inDegree(uint32_t id) const { return inOffsets[id + 1] - inOffsets[id]; }
+};
+
+// Directed follow graph over interned user ids. Every user keeps two
+// adjacency lists, the users they follow and the users following them,
+// and a hash map from each edge to its position in both lists, so
+// follow/unfollow are O(1) on average and neighbour iteration is O(degree).
+class SocialGraph {
+private:
+    struct Node {
+        bool registered = false;
+        vector<uint32_t> followees;
+        vector<uint32_t> followers;
+    };
+
+    const StringInterner& usernames;
+    mutable shared_mutex lock; // taken by every public method
+    vector<Node> nodes; // indexed by interned id
+    int userCount;
+    uint64_t version; // bumped by every change, so snapshots can tell they are stale
+    unordered_map<uint64_t, pair<uint32_t, uint32_t>> edges; // edge -> (index in followees, index in followers)
+
+    static uint64_t edgeKey(uint32_t follower, uint32_t followee) {
+        return ((uint64_t)follower << 32) | followee;
+    }
+
+    bool registered(uint32_t id) const {
+        return id < nodes.size() && nodes[id].registered;
+    }
+
+public:
+    SocialGraph(const StringInterner& names) : usernames(names), userCount(0), version(0) {}
+
+    bool addUser(uint32_t id) {
+        if (id == StringInterner::NONE) {
+            return false;
+        }
+        unique_lock<shared_mutex> guard(lock);
+        if (id >= nodes.size()) {
+            nodes.resize(id + 1);
+        }
+        if (nodes[id].registered) {
+            return false;
+        }
+        nodes[id].registered = true;
+        userCount++;
+        version++;
+        return true;
+    }
+
+    bool hasUser(uint32_t id) const {
+        shared_lock<shared_mutex> guard(lock);
+        return registered(id);
+    }
+
+    bool followUser(uint32_t follower, uint32_t followee) {
+        unique_lock<shared_mutex> guard(lock);
+        if (!registered(follower) || !registered(followee) || follower == followee) {
+            return false;
+        }
+        pair<uint32_t, uint32_t> positions((uint32_t)nodes[follower].followees.size(), (uint32_t)nodes[followee].followers.size());
+        if (!edges.emplace(edgeKey(follower, followee), positions).second) {
+            return false;
+        }
+        nodes[follower].followees.push_back(followee);
+        nodes[followee].followers.push_back(follower);
+        version++;
+        return true;
+    }
+
+    bool unfollowUser(uint32_t follower, uint32_t followee) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = edges.find(edgeKey(follower, followee));
+        if (it == edges.end()) {
+            return false;
+        }
+        uint32_t followeePos = it->second.first;
+        uint32_t followerPos = it->second.second;
+        edges.erase(it);
+
+        // Swap-remove from both lists and repoint the edges that moved.
+        vector<uint32_t>& followees = nodes[follower].followees;
+        uint32_t movedFollowee = followees.back();
+        followees[followeePos] = movedFollowee;
+        followees.pop_back();
+        if (movedFollowee != followee) {
+            edges[edgeKey(follower, movedFollowee)].first = followeePos;
+        }
+
+        vector<uint32_t>& followers = nodes[followee].followers;
+        uint32_t movedFollower = followers.back();
+        followers[followerPos] = movedFollower;
+        followers.pop_back();
+        if (movedFollower != follower) {
+            edges[edgeKey(movedFollower, followee)].second = followerPos;
+        }
+        version++;
+        return true;
+    }
+
+    // Username overloads resolve both names once and defer to the id versions.
+    bool followUser(string_view follower, string_view followee) {
+        return followUser(usernames.find(follower), usernames.find(followee));
+    }
+
+    bool unfollowUser(string_view follower, string_view followee) {
+        return unfollowUser(usernames.find(follower), usernames.find(followee));
+    }
+
+    bool isFollowing(uint32_t follower, uint32_t followee) const {
+        shared_lock<shared_mutex> guard(lock);
+        return edges.count(edgeKey(follower, followee)) != 0;
+    }
+
+    // The candidates that follower follows. One lock and a hash probe
+    // each, however many accounts follower follows.
+    vector<uint32_t> followedAmong(uint32_t follower, const vector<uint32_t>& candidates) const {
+        shared_lock<shared_mutex> guard(lock);
+        vector<uint32_t> followed;
+        for (uint32_t candidate : candidates) {
+            if (edges.count(edgeKey(follower, candidate))) {
+                followed.push_back(candidate);
+            }
+        }
+        return followed;
+    }
+
+    string_view getUsername(uint32_t id) const { return usernames.name(id); }
+
+    // The lists are copied out, since another thread may change them.
+    vector<uint32_t> getFollowers(uint32_t id) const {
+        shared_lock<shared_mutex> guard(lock);
+        return registered(id) ? nodes[id].followers : vector<uint32_t>();
+    }
+
+    vector<uint32_t> getFollowees(uint32_t id) const {
+        shared_lock<shared_mutex> guard(lock);
+        return registered(id) ? nodes[id].followees : vector<uint32_t>();
+    }
+
+    int getFollowerCount(uint32_t id) const {
+        shared_lock<shared_mutex> guard(lock);
+        return registered(id) ? (int)nodes[id].followers.size() : 0;
+    }
+
+    int getFolloweeCount(uint32_t id) const {
+        shared_lock<shared_mutex> guard(lock);
+        return registered(id) ? (int)nodes[id].followees.size() : 0;
+    }
+
+    int getUserCount() const {
+        shared_lock<shared_mutex> guard(lock);
+        return userCount;
+    }
+
+    size_t getEdgeCount() const {
+        shared_lock<shared_mutex> guard(lock);
+        return edges.size();
+    }
+
+    uint64_t getVersion() const {
+        shared_lock<shared_mutex> guard(lock);
+        return version;
+    }
+
+    // A copy of the whole graph for analytics. Holds the lock for one
+    // pass over the adjacency lists.
+    CompactFollowGraph snapshot() const {
+        shared_lock<shared_mutex> guard(lock);
+        CompactFollowGraph compact;
+        uint32_t n = (uint32_t)nodes.size();
+        compact.isUser.resize(n);
+        compact.outOffsets.resize(n + 1, 0);
+        compact.inOffsets.resize(n + 1, 0);
+        compact.outEdges.reserve(edges.size());
+        compact.inEdges.reserve(edges.size());
+        for (uint32_t id = 0; id < n; id++) {
+            compact.isUser[id] = nodes[id].registered;
+            compact.outEdges.insert(compact.outEdges.end(), nodes[id].followees.begin(), nodes[id].followees.end());
+            compact.inEdges.insert(compact.inEdges.end(), nodes[id].followers.begin(), nodes[id].followers.end());
+            compact.outOffsets[id + 1] = (uint32_t)compact.outEdges.size();
+            compact.inOffsets[id + 1] = (uint32_t)compact.inEdges.size();
+        }
+        compact.userCount = (uint32_t)userCount;
+        return compact;
+    }
+};
+
+// Analytics over a snapshot of the follow graph: degrees of separation,
+// friends-of-friends suggestions and influence ranking. The snapshot is
+// taken once, in CSR form, and never changes, so the kernels read it from
+// many threads without locks.
+class GraphAnalytics {
+public:
+    struct Ranked {
+        uint32_t id;
+        double score;
+    };
+
+private:
+    // Below this many items per worker, threads cost more than they save.
+    static constexpr size_t MIN_ITEMS_PER_WORKER = 4096;
+    // Direction switching thresholds from Beamer et al.: go bottom-up once
+    // the frontier's edges exceed the unexplored edges / ALPHA, and back
+    // top-down once the frontier holds fewer than users / BETA.
+    static constexpr uint64_t ALPHA = 14;
+    static constexpr uint64_t BETA = 24;
+
+    CompactFollowGraph graph;
+
+    static size_t workersFor(size_t items) {
+        size_t workers = max(1u, thread::hardware_concurrency());
+        return max((size_t)1, min(workers, items / MIN_ITEMS_PER_WORKER));
+    }
+
+    // Splits [0, items) into one contiguous range per worker and runs
+    // body(begin, end, worker) on each, the first on this thread.
+    static void parallelFor(size_t items, size_t workers, const function<void(size_t, size_t, size_t)>& body) {
+        vector<thread> threads;
+        for (size_t w = 1; w < workers; w++) {
+            threads.emplace_back(body, items * w / workers, items * (w + 1) / workers, w);
+        }
+        body(0, items / workers, 0);
+        for (thread& t : threads) {
+            t.join();
+        }
+    }
+
+    template <typename Score>
+    vector<Ranked> top(size_t k, const Score& score) const {
+        vector<Ranked> ranked;
+        for (uint32_t id = 0; id < graph.nodeCount(); id++) {
+            if (graph.isUser[id]) {
+                ranked.push_back({ id, score(id) });
+            }
+        }
+        k = min(k, ranked.size());
+        partial_sort(ranked.begin(), ranked.begin() + k, ranked.end(), [](const Ranked& a, const Ranked& b) {
+            return a.score != b.score ? a.score > b.score : a.id < b.id;
+        });
+        ranked.resize(k);
+        return ranked;
+    }
+
+public:
+    GraphAnalytics(CompactFollowGraph snapshot) : graph(move(snapshot)) {}
+
+    const CompactFollowGraph& getGraph() const { return graph; }
+
+    // Hops along follow edges from source to every id, -1 where
+    // unreachable. Stops after the level that reaches stopAt, if given.
+    // Levels expand top-down from the frontier while it is small, and
+    // bottom-up while it is large: each unvisited user looks for one of
+    // its followers in the frontier and stops at the first.
+    vector<int32_t> distancesFrom(uint32_t source, uint32_t stopAt = StringInterner::NONE) const {
+        uint32_t n = graph.nodeCount();
+        vector<int32_t> distance(n, -1);
+        if (source >= n || !graph.isUser[source]) {
+            return distance;
+        }
+        vector<atomic<uint64_t>> visited((n + 63) / 64);
+        auto claim = [&visited](uint32_t id) {
+            uint64_t bit = (uint64_t)1 << (id % 64);
+            return !(visited[id / 64].fetch_or(bit, memory_order_relaxed) & bit);
+        };
+        claim(source);
+        distance[source] = 0;
+        vector<uint32_t> frontier = { source };
+        uint64_t unexploredEdges = graph.outEdges.size();
+        bool bottomUp = false;
+
+        for (int32_t depth = 1; !frontier.empty(); depth++) {
+            if (stopAt < n && distance[stopAt] >= 0) {
+                break;
+            }
+            uint64_t frontierEdges = 0;
+            for (uint32_t id : frontier) {
+                frontierEdges += graph.outDegree(id);
+            }
+            unexploredEdges -= min(unexploredEdges, frontierEdges);
+            if (!bottomUp && frontierEdges > unexploredEdges / ALPHA) {
+                bottomUp = true;
+            }
+            else if (bottomUp && frontier.size() < graph.userCount / BETA) {
+                bottomUp = false;
+            }
+
+            vector<vector<uint32_t>> next;
+            if (bottomUp) {
+                vector<uint64_t> inFrontier((n + 63) / 64, 0);
+                for (uint32_t id : frontier) {
+                    inFrontier[id / 64] |= (uint64_t)1 << (id % 64);
+                }
+                size_t workers = workersFor(n);
+                next.resize(workers);
+                parallelFor(n, workers, [&](size_t begin, size_t end, size_t worker) {
+                    for (size_t id = begin; id < end; id++) {
+                        if (!graph.isUser[id] || (visited[id / 64].load(memory_order_relaxed) >> (id % 64)) & 1) {
+                            continue;
+                        }
+                        // A follower of id in the frontier means id is one hop further.
+                        for (uint32_t e = graph.inOffsets[id]; e < graph.inOffsets[id + 1]; e++) {
+                            uint32_t follower = graph.inEdges[e];
+                            if ((inFrontier[follower / 64] >> (follower % 64)) & 1) {
+                                claim((uint32_t)id);
+                                distance[id] = depth;
+                                next[worker].push_back((uint32_t)id);
+                                break;
+                            }
+                        }
+                    }
+                });
+            }
+            else {
+                size_t workers = workersFor(frontierEdges);
+                next.resize(workers);
+                parallelFor(frontier.size(), workers, [&](size_t begin, size_t end, size_t worker) {
+                    for (size_t i = begin; i < end; i++) {
+                        uint32_t id = frontier[i];
+                        for (uint32_t e = graph.outOffsets[id]; e < graph.outOffsets[id + 1]; e++) {
+                            uint32_t followee = graph.outEdges[e];
+                            if (claim(followee)) {
+                                distance[followee] = depth;
+                                next[worker].push_back(followee);
+                            }
+                        }
+                    }
+                });
+            }
+            frontier.clear();
+            for (const vector<uint32_t>& part : next) {
+                frontier.insert(frontier.end(), part.begin(), part.end());
+            }
+        }
+        return distance;
+    }
+
+    // Fewest follow hops from one user to another, or -1 if there is no path.
+    int separation(uint32_t from, uint32_t to) const {
+        if (to >= graph.nodeCount()) {
+            return -1;
+        }
+        return distancesFrom(from, to)[to];
+    }
+
+    // Users that the accounts user follows also follow, scored by how many
+    // of them do, ties going to the more followed. Excludes user and the
+    // accounts user already follows.
+    vector<Ranked> suggestions(uint32_t user, size_t k) const {
+        if (user >= graph.nodeCount() || !graph.isUser[user]) {
+            return {};
+        }
+        const uint32_t EXCLUDED = UINT32_MAX;
+        vector<uint32_t> paths(graph.nodeCount(), 0);
+        vector<uint32_t> touched;
+        paths[user] = EXCLUDED;
+        for (uint32_t e = graph.outOffsets[user]; e < graph.outOffsets[user + 1]; e++) {
+            paths[graph.outEdges[e]] = EXCLUDED;
+        }
+        for (uint32_t e = graph.outOffsets[user]; e < graph.outOffsets[user + 1]; e++) {
+            uint32_t followee = graph.outEdges[e];
+            for (uint32_t f = graph.outOffsets[followee]; f < graph.outOffsets[followee + 1]; f++) {
+                uint32_t candidate = graph.outEdges[f];
+                if (paths[candidate] == EXCLUDED) {
+                    continue;
+                }
+                if (paths[candidate]++ == 0) {
+                    touched.push_back(candidate);
+                }
+            }
+        }
+        k = min(k, touched.size());
+        partial_sort(touched.begin(), touched.begin() + k, touched.end(), [&](uint32_t a, uint32_t b) {
+            if (paths[a] != paths[b]) {
+                return paths[a] > paths[b];
+            }
+            return graph.inDegree(a) != graph.inDegree(b) ? graph.inDegree(a) > graph.inDegree(b) : a < b;
+        });
+        vector<Ranked> result;
+        for (size_t i = 0; i < k; i++) {
+            result.push_back({ touched[i], (double)paths[touched[i]] });
+        }
+        return result;
+    }
+
+    // PageRank over follow edges: a follow passes on a share of the
+    // follower's rank, and users who follow nobody spread theirs over
+    // everyone. Pull-based, so each worker writes only its own range and
+    // the inner loop is a gather over a flat array.
+    vector<double> pageRank(double damping = 0.85, int maxIterations = 50, double tolerance = 1e-9, int* iterationsRun = nullptr) const {
+        uint32_t n = graph.nodeCount();
+        vector<double> rank(n, 0.0);
+        vector<double> next(n, 0.0);
+        vector<double> share(n, 0.0);
+        if (graph.userCount == 0) {
+            return rank;
+        }
+        double users = graph.userCount;
+        for (uint32_t id = 0; id < n; id++) {
+            rank[id] = graph.isUser[id] ? 1.0 / users : 0.0;
+        }
+        size_t workers = workersFor(n);
+        vector<double> partial(workers);
+        int iteration = 0;
+        while (iteration < maxIterations) {
+            iteration++;
+            parallelFor(n, workers, [&](size_t begin, size_t end, size_t worker) {
+                double dangling = 0;
+                for (size_t id = begin; id < end; id++) {
+                    uint32_t degree = graph.outDegree((uint32_t)id);
+                    share[id] = degree ? rank[id] / degree : 0.0;
+                    dangling += degree || !graph.isUser[id] ? 0.0 : rank[id];
+                }
+                partial[worker] = dangling;
+            });
+            double dangling = 0;
+            for (double value : partial) {
+                dangling += value;
+            }
+            double base = (1.0 - damping) / users + damping * dangling / users;
+            parallelFor(n, workers, [&](size_t begin, size_t end, size_t worker) {
+                double change = 0;
+                for (size_t id = begin; id < end; id++) {
+                    double sum = 0;
+                    for (uint32_t e = graph.inOffsets[id]; e < graph.inOffsets[id + 1]; e++) {
+                        sum += share[graph.inEdges[e]];
+                    }
+                    next[id] = graph.isUser[id] ? base + damping * sum : 0.0;
+                    change += fabs(next[id] - rank[id]);
+                }
+                partial[worker] = change;
+            });
+            rank.swap(next);
+            double change = 0;
+            for (double value : partial) {
+                change += value;
+            }
+            if (change < tolerance) {
+                break;
+            }
+        }
+        if (iterationsRun) {
+            *iterationsRun = iteration;
+        }
+        return rank;
+    }
+
+    vector<Ranked> topByPageRank(size_t k) const {
+        vector<double> rank = pageRank();
+        return top(k, [&rank](uint32_t id) { return rank[id]; });
+    }
+
+    vector<Ranked> topByFollowers(size_t k) const {
+        return top(k, [this](uint32_t id) { return (double)graph.inDegree(id); });
+    }
+};
+
+
+class User {
+private:
+    string username;
+    string passwordHash; // PasswordHasher credential, never the password itself
+    uint32_t id; // interned username
+    SocialGraph& graph; // the single store of follow edges
+    FlatHashMap<string, Repository*> repositories; // owned repositories; kept by RepositoryCatalog, which owns them
+    FlatHashMap<string, Repository*> forkedRepositories; // forks, owned by this user
+    mutable mutex lock;
+
+public:
+    static void* operator new(size_t size) { return SlabAllocator<User>::instance("User").allocate(size); }
+    static void operator delete(void* pointer, size_t size) { SlabAllocator<User>::instance("User").deallocate(pointer, size); }
+
+    User(string uname, string credential, uint32_t userId, SocialGraph& socialGraph) : username(uname), passwordHash(credential), id(userId), graph(socialGraph) {}
+
+    uint32_t getId() const { return id; }
+    string getUsername() const { return username; }
+    const string& getPasswordHash() const { return passwordHash; }
+
+    // Guards the repository maps, which the User does not lock itself.
+    // The SocialGraph locks the follow edges on its own.
+    mutex& getLock() const { return lock; }
+
+    // Follow edges live in the SocialGraph; these read this user's node.
+    vector<uint32_t> getFollowers() const { return graph.getFollowers(id); }
+    vector<uint32_t> getFollowing() const { return graph.getFollowees(id); }
+    int getFollowerCount() const { return graph.getFollowerCount(id); }
+    int getFollowingCount() const { return graph.getFolloweeCount(id); }
+
+    // False if the follower is unknown, is this user, or already follows.
+    bool addFollower(uint32_t followerId) {
+        return graph.followUser(followerId, id);
+    }
+
+    bool follow(uint32_t followeeId) {
+        return graph.followUser(id, followeeId);
+    }
+
+    bool unfollow(uint32_t followeeId) {
+        return graph.unfollowUser(id, followeeId);
+    }
+
+    bool isFollowing(uint32_t followeeId) const {
+        return graph.isFollowing(id, followeeId);
+    }
+
+    // Owned repositories are added and removed only through
+    // RepositoryCatalog, which keeps this index in step with its own.
+    void addRepository(Repository* repo) {
+        repositories[repo->getName()] = repo;
+    }
+
+    bool deleteRepository(string_view repoName) {
+        return repositories.erase(repoName);
+    }
+
+    bool ownsRepository(string_view repoName) const {
+        return repositories.find(repoName) != nullptr;
+    }
+
+    // Adopts an already-built fork, e.g. one restored from a snapshot.
+    void addForkedRepository(Repository* repo) {
+        Repository*& forked = forkedRepositories[repo->getName()];
+        delete forked;
+        forked = repo;
+        forked->setOwnerId(id);
+    }
+
+
+    // False if this user already has a fork by that name, which may hold
+    // work of its own.
+    bool forkRepository(Repository* repo) {
+        if (forkedRepositories.find(repo->getName())) {
+            return false;
+        }
+        Repository* forked = repo->fork();
+        forked->setOwnerId(id);
+        forkedRepositories[repo->getName()] = forked;
+        repo->incrementForkCount();
+        return true;
+    }
+
+
+    const FlatHashMap<string, Repository*>& getRepositories() const {
+        return repositories;
+    }
+    const FlatHashMap<string, Repository*>& getForkedRepositories() const {
+        return forkedRepositories;
+    }
+};
+
+
+
+// Public repositories ranked by fork count, and by a trending score in
+// which recent forks weigh more, both kept in order as forks happen so
+// the top N cost O(N) to read instead of a walk of the whole tree.
+//
+// Trending uses forward decay: a fork at time t adds
+// exp(lambda * (t - landmark)) to the score and that never changes
+// afterwards, so the order holds as time passes without rescoring
+// anything. Scaling by exp(-lambda * (now - landmark)) turns a score back
+// into a fork count decayed to now, halving every halfLife seconds.
+class TrendingIndex {
+public:
+    struct Ranking {
+        string name;
+        int forks;
+        double score; // forks decayed to the time of the query
+    };
+
+    static constexpr double DEFAULT_HALF_LIFE = 7 * 24 * 3600.0;
+
+private:
+    struct Ranked {
+        double key;
+        string_view name; // the repository's own name, which never changes
+        const Repository* repo;
+
+        bool operator<(const Ranked& other) const {
+            return key != other.key ? key > other.key : name < other.name;
+        }
+    };
+
+    struct Entry {
+        int forks;
+        double score;
+        bool listed; // public, so it appears in rankings
+    };
+
+    // exp() overflows a little past 709; the landmark moves before that.
+    static constexpr double MAX_EXPONENT = 600;
+
+    mutable mutex lock;
+    double lambda;
+    double landmark;
+    unordered_map<const Repository*, Entry> entries;
+    set<Ranked> byForks;
+    set<Ranked> byScore; // only repositories with a score
+
+    void insertRankings(const Repository* repo, const Entry& entry) {
+        if (!entry.listed) {
+            return;
+        }
+        byForks.insert({ (double)entry.forks, repo->getName(), repo });
+        if (entry.score > 0) {
+            byScore.insert({ entry.score, repo->getName(), repo });
+        }
+    }
+
+    void eraseRankings(const Repository* repo, const Entry& entry) {
+        byForks.erase({ (double)entry.forks, repo->getName(), repo });
+        byScore.erase({ entry.score, repo->getName(), repo });
+    }
+
+    // Moves repo from oldKey to newKey, reusing its node when it has one.
+    static void rerank(set<Ranked>& ranked, double oldKey, double newKey, const Repository* repo) {
+        auto node = ranked.extract({ oldKey, repo->getName(), repo });
+        if (node.empty()) {
+            ranked.insert({ newKey, repo->getName(), repo });
+            return;
+        }
+        node.value().key = newKey;
+        ranked.insert(move(node));
+    }
+
+    // Rescales every score to a new landmark. Order is unchanged, so the
+    // ranking is rebuilt in place; this happens about once per
+    // MAX_EXPONENT / lambda seconds.
+    void moveLandmark(double now) {
+        double factor = exp(-lambda * (now - landmark));
+        byScore.clear();
+        for (auto& pair : entries) {
+            pair.second.score *= factor;
+            if (pair.second.listed && pair.second.score > 0) {
+                byScore.insert({ pair.second.score, pair.first->getName(), pair.first });
+            }
+        }
+        landmark = now;
+    }
+
+public:
+    TrendingIndex(double halfLife = DEFAULT_HALF_LIFE) : lambda(log(2.0) / halfLife), landmark(currentTime()) {}
+
+    static double currentTime() {
+        return chrono::duration<double>(chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // Starts ranking repo with the forks it already has. Earlier forks
+    // carry no time, so they count toward mostForked only.
+    void track(const Repository* repo, int forks, bool isPublic) {
+        lock_guard<mutex> guard(lock);
+        Entry& entry = entries[repo];
+        eraseRankings(repo, entry);
+        entry = { forks, 0, isPublic };
+        insertRankings(repo, entry);
+    }
+
+    void untrack(const Repository* repo) {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(repo);
+        if (it != entries.end()) {
+            eraseRankings(repo, it->second);
+            entries.erase(it);
+        }
+    }
+
+    void recordFork(const Repository* repo, double now = currentTime()) {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(repo);
+        if (it == entries.end()) {
+            return;
+        }
+        if (lambda * (now - landmark) > MAX_EXPONENT) {
+            moveLandmark(now);
+        }
+        Entry& entry = it->second;
+        double score = entry.score + exp(lambda * (now - landmark));
+        if (entry.listed) {
+            rerank(byForks, entry.forks, entry.forks + 1, repo);
+            rerank(byScore, entry.score, score, repo);
+        }
+        entry.forks++;
+        entry.score = score;
+    }
+
+    void setListed(const Repository* repo, bool isPublic) {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(repo);
+        if (it == entries.end() || it->second.listed == isPublic) {
+            return;
+        }
+        eraseRankings(repo, it->second);
+        it->second.listed = isPublic;
+        insertRankings(repo, it->second);
+    }
+
+    // The count most forked public repositories, most forked first.
+    vector<Ranking> mostForked(size_t count) const {
+        lock_guard<mutex> guard(lock);
+        vector<Ranking> top;
+        top.reserve(min(count, byForks.size()));
+        for (auto it = byForks.begin(); it != byForks.end() && top.size() < count; ++it) {
+            top.push_back({ string(it->name), (int)it->key, 0 });
+        }
+        return top;
+    }
+
+    // The count public repositories with the highest decayed fork counts.
+    vector<Ranking> trending(size_t count, double now = currentTime()) const {
+        lock_guard<mutex> guard(lock);
+        double scale = exp(-lambda * (now - landmark));
+        vector<Ranking> top;
+        top.reserve(min(count, byScore.size()));
+        for (auto it = byScore.begin(); it != byScore.end() && top.size() < count; ++it) {
+            top.push_back({ string(it->name), entries.at(it->repo).forks, it->key * scale });
+        }
+        return top;
+    }
+};
+
+// Ascending document ids, delta-encoded as varints in blocks of
+// BLOCK_SIZE. Each block starts with an absolute id and has a skip entry
+// with its last id and byte offset, so a lookup decodes only the blocks
+// whose range can hold what it is looking for.
+class PostingList {
+public:
+    static constexpr size_t BLOCK_SIZE = 128;
+
+private:
+    struct Skip {
+        uint32_t lastId;
+        uint32_t offset;
+    };
+
+    vector<uint8_t> bytes;
+    vector<Skip> skips;
+    uint32_t count = 0;
+
+public:
+    // Ids must arrive in ascending order; repeating the last id is a no-op.
+    void append(uint32_t id) {
+        if (count > 0 && id == skips.back().lastId) {
+            return;
+        }
+        uint32_t value = id;
+        if (count % BLOCK_SIZE == 0) {
+            skips.push_back({ id, (uint32_t)bytes.size() });
+        }
+        else {
+            value = id - skips.back().lastId;
+        }
+        while (value >= 0x80) {
+            bytes.push_back((uint8_t)(value | 0x80));
+            value >>= 7;
+        }
+        bytes.push_back((uint8_t)value);
+        skips.back().lastId = id;
+        count++;
+    }
+
+    size_t size() const { return count; }
+    size_t byteSize() const { return bytes.size() + skips.size() * sizeof(Skip); }
+    size_t blockCount() const { return skips.size(); }
+    uint32_t blockLastId(size_t block) const { return skips[block].lastId; }
+
+    // Decodes one block into out, which has room for BLOCK_SIZE ids.
+    size_t decodeBlock(size_t block, uint32_t* out) const {
+        size_t n = block + 1 < skips.size() ? BLOCK_SIZE : count - block * BLOCK_SIZE;
+        const uint8_t* in = bytes.data() + skips[block].offset;
+        uint32_t id = 0;
+        for (size_t i = 0; i < n; i++) {
+            uint32_t value = 0;
+            int shift = 0;
+            while (*in & 0x80) {
+                value |= (uint32_t)(*in++ & 0x7f) << shift;
+                shift += 7;
+            }
+            value |= (uint32_t)*in++ << shift;
+            id = i == 0 ? value : id + value;
+            out[i] = id;
+        }
+        return n;
+    }
+
+    void decode(vector<uint32_t>& out) const {
+        size_t start = out.size();
+        out.resize(start + count);
+        for (size_t block = 0; block < skips.size(); block++) {
+            decodeBlock(block, out.data() + start + block * BLOCK_SIZE);
+        }
+    }
+
+    // Keeps the candidates that are in this list, or with keepMatches
+    // false the ones that are not. Candidates must be ascending. Blocks
+    // wholly below the next candidate are skipped undecoded; within a
+    // block the merge has no data-dependent branches.
+    void filter(vector<uint32_t>& candidates, bool keepMatches) const {
+        uint32_t decoded[BLOCK_SIZE];
+        size_t kept = 0;
+        size_t i = 0;
+        size_t block = 0;
+        while (i < candidates.size()) {
+            while (block < skips.size() && skips[block].lastId < candidates[i]) {
+                block++;
+            }
+            if (block == skips.size()) {
+                break;
+            }
+            size_t n = decodeBlock(block, decoded);
+            size_t j = 0;
+            while (i < candidates.size() && j < n) {
+                uint32_t a = candidates[i];
+                uint32_t b = decoded[j];
+                candidates[kept] = a;
+                kept += ((a == b) == keepMatches) & (a <= b);
+                i += a <= b;
+                j += b <= a;
+            }
+            block++;
+        }
+        if (!keepMatches) {
+            while (i < candidates.size()) {
+                candidates[kept++] = candidates[i++];
+            }
+        }
+        candidates.resize(kept);
+    }
+};
+
+// Inverted index over commit messages and file paths of every repository
+// in the catalogue, updated as commits and files are added. Each commit
+// and each file is a document; ids only grow, so postings are always
+// appended in order. Deleted files and repositories are dropped when
+// results are read rather than removed from the postings.
+//
+// A query is a list of terms that must all match. OR between terms
+// separates alternatives, "-term" excludes and "term*" matches any term
+// with that prefix. Matching ignores ASCII case. Results are limited to
+// public repositories and the viewer's own.
+class SearchIndex {
+public:
+    struct Hit {
+        string repository;
+        bool isFile;
+        string text; // the commit message or file path
+    };
+
+    struct Stats {
+        size_t documents;
+        size_t terms;
+        size_t postingBytes;
+    };
+
+private:
+    static constexpr size_t MAX_TERM_LENGTH = 64;
+
+    struct IndexedRepository {
+        string name;
+        uint32_t ownerId;
+        bool isPublic;
+        bool live;
+        FlatHashMap<string, uint32_t> files; // path to document id, for removal
+    };
+
+    struct Document {
+        uint32_t repository;
+        bool isFile;
+        bool live;
+        string_view text;
+    };
+
+    struct Literal {
+        string term;
+        bool prefix;
+        bool negated;
+    };
+
+    mutable shared_mutex lock;
+    map<string, PostingList, less<>> terms;
+    vector<Document> documents;
+    vector<IndexedRepository> repositories;
+    unordered_map<const Repository*, uint32_t> repositoryIds;
+    StringPool texts;
+    size_t postingBytes = 0;
+
+    // Calls emit with each lowercased word of text; for a path, also with
+    // each whole component, so "src/main.cpp" finds "main.cpp" as well as
+    // "main" and "cpp".
+    static void tokenize(string_view text, bool isPath, const function<void(string_view)>& emit) {
+        string word;
+        string component;
+        auto flushWord = [&]() {
+            if (!word.empty() && word.size() <= MAX_TERM_LENGTH) {
+                emit(word);
+            }
+            word.clear();
+        };
+        for (size_t i = 0; i <= text.size(); i++) {
+            char c = i < text.size() ? text[i] : '/';
+            unsigned char u = (unsigned char)c;
+            if (isalnum(u) || u >= 0x80) {
+                word += (char)tolower(u);
+            }
+            else {
+                flushWord();
+            }
+            if (isPath) {
+                if (c == '/') {
+                    if (!component.empty() && component.size() <= MAX_TERM_LENGTH) {
+                        emit(component);
+                    }
+                    component.clear();
+                }
+                else {
+                    component += (char)tolower(u);
+                }
+            }
+        }
+    }
+
+    uint32_t addDocument(uint32_t repository, string_view text, bool isFile) {
+        uint32_t id = (uint32_t)documents.size();
+        documents.push_back({ repository, isFile, true, texts.store(text) });
+        tokenize(text, isFile, [&](string_view term) {
+            auto it = terms.find(term);
+            if (it == terms.end()) {
+                it = terms.emplace(string(term), PostingList()).first;
+            }
+            size_t before = it->second.byteSize();
+            it->second.append(id);
+            postingBytes += it->second.byteSize() - before;
+        });
+        return id;
+    }
+
+    const IndexedRepository* indexed(const Repository* repo) const {
+        auto it = repositoryIds.find(repo);
+        return it == repositoryIds.end() ? nullptr : &repositories[it->second];
+    }
+
+    static vector<vector<Literal>> parse(string_view query) {
+        vector<vector<Literal>> clauses(1);
+        size_t i = 0;
+        while (i < query.size()) {
+            size_t end = query.find(' ', i);
+            if (end == string_view::npos) {
+                end = query.size();
+            }
+            string_view word = query.substr(i, end - i);
+            i = end + 1;
+            if (word.empty()) {
+                continue;
+            }
+            if (word == "OR") {
+                clauses.emplace_back();
+                continue;
+            }
+            Literal literal{ "", false, false };
+            if (word[0] == '-') {
+                literal.negated = true;
+                word.remove_prefix(1);
+            }
+            if (!word.empty() && word.back() == '*') {
+                literal.prefix = true;
+                word.remove_suffix(1);
+            }
+            // Punctuation inside a word is kept so paths like "main.cpp"
+            // match whole components.
+            while (!word.empty() && !isalnum((unsigned char)word.front()) && (unsigned char)word.front() < 0x80) {
+                word.remove_prefix(1);
+            }
+            while (!word.empty() && !isalnum((unsigned char)word.back()) && (unsigned char)word.back() < 0x80) {
+                word.remove_suffix(1);
+            }
+            for (char c : word) {
+                literal.term += (char)tolower((unsigned char)c);
+            }
+            if (!literal.term.empty()) {
+                clauses.back().push_back(literal);
+            }
+        }
+        return clauses;
+    }
+
+    // Ids of every term starting with prefix, ascending.
+    vector<uint32_t> prefixIds(const string& prefix) const {
+        vector<uint32_t> ids;
+        for (auto it = terms.lower_bound(prefix); it != terms.end() && it->first.compare(0, prefix.size(), prefix) == 0; ++it) {
+            it->second.decode(ids);
+        }
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        return ids;
+    }
+
+    // Matching ids for one clause, ascending. The rarest term is decoded
+    // and each other term only filters what is left.
+    vector<uint32_t> evaluate(const vector<Literal>& clause) const {
+        struct Operand {
+            const PostingList* list;
+            vector<uint32_t> ids; // for prefixes
+            bool negated;
+            size_t size() const { return list ? list->size() : ids.size(); }
+        };
+        vector<Operand> operands;
+        for (const Literal& literal : clause) {
+            Operand operand{ nullptr, {}, literal.negated };
+            if (literal.prefix) {
+                operand.ids = prefixIds(literal.term);
+            }
+            else {
+                auto it = terms.find(literal.term);
+                if (it != terms.end()) {
+                    operand.list = &it->second;
+                }
+            }
+            if (operand.size() == 0 && !operand.negated) {
+                return {};
+            }
+            operands.push_back(move(operand));
+        }
+        // Positive terms first, smallest first, so the candidates only shrink.
+        sort(operands.begin(), operands.end(), [](const Operand& a, const Operand& b) {
+            return a.negated != b.negated ? !a.negated : a.size() < b.size();
+        });
+        if (operands.empty() || operands[0].negated) {
+            return {};
+        }
+        vector<uint32_t> candidates;
+        if (operands[0].list) {
+            operands[0].list->decode(candidates);
+        }
+        else {
+            candidates = move(operands[0].ids);
+        }
+        for (size_t k = 1; k < operands.size() && !candidates.empty(); k++) {
+            const Operand& operand = operands[k];
+            if (operand.list) {
+                operand.list->filter(candidates, !operand.negated);
+            }
+            else {
+                vector<uint32_t> result;
+                if (operand.negated) {
+                    set_difference(candidates.begin(), candidates.end(), operand.ids.begin(), operand.ids.end(), back_inserter(result));
+                }
+                else {
+                    set_intersection(candidates.begin(), candidates.end(), operand.ids.begin(), operand.ids.end(), back_inserter(result));
+                }
+                candidates = move(result);
+            }
+        }
+        return candidates;
+    }
+
+public:
+    // Indexes repo and everything already in it. Call before other
+    // threads can change repo.
+    void track(const Repository* repo, uint32_t ownerId) {
+        unique_lock<shared_mutex> guard(lock);
+        uint32_t id = (uint32_t)repositories.size();
+        repositories.push_back({ repo->getName(), ownerId, repo->isRepositoryPublic(), true, {} });
+        repositoryIds[repo] = id;
+        for (const Commit& commit : repo->getCommits()) {
+            addDocument(id, commit.getMessage(), false);
+        }
+        for (int i = 0; i < repo->getFileCount(); i++) {
+            string_view path = repo->getFiles()[i].getName();
+            repositories[id].files[path] = addDocument(id, path, true);
+        }
+    }
+
+    void untrack(const Repository* repo) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = repositoryIds.find(repo);
+        if (it != repositoryIds.end()) {
+            repositories[it->second].live = false;
+            repositories[it->second].files = FlatHashMap<string, uint32_t>();
+            repositoryIds.erase(it);
+        }
+    }
+
+    void addCommit(const Repository* repo, string_view message) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = repositoryIds.find(repo);
+        if (it != repositoryIds.end()) {
+            addDocument(it->second, message, false);
+        }
+    }
+
+    void addFile(const Repository* repo, string_view path) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = repositoryIds.find(repo);
+        if (it != repositoryIds.end()) {
+            repositories[it->second].files[path] = addDocument(it->second, path, true);
+        }
+    }
+
+    void removeFile(const Repository* repo, string_view path) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = repositoryIds.find(repo);
+        if (it == repositoryIds.end()) {
+            return;
+        }
+        FlatHashMap<string, uint32_t>& files = repositories[it->second].files;
+        if (const uint32_t* document = files.find(path)) {
+            documents[*document].live = false;
+            files.erase(path);
+        }
+    }
+
+    void setVisibility(const Repository* repo, bool isPublic) {
+        unique_lock<shared_mutex> guard(lock);
+        auto it = repositoryIds.find(repo);
+        if (it != repositoryIds.end()) {
+            repositories[it->second].isPublic = isPublic;
+        }
+    }
+
+    // Up to limit matches visible to viewer (an interned username, or
+    // StringInterner::NONE for nobody), newest first.
+    vector<Hit> search(string_view query, uint32_t viewer, size_t limit) const {
+        shared_lock<shared_mutex> guard(lock);
+        vector<uint32_t> matches;
+        for (const vector<Literal>& clause : parse(query)) {
+            vector<uint32_t> ids = evaluate(clause);
+            vector<uint32_t> merged;
+            set_union(matches.begin(), matches.end(), ids.begin(), ids.end(), back_inserter(merged));
+            matches = move(merged);
+        }
+        vector<Hit> hits;
+        for (auto it = matches.rbegin(); it != matches.rend() && hits.size() < limit; ++it) {
+            const Document& document = documents[*it];
+            const IndexedRepository& repository = repositories[document.repository];
+            if (document.live && repository.live && (repository.isPublic || repository.ownerId == viewer)) {
+                hits.push_back({ repository.name, document.isFile, string(document.text) });
+            }
+        }
+        return hits;
+    }
+
+    Stats getStats() const {
+        shared_lock<shared_mutex> guard(lock);
+        return Stats{ documents.size(), terms.size(), postingBytes };
+    }
+};
+
+// Every owned repository, indexed two ways: the tree is the global index
+// by name and owns the repositories in it, and each owner's User indexes
+// its own repositories by name, so listing one user's repositories costs
+// O(their count). Adding and removing go through here so the two never
+// disagree. Forks share their source's name, so they stay out of the
+// global index and belong to the forking user instead. The catalogue
+// also ranks its repositories by forks and indexes their text for search;
+// changes to a repository are reported to it so both stay current.
+class RepositoryCatalog {
+private:
+    Tree index;
+    TrendingIndex rankings;
+    SearchIndex text;
+    CommitGraph history; // every repository's commits, including those of forks and deleted repositories
+
+    void unlink(const vector<Repository*>& victims, const function<User*(uint32_t)>& ownerOf) {
+        for (Repository* repo : victims) {
+            User* owner = ownerOf(repo->getOwnerId());
+            if (owner) {
+                owner->deleteRepository(repo->getName());
+            }
+            rankings.untrack(repo);
+            text.untrack(repo);
+        }
+    }
+
+public:
+    Repository* find(const string& repoName) const { return index.searchRepository(repoName); }
+    int size() const { return index.size(); }
+    CommitGraph& getCommitGraph() { return history; }
+    const CommitGraph& getCommitGraph() const { return history; }
+    const TrendingIndex& getRankings() const { return rankings; }
+    const SearchIndex& getSearchIndex() const { return text; }
+
+    // Call these with repo locked, after the change.
+    void forked(const Repository* repo) { rankings.recordFork(repo); }
+    void committed(const Repository* repo, string_view message) { text.addCommit(repo, message); }
+    void fileAdded(const Repository* repo, string_view path) { text.addFile(repo, path); }
+    void fileDeleted(const Repository* repo, string_view path) { text.removeFile(repo, path); }
+    void visibilityChanged(const Repository* repo) {
+        rankings.setListed(repo, repo->isRepositoryPublic());
+        text.setVisibility(repo, repo->isRepositoryPublic());
+    }
+
+    // Names may not contain '/', which names forks as "owner/name".
+    static bool isValidName(string_view repoName) {
+        return !repoName.empty() && repoName.find('/') == string_view::npos;
+    }
+
+    // Takes ownership of repo if its name is valid and free; otherwise the
+    // caller still owns it.
+    bool add(User* owner, Repository* repo) {
+        if (!isValidName(repo->getName()) || !index.addRepository(repo)) {
+            return false;
+        }
+        repo->setOwnerId(owner->getId());
+        owner->addRepository(repo);
+        rankings.track(repo, repo->getForkCount(), repo->isRepositoryPublic());
+        text.track(repo, owner->getId());
+        return true;
+    }
+
+    // Only the owner can remove a repository. Frees it.
+    bool remove(User* owner, const string& repoName) {
+        if (!owner->ownsRepository(repoName)) {
+            return false;
+        }
+        owner->deleteRepository(repoName);
+        Repository* repo = index.searchRepository(repoName);
+        rankings.untrack(repo);
+        text.untrack(repo);
+        return index.deleteRepository(repoName);
+    }
+
+    // Bulk removal: every repository with from <= name < to, or every one
+    // the predicate selects. Each is unlinked from its owner, found through
+    // ownerOf, and from the rankings and search index before the index
+    // frees them all in one pass. Returns the count removed.
+    int removeRepositories(const string& from, const string& to, const function<User*(uint32_t)>& ownerOf) {
+        vector<Repository*> victims = index.rangeScan(from, to);
+        unlink(victims, ownerOf);
+        return index.deleteRepositories(from, to);
+    }
+
+    int removeRepositories(const function<bool(const Repository*)>& shouldRemove, const function<User*(uint32_t)>& ownerOf) {
+        vector<Repository*> victims;
+        for (Repository* repo : index.prefixScan("")) {
+            if (shouldRemove(repo)) {
+                victims.push_back(repo);
+            }
+        }
+        unlink(victims, ownerOf);
+        unordered_set<const Repository*> doomed(victims.begin(), victims.end());
+        return index.deleteRepositories([&doomed](const Repository* repo) { return doomed.count(repo) != 0; });
+    }
+
+    vector<Repository*> prefixScan(const string& prefix) const { return index.prefixScan(prefix); }
+};
+
+class UserRepository {
+private:
+    string name;
+    string commits[MAX_FOLLOWERS]; 
+    string files[MAX_FOLLOWERS];  
+    int commitCount;
+    int fileCount;
+
+public:
+    UserRepository(string repoName) : name(repoName), commitCount(0), fileCount(0) {}
+    string getName() const { return name; }
+    const string* getCommits() const { return commits; }
+    const string* getFiles() const { return files; }
+    int getCommitCount() const { return commitCount; }
+    int getFileCount() const { return fileCount; }
+    bool addCommit(const string& commit) {
+        if (commitCount < MAX_FOLLOWERS) {
+            commits[commitCount++] = commit;
+            return true;
+        }
+        return false;
+    }
+    bool addFile(const string& file) {
+        if (fileCount < MAX_FOLLOWERS) {
+            files[fileCount++] = file;
+            return true;
+        }
+        return false; 
+    }
+};
+
+// Read-only view of a whole file. On POSIX systems the file is mapped with
+// mmap so pages are faulted in on first touch; elsewhere it is read into
+// a buffer.
+class MappedFile {
+private:
+    const char* bytes;
+    size_t length;
+#ifdef _WIN32
+    vector<char> buffer;
+#endif
+
+public:
+    MappedFile() : bytes(nullptr), length(0) {}
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+#ifndef _WIN32
+        if (bytes) {
+            munmap((void*)bytes, length);
+        }
+#endif
+    }
+
+    bool open(const string& path) {
+#ifdef _WIN32
+        ifstream file(path, ios::binary | ios::ate);
+        if (!file.is_open()) {
+            return false;
+        }
+        buffer.resize((size_t)file.tellg());
+        file.seekg(0);
+        file.read(buffer.data(), buffer.size());
+        bytes = buffer.data();
+        length = buffer.size();
+        return (bool)file;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if (fstat(fd, &info) != 0) {
+            ::close(fd);
+            return false;
+        }
+        if (info.st_size == 0) {
+            ::close(fd);
+            return true; // nothing to map
+        }
+        void* mapped = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        bytes = (const char*)mapped;
+        length = (size_t)info.st_size;
+        return true;
+#endif
+    }
+
+    const char* data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+// Content-addressed store for file contents, kept in one directory. Each
+// blob is written once under its BlobId, however many files, repositories
+// and forks refer to it, so adding content the store already holds costs
+// a hash and an index probe. Blobs under LARGE_BLOB_BYTES are appended to
+// pack files (pack-0, pack-1, ...) that roll over at PACK_BYTES; larger
+// ones get a loose file of their own, named by the id, which reads map.
+// An append-only index of fixed-size records, each written after the data
+// it locates, is loaded on open; records pointing past the end of their
+// file, left by a crash, are dropped. Blobs are never removed. Writes are
+// left to the OS until sync(), which forces the data out before the index.
+class BlobStore {
+public:
+    static constexpr size_t LARGE_BLOB_BYTES = 64 * 1024;
+    static constexpr uint64_t PACK_BYTES = 64ull * 1024 * 1024;
+
+    // A blob's bytes and what keeps them alive: a copy for a packed blob,
+    // the mapping for a loose one.
+    struct Blob {
+        shared_ptr<const void> storage;
+        string_view data;
+    };
+
+    struct Stats {
+        size_t blobs;
+        size_t looseBlobs;
+        size_t packs;
+        uint64_t storedBytes;
+        size_t duplicates;       // puts of content that was already stored
+        uint64_t duplicateBytes; // and the bytes they did not have to write
+    };
+
+private:
+    static constexpr uint32_t LOOSE = UINT32_MAX;
+
+    struct Location {
+        uint32_t pack; // or LOOSE
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    struct IndexRecord {
+        uint64_t high;
+        uint64_t low;
+        Location location;
+    };
+
+    string directory;
+    mutex writeLock;                // serializes writers; taken before indexLock
+    mutable shared_mutex indexLock; // locations and packReaders
+    unordered_map<BlobId, Location, BlobIdHash> locations;
+    vector<int> packReaders; // one read descriptor per pack
+    int indexFd;
+    int packFd; // the pack being appended to
+    uint64_t packSize;
+    uint64_t storedBytes;
+    size_t looseBlobs;
+    atomic<size_t> duplicates;
+    atomic<uint64_t> duplicateBytes;
+
+    string packPath(uint32_t pack) const { return directory + "/pack-" + to_string(pack); }
+    string loosePath(const BlobId& id) const { return directory + "/" + id.toHex(); }
+    string indexPath() const { return directory + "/index"; }
+
+    // With truncate, whatever the file held before is discarded.
+    static int openFile(const string& path, bool forWriting, bool truncate = false) {
+#ifdef _WIN32
+        return forWriting ? _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY | (truncate ? _O_TRUNC : 0), _S_IREAD | _S_IWRITE)
+            : _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        return forWriting ? ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT | (truncate ? O_TRUNC : 0), 0644) : ::open(path.c_str(), O_RDONLY);
+#endif
+    }
+
+    static void closeFile(int fd) {
+        if (fd >= 0) {
+#ifdef _WIN32
+            _close(fd);
+#else
+            ::close(fd);
+#endif
+        }
+    }
+
+    static void syncFile(int fd) {
+#ifdef _WIN32
+        _commit(fd);
+#else
+        fsync(fd);
+#endif
+    }
+
+    static bool writeAll(int fd, const char* data, size_t length) {
+        size_t written = 0;
+        while (written < length) {
+#ifdef _WIN32
+            int result = _write(fd, data + written, (unsigned int)(length - written));
+#else
+            ssize_t result = ::write(fd, data + written, length - written);
+#endif
+            if (result <= 0) {
+                return false;
+            }
+            written += (size_t)result;
+        }
+        return true;
+    }
+
+    // Reads a packed blob into out, which already has its size.
+    bool readPacked([[maybe_unused]] int fd, [[maybe_unused]] uint32_t pack, uint64_t offset, string& out) const {
+#ifdef _WIN32
+        // No positioned reads here, so each read opens the pack afresh.
+        ifstream file(packPath(pack), ios::binary);
+        file.seekg((streamoff)offset);
+        file.read(&out[0], (streamsize)out.size());
+        return (bool)file;
+#else
+        size_t done = 0;
+        while (done < out.size()) {
+            ssize_t result = pread(fd, &out[done], out.size() - done, (off_t)(offset + done));
+            if (result <= 0) {
+                return false;
+            }
+            done += (size_t)result;
+        }
+        return true;
+#endif
+    }
+
+    // Starts the next pack. The caller holds writeLock.
+    bool startPack() {
+        uint32_t pack = (uint32_t)packReaders.size();
+        int writer = openFile(packPath(pack), true);
+        int reader = writer >= 0 ? openFile(packPath(pack), false) : -1;
+        if (reader < 0) {
+            closeFile(writer);
+            return false;
+        }
+        closeFile(packFd);
+        packFd = writer;
+        packSize = 0;
+        unique_lock<shared_mutex> guard(indexLock);
+        packReaders.push_back(reader);
+        return true;
+    }
+
+    // Writes a large blob to a file of its own: a temporary file, synced
+    // and renamed, so the name only ever holds the whole blob. A temporary
+    // left behind by a crash is overwritten, not appended to.
+    bool writeLoose(const BlobId& id, string_view content) {
+        string path = loosePath(id);
+        string temporary = path + ".tmp";
+        int fd = openFile(temporary, true, true);
+        if (fd < 0) {
+            return false;
+        }
+        bool written = writeAll(fd, content.data(), content.size());
+        if (written) {
+            syncFile(fd);
+        }
+        closeFile(fd);
+        error_code error;
+        if (written) {
+            filesystem::rename(temporary, path, error);
+        }
+        if (!written || error) {
+            filesystem::remove(temporary, error);
+            return false;
+        }
+        return true;
+    }
+
+public:
+    BlobStore() : indexFd(-1), packFd(-1), packSize(0), storedBytes(0), looseBlobs(0), duplicates(0), duplicateBytes(0) {}
+
+    BlobStore(const BlobStore&) = delete;
+    BlobStore& operator=(const BlobStore&) = delete;
+
+    ~BlobStore() {
+        closeFile(indexFd);
+        closeFile(packFd);
+        for (int fd : packReaders) {
+            closeFile(fd);
+        }
+    }
+
+    // Opens the store in path, creating it if need be, and loads its
+    // index. Runs before other threads use the store.
+    bool open(const string& path) {
+        directory = path;
+        error_code error;
+        filesystem::create_directories(directory, error);
+        if (!filesystem::is_directory(directory, error)) {
+            cout << "Unable to create blob store: " << directory << endl;
+            return false;
+        }
+
+        vector<uint64_t> packSizes;
+        while (filesystem::exists(packPath((uint32_t)packSizes.size()), error)) {
+            packSizes.push_back(filesystem::file_size(packPath((uint32_t)packSizes.size()), error));
+        }
+        for (uint32_t pack = 0; pack < packSizes.size(); pack++) {
+            int reader = openFile(packPath(pack), false);
+            if (reader < 0) {
+                cout << "Unable to open blob pack: " << packPath(pack) << endl;
+                return false;
+            }
+            packReaders.push_back(reader);
+        }
+
+        size_t validLength = 0;
+        size_t dropped = 0;
+        {
+            MappedFile index;
+            if (index.open(indexPath())) {
+                size_t recordCount = index.size() / sizeof(IndexRecord);
+                validLength = recordCount * sizeof(IndexRecord);
+                for (size_t i = 0; i < recordCount; i++) {
+                    IndexRecord record;
+                    memcpy(&record, index.data() + i * sizeof(IndexRecord), sizeof(record));
+                    const Location& location = record.location;
+                    bool present;
+                    if (location.pack == LOOSE) {
+                        BlobId id{ record.high, record.low };
+                        present = filesystem::file_size(loosePath(id), error) == location.size && !error;
+                    }
+                    else {
+                        present = location.pack < packSizes.size() && location.offset <= packSizes[location.pack] &&
+                            location.size <= packSizes[location.pack] - location.offset;
+                    }
+                    if (!present) {
+                        dropped++;
+                        continue;
+                    }
+                    if (locations.emplace(BlobId{ record.high, record.low }, location).second) {
+                        storedBytes += location.size;
+                        looseBlobs += location.pack == LOOSE;
+                    }
+                }
+            }
+        }
+        if (dropped > 0) {
+            cout << "Dropped " << dropped << " blob index records with missing data." << endl;
+        }
+        if (filesystem::exists(indexPath(), error) && filesystem::file_size(indexPath(), error) > validLength) {
+            filesystem::resize_file(indexPath(), validLength, error);
+        }
+
+        indexFd = openFile(indexPath(), true);
+        if (indexFd < 0) {
+            cout << "Unable to open blob index: " << indexPath() << endl;
+            return false;
+        }
+        if (packSizes.empty() || packSizes.back() >= PACK_BYTES) {
+            return startPack();
+        }
+        packFd = openFile(packPath((uint32_t)packSizes.size() - 1), true);
+        packSize = packSizes.back();
+        return packFd >= 0;
+    }
+
+    // Stores content if the store does not hold it yet and names it in id.
+    // Empty content is never stored; its id is the null id. Returns false
+    // if the blob could not be written.
+    bool put(string_view content, BlobId& id) {
+        id = BlobId::of(content);
+        if (id.isNull()) {
+            return true;
+        }
+        {
+            shared_lock<shared_mutex> guard(indexLock);
+            if (locations.count(id)) {
+                duplicates++;
+                duplicateBytes += content.size();
+                return true;
+            }
+        }
+
+        lock_guard<mutex> writer(writeLock);
+        if (locations.count(id)) { // only writers change locations, so no indexLock is needed to look
+            duplicates++;
+            duplicateBytes += content.size();
+            return true;
+        }
+        Location location = { LOOSE, 0, 0, content.size() };
+        if (content.size() >= LARGE_BLOB_BYTES) {
+            if (!writeLoose(id, content)) {
+                cout << "Unable to write blob: " << loosePath(id) << endl;
+                return false;
+            }
+        }
+        else {
+            if (packSize + content.size() > PACK_BYTES && !startPack()) {
+                cout << "Unable to start blob pack: " << packPath((uint32_t)packReaders.size()) << endl;
+                return false;
+            }
+            if (!writeAll(packFd, content.data(), content.size())) {
+                // Part of the blob may have reached the pack, so later
+                // offsets start from its real end. If that is unknown, the
+                // next blob starts a new pack.
+                string pack = packPath((uint32_t)packReaders.size() - 1);
+                cout << "Unable to write blob pack: " << pack << endl;
+                error_code error;
+                uint64_t size = filesystem::file_size(pack, error);
+                packSize = error ? PACK_BYTES : size;
+                return false;
+            }
+            location.pack = (uint32_t)packReaders.size() - 1;
+            location.offset = packSize;
+            packSize += content.size();
+        }
+        IndexRecord record = { id.high, id.low, location };
+        if (!writeAll(indexFd, (const char*)&record, sizeof(record))) {
+            // Drop any partial record, so the records after it stay aligned.
+            cout << "Unable to write blob index: " << indexPath() << endl;
+            error_code error;
+            uint64_t size = filesystem::file_size(indexPath(), error);
+            if (!error) {
+                filesystem::resize_file(indexPath(), size - size % sizeof(IndexRecord), error);
+            }
+            return false;
+        }
+        unique_lock<shared_mutex> guard(indexLock);
+        locations.emplace(id, location);
+        storedBytes += content.size();
+        looseBlobs += location.pack == LOOSE;
+        return true;
+    }
+
+    bool contains(const BlobId& id) const {
+        shared_lock<shared_mutex> guard(indexLock);
+        return id.isNull() || locations.count(id) != 0;
+    }
+
+    // Size of the blob without reading it; false if the store does not hold it.
+    bool sizeOf(const BlobId& id, uint64_t& size) const {
+        shared_lock<shared_mutex> guard(indexLock);
+        auto found = locations.find(id);
+        size = found != locations.end() ? found->second.size : 0;
+        return id.isNull() || found != locations.end();
+    }
+
+    // Returns false if the store does not hold the blob, or it could not
+    // be read back. The null id reads as empty content.
+    bool read(const BlobId& id, Blob& blob) const {
+        blob = Blob();
+        if (id.isNull()) {
+            return true;
+        }
+        Location location;
+        int fd = -1;
+        {
+            shared_lock<shared_mutex> guard(indexLock);
+            auto found = locations.find(id);
+            if (found == locations.end()) {
+                return false;
+            }
+            location = found->second;
+            if (location.pack != LOOSE) {
+                fd = packReaders[location.pack];
+            }
+        }
+        if (location.pack == LOOSE) {
+            shared_ptr<MappedFile> mapping = make_shared<MappedFile>();
+            if (!mapping->open(loosePath(id)) || mapping->size() != location.size) {
+                return false;
+            }
+            blob.data = string_view(mapping->data(), mapping->size());
+            blob.storage = mapping;
+            return true;
+        }
+        shared_ptr<string> bytes = make_shared<string>((size_t)location.size, '\0');
+        if (!readPacked(fd, location.pack, location.offset, *bytes)) {
+            return false;
+        }
+        blob.data = *bytes;
+        blob.storage = bytes;
+        return true;
+    }
+
+    // Forces written blobs to disk, the pack data ahead of the index
+    // records that point into it. Loose blobs are synced as they are written.
+    void sync() {
+        lock_guard<mutex> writer(writeLock);
+        if (packFd >= 0) {
+            syncFile(packFd);
+        }
+        if (indexFd >= 0) {
+            syncFile(indexFd);
+        }
+    }
+
+    Stats getStats() const {
+        shared_lock<shared_mutex> guard(indexLock);
+        return { locations.size(), looseBlobs, packReaders.size(), storedBytes, duplicates.load(), duplicateBytes.load() };
+    }
+};
+
+// Binary snapshot layout. A header gives the offset and size of each
+// section; strings live once in the string table and records refer to
+// them by offset, so a loaded snapshot can hand out views straight into
+// the mapping. Sections are 8-byte aligned and records are fixed size,
+// so each section is read in place as an array. Integers are in host
+// byte order; byteOrder lets a reader reject a file from another host.
+const char SNAPSHOT_MAGIC[8] = { 'G', 'H', 'S', 'N', 'A', 'P', '\r', '\n' };
+const uint32_t SNAPSHOT_VERSION = 6; // 3 added commit authors and times, 4 file contents, 5 commit parents, 6 fork upstreams; 2 to 5 are still read
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+enum SnapshotSection {
+    SECTION_STRINGS,
+    SECTION_USERS,
+    SECTION_REPOSITORIES,
+    SECTION_COMMITS,
+    SECTION_FILES,
+    SECTION_FOLLOWS,
+    SECTION_COUNT
+};
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t sectionOffsets[SECTION_COUNT];
+    uint64_t sectionSizes[SECTION_COUNT];
+    uint64_t journalSequence; // last journal record already reflected in the snapshot
+};
+
+struct SnapshotString {
+    uint64_t offset; // into the string table
+    uint32_t length;
+    uint32_t reserved;
+};
+
+struct SnapshotUser {
+    SnapshotString name;
+    SnapshotString credential; // plain password in snapshots written before hashing
+    uint32_t firstRepository;
+    uint32_t repositoryCount; // owned repositories, followed by the forks
+    uint32_t forkedCount;
+    uint32_t reserved;
+};
+
+// Versions before 6 end the record at upstreamOwner.
+struct SnapshotRepository {
+    SnapshotString name;
+    uint32_t isPublic;
+    uint32_t forkCount;
+    uint32_t firstCommit;
+    uint32_t commitCount;
+    uint32_t firstFile;
+    uint32_t fileCount;
+    uint32_t upstreamOwner; // for a fork, the user record owning the repository it was forked from, or StringInterner::NONE
+    uint32_t reserved;
+};
+
+// Versions 3 and 4 end the record at parents. Commits that no repository
+// lists any more, but that a merge still reaches, follow every repository's
+// commits with an empty message.
+struct SnapshotCommit {
+    SnapshotString message;
+    uint32_t author; // indexes into the user section, or StringInterner::NONE
+    uint32_t reserved;
+    int64_t timestamp;
+    uint64_t idHigh; // see CommitGraph
+    uint64_t idLow;
+    uint32_t parents[2]; // index into the commit section, or CommitGraph::NONE
+};
+
+struct SnapshotFile {
+    SnapshotString name;
+    uint64_t contentHigh; // BlobId of the content, in a BlobStore kept beside the snapshot
+    uint64_t contentLow;
+};
+
+struct SnapshotFollow {
+    uint32_t follower; // indexes into the user section
+    uint32_t followee;
+};
+
+enum JournalOperation {
+    JOURNAL_REGISTER = 1,        // username, password credential
+    JOURNAL_CREATE_REPOSITORY,   // username, repository, public ("1"/"0")
+    JOURNAL_DELETE_REPOSITORY,   // username, repository
+    JOURNAL_COMMIT,              // username, repository, message
+    JOURNAL_ADD_FILE,            // username, repository, file[, content blob id in hex]
+    JOURNAL_DELETE_FILE,         // username, repository, file
+    JOURNAL_FORK,                // username, repository
+    JOURNAL_FOLLOW,              // follower, followee
+    JOURNAL_UNFOLLOW,            // follower, followee
+    JOURNAL_SET_VISIBILITY,      // username, repository, public ("1"/"0")
+    JOURNAL_MERGE                // username, repository, source repository, message[, timestamp]
+};
+
+// When buffered journal records are written out and forced to disk.
+struct JournalPolicy {
+    size_t groupSize = 64;                                 // records per group commit
+    chrono::milliseconds maxDelay = chrono::milliseconds(50); // oldest buffered record is written by the next append after this
+    bool syncToDisk = true;                                // fsync each group; false leaves it to the OS
+};
+
+// Append-only operation log. Records are buffered and written as a group
+// with one write and one fsync. Each record is framed as
+//   uint32 payload length | uint32 checksum | uint64 sequence | payload
+// where the payload is the operation byte, a field count byte and then
+// each field as uint32 length + bytes. Sequence numbers keep increasing
+// across truncations, so a snapshot can record the last one it covers.
+// Appends may come from several threads; sequence numbers follow the
+// order in which they took the lock.
+class Journal {
+private:
+    string path;
+    JournalPolicy policy;
+    mutable mutex lock;
+    int fd;
+    string pending;
+    size_t pendingRecords;
+    size_t recordsInFile;
+    chrono::steady_clock::time_point oldestPending;
+    uint64_t lastSequence;
+
+    static uint32_t checksum(const char* data, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ (unsigned char)data[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static void appendInt(string& out, uint64_t value, int bytes) {
+        for (int i = 0; i < bytes; i++) {
+            out.push_back((char)(value >> (8 * i)));
+        }
+    }
+
+    static uint64_t readInt(const char* data, int bytes) {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++) {
+            value |= (uint64_t)(unsigned char)data[i] << (8 * i);
+        }
+        return value;
+    }
+
+    bool openForAppend() {
+#ifdef _WIN32
+        fd = _open(path.c_str(), _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+        fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+#endif
+        if (fd < 0) {
+            cout << "Unable to open journal: " << path << endl;
+            return false;
+        }
+        return true;
+    }
+
+    // Group commit: writes every buffered record, then syncs once. The
+    // caller holds the lock.
+    bool flushLocked() {
+        if (pending.empty() || fd < 0) {
+            return pending.empty();
+        }
+        size_t written = 0;
+        while (written < pending.size()) {
+#ifdef _WIN32
+            int result = _write(fd, pending.data() + written, (unsigned int)(pending.size() - written));
+#else
+            ssize_t result = ::write(fd, pending.data() + written, pending.size() - written);
+#endif
+            if (result <= 0) {
+                cout << "Unable to write journal: " << path << endl;
+                return false;
+            }
+            written += (size_t)result;
+        }
+        if (policy.syncToDisk) {
+#ifdef _WIN32
+            _commit(fd);
+#else
+            fsync(fd);
+#endif
+        }
+        recordsInFile += pendingRecords;
+        pending.clear();
+        pendingRecords = 0;
+        return true;
+    }
+
+public:
+    Journal(const string& journalPath, JournalPolicy journalPolicy = JournalPolicy())
+        : path(journalPath), policy(journalPolicy), fd(-1), pendingRecords(0), recordsInFile(0), lastSequence(0) {}
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    ~Journal() {
+        flush();
+        if (fd >= 0) {
+#ifdef _WIN32
+            _close(fd);
+#else
+            ::close(fd);
+#endif
+        }
+    }
+
+    void setPolicy(JournalPolicy journalPolicy) {
+        lock_guard<mutex> guard(lock);
+        policy = journalPolicy;
+    }
+
+    // Feeds every intact record with a sequence number above afterSequence
+    // to apply, cuts off a torn or corrupt tail left by a crash, and opens
+    // the journal for appending. Returns the number of records applied.
+    // Runs before other threads use the journal, so it takes no lock and
+    // apply may take locks of its own.
+    size_t replay(uint64_t afterSequence, const function<void(JournalOperation, const vector<string_view>&)>& apply) {
+        lastSequence = afterSequence;
+        recordsInFile = 0;
+        size_t applied = 0;
+        size_t validLength = 0;
+        {
+            MappedFile file;
+            if (file.open(path)) {
+                const char* data = file.data();
+                size_t size = file.size();
+                vector<string_view> fields;
+                while (size - validLength >= 16) {
+                    const char* frame = data + validLength;
+                    uint64_t payloadLength = readInt(frame, 4);
+                    if (payloadLength < 2 || payloadLength > size - validLength - 16 ||
+                        readInt(frame + 4, 4) != checksum(frame + 8, 8 + payloadLength)) {
+                        break;
+                    }
+                    uint64_t sequence = readInt(frame + 8, 8);
+                    const char* payload = frame + 16;
+                    JournalOperation operation = (JournalOperation)(unsigned char)payload[0];
+                    int fieldCount = (unsigned char)payload[1];
+                    fields.clear();
+                    size_t offset = 2;
+                    for (int i = 0; i < fieldCount && offset + 4 <= payloadLength; i++) {
+                        uint64_t fieldLength = readInt(payload + offset, 4);
+                        if (fieldLength > payloadLength - offset - 4) {
+                            break;
+                        }
+                        fields.push_back(string_view(payload + offset + 4, fieldLength));
+                        offset += 4 + fieldLength;
+                    }
+                    if ((int)fields.size() != fieldCount) {
+                        break;
+                    }
+                    if (sequence > afterSequence) {
+                        apply(operation, fields);
+                        applied++;
+                    }
+                    lastSequence = max(lastSequence, sequence);
+                    validLength += 16 + payloadLength;
+                    recordsInFile++;
+                }
+                if (validLength < size) {
+                    cout << "Discarding " << (size - validLength) << " bytes of incomplete journal tail." << endl;
+                }
+            }
+        }
+
+        error_code error;
+        if (filesystem::exists(path, error) && filesystem::file_size(path, error) > validLength) {
+            filesystem::resize_file(path, validLength, error);
+        }
+        openForAppend();
+        return applied;
+    }
+
+    void append(JournalOperation operation, initializer_list<string_view> fields) {
+        lock_guard<mutex> guard(lock);
+        size_t frameStart = pending.size();
+        appendInt(pending, 0, 4); // payload length, patched below
+        appendInt(pending, 0, 4); // checksum, patched below
+        appendInt(pending, ++lastSequence, 8);
+        pending.push_back((char)operation);
+        pending.push_back((char)fields.size());
+        for (string_view field : fields) {
+            appendInt(pending, field.size(), 4);
+            pending.append(field.data(), field.size());
+        }
+        size_t payloadLength = pending.size() - frameStart - 16;
+        uint32_t sum = checksum(pending.data() + frameStart + 8, 8 + payloadLength);
+        for (int i = 0; i < 4; i++) {
+            pending[frameStart + i] = (char)(payloadLength >> (8 * i));
+            pending[frameStart + 4 + i] = (char)(sum >> (8 * i));
+        }
+
+        if (pendingRecords++ == 0) {
+            oldestPending = chrono::steady_clock::now();
+        }
+        if (pendingRecords >= policy.groupSize || chrono::steady_clock::now() - oldestPending >= policy.maxDelay) {
+            flushLocked();
+        }
+    }
+
+    bool flush() {
+        lock_guard<mutex> guard(lock);
+        return flushLocked();
+    }
+
+    // Drops every record once a snapshot covering them has been written.
+    void truncate() {
+        lock_guard<mutex> guard(lock);
+        flushLocked();
+        error_code error;
+        filesystem::resize_file(path, 0, error);
+        recordsInFile = 0;
+    }
+
+    size_t getRecordCount() const {
+        lock_guard<mutex> guard(lock);
+        return recordsInFile + pendingRecords;
+    }
+
+    uint64_t getLastSequence() const {
+        lock_guard<mutex> guard(lock);
+        return lastSequence;
+    }
+};
+
+// SHA-256 (FIPS 180-4), only as the building block for password hashing.
+class Sha256 {
+private:
+    uint32_t state[8];
+    unsigned char block[64];
+    size_t blockLength;
+    uint64_t totalLength;
+
+    static uint32_t rotr(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+    void compress(const unsigned char* data) {
+        static const uint32_t k[64] = {
+            0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+            0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+            0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+            0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+            0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+            0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+            0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+            0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+        uint32_t w[64];
+        for (int i = 0; i < 16; i++) {
+            w[i] = (uint32_t)data[4 * i] << 24 | (uint32_t)data[4 * i + 1] << 16 | (uint32_t)data[4 * i + 2] << 8 | data[4 * i + 3];
+        }
+        for (int i = 16; i < 64; i++) {
+            uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; i++) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + k[i] + w[i];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+
+public:
+    static constexpr size_t DIGEST_SIZE = 32;
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    Sha256() : state{ 0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 },
+        blockLength(0), totalLength(0) {}
+
+    void update(const void* data, size_t length) {
+        const unsigned char* bytes = (const unsigned char*)data;
+        totalLength += length;
+        if (blockLength > 0) {
+            size_t take = min(length, BLOCK_SIZE - blockLength);
+            memcpy(block + blockLength, bytes, take);
+            blockLength += take;
+            bytes += take;
+            length -= take;
+            if (blockLength < BLOCK_SIZE) {
+                return;
+            }
+            compress(block);
+            blockLength = 0;
+        }
+        for (; length >= BLOCK_SIZE; bytes += BLOCK_SIZE, length -= BLOCK_SIZE) {
+            compress(bytes);
+        }
+        memcpy(block, bytes, length);
+        blockLength = length;
+    }
+
+    void finish(unsigned char digest[DIGEST_SIZE]) {
+        uint64_t bitLength = totalLength * 8;
+        unsigned char padding[BLOCK_SIZE * 2] = { 0x80 };
+        size_t padLength = (blockLength < 56 ? 56 : 120) - blockLength;
+        for (int i = 0; i < 8; i++) {
+            padding[padLength + i] = (unsigned char)(bitLength >> (56 - 8 * i));
+        }
+        update(padding, padLength + 8);
+        for (int i = 0; i < 8; i++) {
+            for (int j = 0; j < 4; j++) {
+                digest[4 * i + j] = (unsigned char)(state[i] >> (24 - 8 * j));
+            }
+        }
+    }
+};
+
+// Salted, deliberately slow password hashes: PBKDF2-HMAC-SHA256 (RFC 8018).
+// A stored credential records its own cost and salt,
+//   pbkdf2-sha256$<iterations>$<salt hex>$<hash hex>
+// so raising the cost for new passwords keeps old credentials valid.
+class PasswordHasher {
+private:
+    static constexpr size_t SALT_SIZE = 16;
+
+    static string toHex(const unsigned char* data, size_t length) {
+        static const char digits[] = "0123456789abcdef";
+        string hex;
+        for (size_t i = 0; i < length; i++) {
+            hex.push_back(digits[data[i] >> 4]);
+            hex.push_back(digits[data[i] & 15]);
+        }
+        return hex;
+    }
+
+    static bool fromHex(string_view hex, string& bytes) {
+        if (hex.size() % 2 != 0) {
+            return false;
+        }
+        bytes.clear();
+        for (size_t i = 0; i < hex.size(); i += 2) {
+            int value = 0;
+            for (int j = 0; j < 2; j++) {
+                char c = hex[i + j];
+                int digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : -1;
+                if (digit < 0) {
+                    return false;
+                }
+                value = value * 16 + digit;
+            }
+            bytes.push_back((char)value);
+        }
+        return true;
+    }
+
+    // One 32-byte block of PBKDF2. The HMAC key pads are hashed once up
+    // front, so each iteration costs two SHA-256 compressions.
+    static void derive(string_view password, string_view salt, int iterations, unsigned char out[Sha256::DIGEST_SIZE]) {
+        unsigned char key[Sha256::BLOCK_SIZE] = {};
+        if (password.size() > Sha256::BLOCK_SIZE) {
+            Sha256 keyHash;
+            keyHash.update(password.data(), password.size());
+            keyHash.finish(key);
+        }
+        else {
+            memcpy(key, password.data(), password.size());
+        }
+        unsigned char innerPad[Sha256::BLOCK_SIZE];
+        unsigned char outerPad[Sha256::BLOCK_SIZE];
+        for (size_t i = 0; i < Sha256::BLOCK_SIZE; i++) {
+            innerPad[i] = key[i] ^ 0x36;
+            outerPad[i] = key[i] ^ 0x5c;
+        }
+        Sha256 inner;
+        Sha256 outer;
+        inner.update(innerPad, sizeof(innerPad));
+        outer.update(outerPad, sizeof(outerPad));
+        auto hmac = [&inner, &outer](const void* message, size_t length, unsigned char digest[Sha256::DIGEST_SIZE]) {
+            Sha256 innerHash = inner;
+            innerHash.update(message, length);
+            innerHash.finish(digest);
+            Sha256 outerHash = outer;
+            outerHash.update(digest, Sha256::DIGEST_SIZE);
+            outerHash.finish(digest);
+        };
+
+        string first(salt);
+        first.append("\0\0\0\1", 4); // block index 1
+        unsigned char u[Sha256::DIGEST_SIZE];
+        hmac(first.data(), first.size(), u);
+        memcpy(out, u, sizeof(u));
+        for (int i = 1; i < iterations; i++) {
+            hmac(u, sizeof(u), u);
+            for (size_t j = 0; j < sizeof(u); j++) {
+                out[j] ^= u[j];
+            }
+        }
+    }
+
+public:
+    static constexpr int DEFAULT_ITERATIONS = 100000;
+
+    static bool isCredential(string_view stored) {
+        return stored.compare(0, 14, "pbkdf2-sha256$") == 0;
+    }
+
+    static string hash(string_view password, int iterations) {
+        static mutex randomLock;
+        static random_device randomSource;
+        unsigned char salt[SALT_SIZE];
+        {
+            lock_guard<mutex> guard(randomLock);
+            for (size_t i = 0; i < SALT_SIZE; i += 4) {
+                uint32_t value = randomSource();
+                memcpy(salt + i, &value, 4);
+            }
+        }
+        unsigned char digest[Sha256::DIGEST_SIZE];
+        derive(password, string_view((const char*)salt, SALT_SIZE), iterations, digest);
+        return "pbkdf2-sha256$" + to_string(iterations) + "$" + toHex(salt, SALT_SIZE) + "$" + toHex(digest, sizeof(digest));
+    }
+
+    // Rehashes with the stored salt and cost and compares in constant time.
+    static bool verify(string_view password, string_view credential) {
+        if (!isCredential(credential)) {
+            return false;
+        }
+        string_view rest = credential.substr(14);
+        size_t costEnd = rest.find('$');
+        size_t saltEnd = costEnd == string_view::npos ? string_view::npos : rest.find('$', costEnd + 1);
+        if (saltEnd == string_view::npos) {
+            return false;
+        }
+        int iterations = atoi(string(rest.substr(0, costEnd)).c_str());
+        string salt;
+        string expected;
+        if (iterations < 1 || !fromHex(rest.substr(costEnd + 1, saltEnd - costEnd - 1), salt) ||
+            !fromHex(rest.substr(saltEnd + 1), expected) || expected.size() != Sha256::DIGEST_SIZE) {
+            return false;
+        }
+        unsigned char digest[Sha256::DIGEST_SIZE];
+        derive(password, salt, iterations, digest);
+        unsigned char difference = 0;
+        for (size_t i = 0; i < Sha256::DIGEST_SIZE; i++) {
+            difference |= digest[i] ^ (unsigned char)expected[i];
+        }
+        return difference == 0;
+    }
+};
+
+// Maps session tokens to users so that authenticated requests cost one
+// hash lookup instead of a password hash. Tokens are 128 random bits and
+// expire a fixed time after login.
+class SessionCache {
+private:
+    struct Session {
+        User* user;
+        chrono::steady_clock::time_point expires;
+    };
+
+    static constexpr size_t SHARDS = 16; // shardFor takes the top 4 bits of the hash
+
+    struct Shard {
+        mutex lock;
+        FlatHashMap<string, Session> sessions;
+        size_t createdSincePurge = 0;
+    };
+
+    Shard shards[SHARDS];
+    atomic<chrono::seconds::rep> lifetime;
+    mutex randomLock;
+    random_device random; // the token is the credential, so every bit comes from the system source
+
+    Shard& shardFor(uint32_t tokenHash) { return shards[tokenHash >> 28]; }
+
+public:
+    SessionCache(chrono::seconds sessionLifetime = chrono::minutes(30)) : lifetime(sessionLifetime.count()) {}
+
+    void setLifetime(chrono::seconds sessionLifetime) { lifetime = sessionLifetime.count(); }
+
+    string create(User* user) {
+        static const char digits[] = "0123456789abcdef";
+        string token;
+        {
+            lock_guard<mutex> guard(randomLock);
+            for (int part = 0; part < 4; part++) {
+                uint32_t bits = random();
+                for (int i = 0; i < 8; i++, bits >>= 4) {
+                    token.push_back(digits[bits & 15]);
+                }
+            }
+        }
+        auto now = chrono::steady_clock::now();
+        uint32_t tokenHash = FlatHashMap<string, Session>::hashKey(token);
+        Shard& shard = shardFor(tokenHash);
+        lock_guard<mutex> guard(shard.lock);
+        // Expired sessions are swept now and then rather than on a timer.
+        if (++shard.createdSincePurge >= 1024) {
+            vector<string> expired;
+            for (const auto& entry : shard.sessions) {
+                if (entry.second.expires <= now) {
+                    expired.push_back(entry.first);
+                }
+            }
+            for (const string& old : expired) {
+                shard.sessions.erase(old);
+            }
+            shard.createdSincePurge = 0;
+        }
+        shard.sessions.findOrInsert(token, tokenHash) = Session{ user, now + chrono::seconds(lifetime.load()) };
+        return token;
+    }
+
+    // The session's user, or nullptr if the token is unknown or expired.
+    User* find(string_view token) {
+        uint32_t tokenHash = FlatHashMap<string, Session>::hashKey(token);
+        Shard& shard = shardFor(tokenHash);
+        lock_guard<mutex> guard(shard.lock);
+        const Session* session = shard.sessions.find(token, tokenHash);
+        if (!session) {
+            return nullptr;
+        }
+        if (session->expires <= chrono::steady_clock::now()) {
+            shard.sessions.erase(token);
+            return nullptr;
+        }
+        return session->user;
+    }
+
+    void revoke(string_view token) {
+        Shard& shard = shardFor(FlatHashMap<string, Session>::hashKey(token));
+        lock_guard<mutex> guard(shard.lock);
+        shard.sessions.erase(token);
+    }
+};
+
+class UserManager {
+private:
+
+    StringInterner& usernames;
+    SocialGraph& socialGraph;
+    RepositoryCatalog& catalog;
+    PagedArray<atomic<User*>> users; // indexed by interned username id, null for names that are not users
+
+    string dataFile = "data.xlsx"; 
+    string datafile = "user_data.txt";
+    string snapshotFile = "platform.snapshot";
+    uint64_t snapshotJournalSequence = 0;
+    atomic<int> hashIterations{ PasswordHasher::DEFAULT_ITERATIONS };
+    SessionCache sessions;
+
+    // The graph decides which of several concurrent registrations of one
+    // name wins. beforePublish runs for the winner while no other thread
+    // can see the new user yet.
+    User* addUser(const string& username, const string& credential, const function<void(User*)>& beforePublish = nullptr) {
+        uint32_t id = usernames.intern(username);
+        if (!socialGraph.addUser(id)) {
+            return nullptr;
+        }
+        User* user = new User(username, credential, id, socialGraph);
+        if (beforePublish) {
+            beforePublish(user);
+        }
+        users.at(id).store(user, memory_order_release);
+        return user;
+    }
+
+public:
+    UserManager(StringInterner& names, SocialGraph& graph, RepositoryCatalog& repositories) : usernames(names), socialGraph(graph), catalog(repositories) {}
+
+    // Hashing is the slow part, so a name that is plainly taken is
+    // refused before paying for it.
+    bool registerUser(const string& username, const string& password, const function<void(User*)>& beforePublish = nullptr) {
+        if (getUser(username)) {
+            return false;
+        }
+        return addUser(username, PasswordHasher::hash(password, hashIterations), beforePublish) != nullptr;
+    }
+
+    // Re-creates a user from a stored credential. Files written before
+    // passwords were hashed hold the password itself; it is hashed here.
+    bool restoreUser(const string& username, const string& stored) {
+        return addUser(username, PasswordHasher::isCredential(stored) ? stored : PasswordHasher::hash(stored, hashIterations)) != nullptr;
+    }
+
+    User* loginUser(const string& username, const string& password) const {
+        User* user = getUser(username);
+        if (user && PasswordHasher::verify(password, user->getPasswordHash())) {
+            return user;
+        }
+        return nullptr;
+    }
+
+    // Checks the password once and returns a token for later requests,
+    // or an empty string if the login fails.
+    string startSession(const string& username, const string& password) {
+        User* user = loginUser(username, password);
+        return user ? sessions.create(user) : string();
+    }
+
+    User* getSessionUser(string_view token) { return sessions.find(token); }
+    void endSession(string_view token) { sessions.revoke(token); }
+
+    // Cost of newly hashed passwords; existing credentials keep their own.
+    void setHashIterations(int iterations) { hashIterations = max(1, iterations); }
+    int getHashIterations() const { return hashIterations; }
+    void setSessionLifetime(chrono::seconds lifetime) { sessions.setLifetime(lifetime); }
+
+    User* getUser(uint32_t id) const {
+        const atomic<User*>* slot = users.find(id);
+        return slot ? slot->load(memory_order_acquire) : nullptr;
+    }
+
+    User* getUser(string_view username) const {
+        return getUser(usernames.find(username));
+    }
+
+    // One past the highest user id.
+    uint32_t getIdLimit() const { return (uint32_t)users.size(); }
+
+    void saveUserData() {
+        ofstream file(dataFile);
+        if (file.is_open()) {
+            for (uint32_t id = 0; id < users.size(); id++) {
+                User* user = getUser(id);
+                if (user) {
+                    file << user->getUsername() << "," << user->getPasswordHash() << endl;
+                }
+            }
+            file.close();
+            cout << "User data saved to file: " << dataFile << endl;
+        }
+        else {
+            cout << "Unable to open file: " << dataFile << endl;
+        }
+    }
+
+
+    void loadUserData() {
+        ifstream file(dataFile);
+        if (file.is_open()) {
+            string line;
+            while (getline(file, line)) {
+                size_t pos = line.find(",");
+                if (pos != string::npos) {
+                    string username = line.substr(0, pos);
+                    string credential = line.substr(pos + 1);
+                    restoreUser(username, credential);
+                }
+            }
+            file.close();
+            cout << "User data loaded from file: " << dataFile << endl;
+        }
+        else {
+            cout << "Unable to open file: " << dataFile << endl;
+        }
+    }
+
+    ////////////////////////////////////////////////////////////////////
+
+
+    void saveAllDataToFile() {
+        ofstream file(datafile);
+        if (file.is_open()) {
+            for (uint32_t id = 0; id < users.size(); id++) {
+                User* user = getUser(id);
+                if (!user) {
+                    continue;
+                }
+                file << "Username: " << user->getUsername() << endl;
+               
+                const FlatHashMap<string, Repository*>& repositories = user->getRepositories();
+                for (const auto& repoPair : repositories) {
+                    Repository* repo = repoPair.second;
+                    file << "Repository: " << repo->getName() << endl;
+
+                    // Save commits
+                    for (const Commit& commit : repo->getCommits()) {
+                        file << "Commit: " << commit.getMessage() << endl;
+                    }
+
+                    // Save files
+                    const File* files = repo->getFiles();
+                    for (int i = 0; i < repo->getFileCount(); i++) {
+                        file << "File: " << files[i].getName() << endl;
+                    }
+                }
+            }
+            file.close();
+            cout << "All user data saved to file: " << datafile << endl;
+        }
+        else {
+            cout << "Unable to open file for saving all user data." << endl;
+        }
+    }
+
+    // Records parsed from one slice of user_data.txt. The parsing thread
+    // builds the repositories and their files itself. Commits are only
+    // collected: the merge adds them to the shared commit graph, so the
+    // threads never contend on its lock, and then hands repositories to owners.
+    struct ParsedRepository {
+        Repository* repo;
+        vector<string_view> commits; // messages, oldest first, in the mapping
+    };
+
+    struct ParsedUser {
+        string_view username;
+        size_t line;
+        vector<ParsedRepository> repositories;
+    };
+
+    struct ParsedChunk {
+        vector<ParsedUser> users;
+        vector<pair<size_t, string>> problems; // chunk-relative line, message
+        size_t lineCount = 0;
+    };
+
+    static bool startsWith(string_view line, string_view tag) {
+        return line.substr(0, tag.size()) == tag;
+    }
+
+    // Parses [begin, end), which starts at a "Username: " line unless it is
+    // the first chunk. Commit messages and file names stay in the mapping.
+    static void parseUserDataChunk(const char* begin, const char* end, const shared_ptr<MappedFile>& mapping, ParsedChunk& chunk) {
+        ParsedRepository* currentRepo = nullptr;
+        const char* cursor = begin;
+        while (cursor < end) {
+            const char* newline = (const char*)memchr(cursor, '\n', end - cursor);
+            const char* lineEnd = newline ? newline : end;
+            string_view line(cursor, lineEnd - cursor);
+            if (!line.empty() && line.back() == '\r') {
+                line.remove_suffix(1);
+            }
+            cursor = newline ? newline + 1 : end;
+            size_t lineNumber = ++chunk.lineCount;
+
+            if (startsWith(line, "Username: ")) {
+                chunk.users.push_back(ParsedUser{ line.substr(10), lineNumber, {} });
+                currentRepo = nullptr;
+            }
+            else if (startsWith(line, "Repository: ")) {
+                if (chunk.users.empty()) {
+                    chunk.problems.push_back(make_pair(lineNumber, "repository before any username"));
+                    currentRepo = nullptr;
+                    continue;
+                }
+                chunk.users.back().repositories.push_back({ new Repository(string(line.substr(12)), false), {} });
+                currentRepo = &chunk.users.back().repositories.back();
+            }
+            else if (startsWith(line, "Commit: ") || startsWith(line, "File: ")) {
+                if (!currentRepo) {
+                    chunk.problems.push_back(make_pair(lineNumber, "commit or file before any repository"));
+                }
+                else if (line[0] == 'C') {
+                    currentRepo->commits.push_back(line.substr(8));
+                }
+                else {
+                    currentRepo->repo->addFile(line.substr(6), BlobId(), mapping); // the text format has no file contents
+                }
+            }
+            else if (!line.empty()) {
+                chunk.problems.push_back(make_pair(lineNumber, "unrecognised line"));
+            }
+        }
+    }
+
+    // Splits the file at "Username: " lines into one chunk per hardware
+    // thread, parses the chunks in parallel and then attaches the parsed
+    // repositories to their users in file order. Unknown users and
+    // malformed lines are reported and skipped.
+    void loadAllDataFromFile() {
+        shared_ptr<MappedFile> mapping = make_shared<MappedFile>();
+        if (!mapping->open(datafile)) {
+            cout << "Unable to open file for loading all user data." << endl;
+            return;
+        }
+        const char* base = mapping->data();
+        const char* end = base + mapping->size();
+
+        const size_t MIN_CHUNK_BYTES = 1 << 16;
+        size_t threadCount = max(1u, thread::hardware_concurrency());
+        threadCount = max((size_t)1, min(threadCount, mapping->size() / MIN_CHUNK_BYTES));
+
+        vector<const char*> starts(1, base);
+        for (size_t i = 1; i < threadCount; i++) {
+            const char* cursor = max(starts.back(), base + mapping->size() * i / threadCount);
+            while (cursor < end && cursor > base && cursor[-1] != '\n') {
+                cursor++;
+            }
+            while (cursor < end && !startsWith(string_view(cursor, end - cursor), "Username: ")) {
+                const char* newline = (const char*)memchr(cursor, '\n', end - cursor);
+                cursor = newline ? newline + 1 : end;
+            }
+            if (cursor > starts.back() && cursor < end) {
+                starts.push_back(cursor);
+            }
+        }
+        starts.push_back(end);
+
+        vector<ParsedChunk> chunks(starts.size() - 1);
+        vector<thread> workers;
+        for (size_t i = 0; i < chunks.size(); i++) {
+            workers.emplace_back(parseUserDataChunk, starts[i], starts[i + 1], cref(mapping), ref(chunks[i]));
+        }
+        for (thread& worker : workers) {
+            worker.join();
+        }
+
+        size_t lineOffset = 0;
+        size_t problemCount = 0;
+        for (ParsedChunk& chunk : chunks) {
+            for (const auto& problem : chunk.problems) {
+                cout << datafile << ":" << (lineOffset + problem.first) << ": " << problem.second << ", skipped" << endl;
+                problemCount++;
+            }
+            for (ParsedUser& parsed : chunk.users) {
+                User* user = getUser(parsed.username);
+                if (!user) {
+                    cout << datafile << ":" << (lineOffset + parsed.line) << ": unknown user '" << parsed.username << "', skipped "
+                        << parsed.repositories.size() << " repositories" << endl;
+                    problemCount++;
+                    for (ParsedRepository& repository : parsed.repositories) {
+                        delete repository.repo;
+                    }
+                    continue;
+                }
+                for (ParsedRepository& repository : parsed.repositories) {
+                    Repository* repo = repository.repo;
+                    if (!RepositoryCatalog::isValidName(repo->getName())) {
+                        cout << datafile << ": repository '" << repo->getName() << "' of user '" << parsed.username
+                            << "' has an invalid name, skipped" << endl;
+                        problemCount++;
+                        delete repo;
+                    }
+                    else if (catalog.find(repo->getName())) {
+                        cout << datafile << ": repository '" << repo->getName() << "' of user '" << parsed.username
+                            << "' is already taken, skipped" << endl;
+                        problemCount++;
+                        delete repo;
+                    }
+                    else {
+                        repo->setOwnerId(user->getId()); // before the history, which the owner is part of
+                        for (string_view message : repository.commits) {
+                            repo->addCommit(catalog.getCommitGraph(), message, StringInterner::NONE, 0, mapping); // the text format has no author, time or merges
+                        }
+                        catalog.add(user, repo);
+                    }
+                }
+            }
+            lineOffset += chunk.lineCount;
+        }
+
+        cout << "All user data loaded from file: " << datafile;
+        if (problemCount > 0) {
+            cout << " (" << problemCount << " problems reported)";
+        }
+        cout << endl;
+    }
+
+    ////////////////////////////////////////////////////////////////////
+
+
+    // journalSequence is the last journal record the saved state includes.
+    bool saveSnapshot(uint64_t journalSequence = 0) {
+        string strings;
+        vector<SnapshotUser> userRecords;
+        vector<SnapshotRepository> repositoryRecords;
+        vector<SnapshotCommit> commitRecords;
+        vector<uint32_t> recordNodes;                // graph node of each commit record
+        unordered_map<uint32_t, uint32_t> nodeRecords; // first record of each node
+        vector<SnapshotFile> fileRecords;
+        vector<SnapshotFollow> followRecords;
+
+        auto addString = [&strings](string_view text) {
+            SnapshotString ref = { strings.size(), (uint32_t)text.size(), 0 };
+            strings.append(text.data(), text.size());
+            return ref;
+        };
+
+        // Commit authors refer to user records, so number them all first.
+        vector<uint32_t> recordIndex(users.size(), StringInterner::NONE);
+        uint32_t recordCount = 0;
+        for (uint32_t id = 0; id < users.size(); id++) {
+            if (getUser(id)) {
+                recordIndex[id] = recordCount++;
+            }
+        }
+        for (uint32_t id = 0; id < users.size(); id++) {
+            User* user = getUser(id);
+            if (!user) {
+                continue;
+            }
+            SnapshotUser userRecord = { addString(user->getUsername()), addString(user->getPasswordHash()), (uint32_t)repositoryRecords.size(), 0, 0, 0 };
+            vector<Repository*> repositories;
+            for (const auto& repoPair : user->getRepositories()) {
+                repositories.push_back(repoPair.second);
+            }
+            userRecord.repositoryCount = (uint32_t)repositories.size();
+            for (const auto& repoPair : user->getForkedRepositories()) {
+                repositories.push_back(repoPair.second);
+            }
+            userRecord.forkedCount = (uint32_t)(repositories.size() - userRecord.repositoryCount);
+            for (Repository* repo : repositories) {
+                SnapshotRepository repoRecord = { addString(repo->getName()), repo->isRepositoryPublic() ? 1u : 0u, (uint32_t)repo->getForkCount(),
+                    (uint32_t)commitRecords.size(), (uint32_t)repo->getCommitCount(), (uint32_t)fileRecords.size(), (uint32_t)repo->getFileCount(),
+                    StringInterner::NONE, 0 };
+                // A fork whose upstream was deleted, even if the name was
+                // reused since, is saved as no longer having one.
+                Repository* upstream = repo->isFork() ? catalog.find(repo->getName()) : nullptr;
+                if (upstream && upstream->getSerial() == repo->getUpstreamSerial() && repo->getUpstreamOwner() < recordIndex.size()) {
+                    repoRecord.upstreamOwner = recordIndex[repo->getUpstreamOwner()];
+                }
+                for (const Commit& commit : repo->getCommits()) {
+                    uint32_t author = commit.getAuthor() < recordIndex.size() ? recordIndex[commit.getAuthor()] : StringInterner::NONE;
+                    nodeRecords.emplace(commit.getNode(), (uint32_t)commitRecords.size());
+                    recordNodes.push_back(commit.getNode());
+                    commitRecords.push_back({ addString(commit.getMessage()), author, 0, commit.getTimestamp(), 0, 0, { CommitGraph::NONE, CommitGraph::NONE } });
+                }
+                const File* files = repo->getFiles();
+                for (int i = 0; i < repo->getFileCount(); i++) {
+                    fileRecords.push_back({ addString(files[i].getName()), files[i].getContent().high, files[i].getContent().low });
+                }
+                repositoryRecords.push_back(repoRecord);
+            }
+            userRecords.push_back(userRecord);
+        }
+        // Parents point at the first record of each commit, so they are
+        // filled in once every listed commit has one.
+        const CommitGraph& graph = catalog.getCommitGraph();
+        for (size_t r = 0; r < recordNodes.size(); r++) {
+            CommitGraph::Node node = graph.get(recordNodes[r]);
+            commitRecords[r].idHigh = node.id.high;
+            commitRecords[r].idLow = node.id.low;
+            for (int p = 0; p < 2; p++) {
+                if (node.parents[p] == CommitGraph::NONE) {
+                    continue;
+                }
+                auto known = nodeRecords.emplace(node.parents[p], (uint32_t)commitRecords.size());
+                if (known.second) {
+                    recordNodes.push_back(node.parents[p]);
+                    commitRecords.push_back({ addString(""), StringInterner::NONE, 0, 0, 0, 0, { CommitGraph::NONE, CommitGraph::NONE } });
+                }
+                commitRecords[r].parents[p] = known.first->second;
+            }
+        }
+        for (uint32_t id = 0; id < users.size(); id++) {
+            User* user = getUser(id);
+            if (user) {
+                for (uint32_t followee : user->getFollowing()) {
+                    followRecords.push_back({ recordIndex[user->getId()], recordIndex[followee] });
+                }
+            }
+        }
+
+        const char* sectionData[SECTION_COUNT] = { strings.data(), (const char*)userRecords.data(), (const char*)repositoryRecords.data(),
+            (const char*)commitRecords.data(), (const char*)fileRecords.data(), (const char*)followRecords.data() };
+        uint64_t sectionSizes[SECTION_COUNT] = { strings.size(), userRecords.size() * sizeof(SnapshotUser), repositoryRecords.size() * sizeof(SnapshotRepository),
+            commitRecords.size() * sizeof(SnapshotCommit), fileRecords.size() * sizeof(SnapshotFile), followRecords.size() * sizeof(SnapshotFollow) };
+
+        SnapshotHeader header;
+        memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+        header.version = SNAPSHOT_VERSION;
+        header.byteOrder = SNAPSHOT_BYTE_ORDER;
+        header.journalSequence = journalSequence;
+        uint64_t offset = sizeof(SnapshotHeader);
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            offset = (offset + 7) & ~(uint64_t)7;
+            header.sectionOffsets[i] = offset;
+            header.sectionSizes[i] = sectionSizes[i];
+            offset += sectionSizes[i];
+        }
+
+        // Written beside the old snapshot and renamed over it, so a failed
+        // save never leaves a truncated snapshot behind.
+        string temporary = snapshotFile + ".tmp";
+        ofstream file(temporary, ios::binary | ios::trunc);
+        if (!file.is_open()) {
+            cout << "Unable to open file for saving snapshot: " << temporary << endl;
+            return false;
+        }
+        const char padding[8] = {};
+        file.write((const char*)&header, sizeof(header));
+        uint64_t written = sizeof(SnapshotHeader);
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            file.write(padding, header.sectionOffsets[i] - written);
+            file.write(sectionData[i], sectionSizes[i]);
+            written = header.sectionOffsets[i] + sectionSizes[i];
+        }
+        file.close();
+        if (!file) {
+            cout << "Unable to write snapshot: " << temporary << endl;
+            return false;
+        }
+        if (rename(temporary.c_str(), snapshotFile.c_str()) != 0) {
+            remove(snapshotFile.c_str());
+            if (rename(temporary.c_str(), snapshotFile.c_str()) != 0) {
+                cout << "Unable to replace snapshot: " << snapshotFile << endl;
+                return false;
+            }
+        }
+        cout << "All user data saved to snapshot: " << snapshotFile << endl;
+        return true;
+    }
+
+    // Returns false if there is no usable snapshot. Commit messages and file
+    // names are not copied: repositories refer into the mapping and keep it
+    // alive for as long as they need it.
+    bool loadSnapshot() {
+        shared_ptr<MappedFile> mapping = make_shared<MappedFile>();
+        if (!mapping->open(snapshotFile)) {
+            return false;
+        }
+        const char* base = mapping->data();
+        size_t size = mapping->size();
+
+        SnapshotHeader header;
+        if (size < sizeof(header)) {
+            cout << "Snapshot is truncated: " << snapshotFile << endl;
+            return false;
+        }
+        memcpy(&header, base, sizeof(header));
+        if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 || header.byteOrder != SNAPSHOT_BYTE_ORDER) {
+            cout << "Not a snapshot for this platform: " << snapshotFile << endl;
+            return false;
+        }
+        if (header.version < 2 || header.version > SNAPSHOT_VERSION) {
+            cout << "Unsupported snapshot version " << header.version << ": " << snapshotFile << endl;
+            return false;
+        }
+        for (int i = 0; i < SECTION_COUNT; i++) {
+            if (header.sectionOffsets[i] % 8 != 0 || header.sectionOffsets[i] > size || header.sectionSizes[i] > size - header.sectionOffsets[i]) {
+                cout << "Snapshot section " << i << " is out of bounds: " << snapshotFile << endl;
+                return false;
+            }
+        }
+
+        const char* strings = base + header.sectionOffsets[SECTION_STRINGS];
+        uint64_t stringsSize = header.sectionSizes[SECTION_STRINGS];
+        const SnapshotUser* userRecords = (const SnapshotUser*)(base + header.sectionOffsets[SECTION_USERS]);
+        size_t userCount = header.sectionSizes[SECTION_USERS] / sizeof(SnapshotUser);
+        // Before version 6 forks do not name their upstream; each is taken
+        // to be a fork of the repository with its name, if there is one.
+        bool forkUpstreams = header.version >= 6;
+        const char* repositoryRecords = base + header.sectionOffsets[SECTION_REPOSITORIES];
+        size_t repositoryStride = forkUpstreams ? sizeof(SnapshotRepository) : offsetof(SnapshotRepository, upstreamOwner);
+        size_t repositoryCount = header.sectionSizes[SECTION_REPOSITORIES] / repositoryStride;
+        // Version 2 commits are bare messages, and 3 and 4 have no ids or
+        // parents: their history is rebuilt from the order of the commits.
+        bool commitMetadata = header.version >= 3;
+        bool commitParents = header.version >= 5;
+        const char* commitRecords = base + header.sectionOffsets[SECTION_COMMITS];
+        size_t commitStride = commitParents ? sizeof(SnapshotCommit) : commitMetadata ? offsetof(SnapshotCommit, idHigh) : sizeof(SnapshotString);
+        size_t commitCount = header.sectionSizes[SECTION_COMMITS] / commitStride;
+        auto commitRecord = [&](size_t index) { return (const SnapshotCommit*)(commitRecords + index * commitStride); };
+        // Files before version 4 are bare names.
+        bool fileContents = header.version >= 4;
+        const char* fileRecords = base + header.sectionOffsets[SECTION_FILES];
+        size_t fileCount = header.sectionSizes[SECTION_FILES] / (fileContents ? sizeof(SnapshotFile) : sizeof(SnapshotString));
+        const SnapshotFollow* followRecords = (const SnapshotFollow*)(base + header.sectionOffsets[SECTION_FOLLOWS]);
+        size_t followCount = header.sectionSizes[SECTION_FOLLOWS] / sizeof(SnapshotFollow);
+
+        bool corrupt = false;
+        auto view = [&](const SnapshotString& ref) {
+            if (ref.offset > stringsSize || ref.length > stringsSize - ref.offset) {
+                corrupt = true;
+                return string_view();
+            }
+            return string_view(strings + ref.offset, ref.length);
+        };
+        auto inRange = [&corrupt](uint64_t first, uint64_t count, size_t limit) {
+            if (first > limit || count > limit - first) {
+                corrupt = true;
+                return false;
+            }
+            return true;
+        };
+
+        // Every commit's node, each made after its parents.
+        CommitGraph& graph = catalog.getCommitGraph();
+        vector<uint32_t> commitNodes(commitParents ? commitCount : 0, CommitGraph::NONE);
+        vector<uint32_t> pending;
+        for (size_t i = 0; i < commitNodes.size() && !corrupt; i++) {
+            pending.push_back((uint32_t)i);
+            while (!pending.empty() && !corrupt) {
+                const SnapshotCommit* commit = commitRecord(pending.back());
+                bool ready = true;
+                for (uint32_t parent : commit->parents) {
+                    if (parent != CommitGraph::NONE && (parent >= commitCount || pending.size() > commitCount)) {
+                        corrupt = true; // out of range, or a cycle
+                    }
+                    else if (parent != CommitGraph::NONE && commitNodes[parent] == CommitGraph::NONE) {
+                        pending.push_back(parent);
+                        ready = false;
+                    }
+                }
+                if (ready && !corrupt) {
+                    uint32_t r = pending.back();
+                    pending.pop_back();
+                    if (commitNodes[r] == CommitGraph::NONE) {
+                        uint32_t first = commit->parents[0] != CommitGraph::NONE ? commitNodes[commit->parents[0]] : CommitGraph::NONE;
+                        uint32_t second = commit->parents[1] != CommitGraph::NONE ? commitNodes[commit->parents[1]] : CommitGraph::NONE;
+                        commitNodes[r] = graph.insert(BlobId{ commit->idHigh, commit->idLow }, first, second);
+                    }
+                }
+            }
+        }
+
+        vector<uint32_t> userIds(userCount, StringInterner::NONE);
+        vector<pair<Repository*, uint32_t>> forks; // with the user record owning the upstream
+        for (size_t u = 0; u < userCount && !corrupt; u++) {
+            const SnapshotUser& userRecord = userRecords[u];
+            string username(view(userRecord.name));
+            string stored(view(userRecord.credential));
+            User* user = addUser(username, PasswordHasher::isCredential(stored) ? stored : PasswordHasher::hash(stored, hashIterations));
+            if (!user) {
+                cout << "Skipping duplicate user in snapshot: " << username << endl;
+                continue;
+            }
+            userIds[u] = user->getId();
+            if (!inRange(userRecord.firstRepository, (uint64_t)userRecord.repositoryCount + userRecord.forkedCount, repositoryCount)) {
+                break;
+            }
+            for (uint32_t r = 0; r < userRecord.repositoryCount + userRecord.forkedCount; r++) {
+                const SnapshotRepository& repoRecord = *(const SnapshotRepository*)(repositoryRecords + (userRecord.firstRepository + r) * repositoryStride);
+                if (!inRange(repoRecord.firstCommit, repoRecord.commitCount, commitCount) ||
+                    !inRange(repoRecord.firstFile, repoRecord.fileCount, fileCount)) {
+                    break;
+                }
+                Repository* repo = new Repository(string(view(repoRecord.name)), repoRecord.isPublic != 0);
+                repo->setForkCount((int)repoRecord.forkCount);
+                repo->setOwnerId(user->getId()); // before any rebuilt history, which the owner is part of
+                for (uint32_t c = 0; c < repoRecord.commitCount; c++) {
+                    size_t index = repoRecord.firstCommit + c;
+                    if (commitMetadata) {
+                        const SnapshotCommit& commit = *commitRecord(index);
+                        uint32_t author = commit.author < userCount ? usernames.intern(view(userRecords[commit.author].name)) : StringInterner::NONE;
+                        if (commitParents) {
+                            repo->restoreCommit(commitNodes[index], view(commit.message), author, commit.timestamp, mapping);
+                        }
+                        else {
+                            repo->addCommit(graph, view(commit.message), author, commit.timestamp, mapping);
+                        }
+                    }
+                    else {
+                        repo->addCommit(graph, view(((const SnapshotString*)commitRecords)[index]), StringInterner::NONE, 0, mapping);
+                    }
+                }
+                for (uint32_t f = 0; f < repoRecord.fileCount; f++) {
+                    size_t index = repoRecord.firstFile + f;
+                    if (fileContents) {
+                        const SnapshotFile& file = ((const SnapshotFile*)fileRecords)[index];
+                        repo->addFile(view(file.name), BlobId{ file.contentHigh, file.contentLow }, mapping);
+                    }
+                    else {
+                        repo->addFile(view(((const SnapshotString*)fileRecords)[index]), BlobId(), mapping);
+                    }
+                }
+                if (r < userRecord.repositoryCount) {
+                    if (!RepositoryCatalog::isValidName(repo->getName())) {
+                        cout << "Invalid repository name '" << repo->getName() << "' in snapshot, skipped" << endl;
+                        delete repo;
+                    }
+                    else if (!catalog.add(user, repo)) {
+                        cout << "Duplicate repository '" << repo->getName() << "' in snapshot, skipped" << endl;
+                        delete repo;
+                    }
+                }
+                else {
+                    user->addForkedRepository(repo);
+                    if (!forkUpstreams || repoRecord.upstreamOwner < userCount) {
+                        forks.push_back({ repo, forkUpstreams ? repoRecord.upstreamOwner : StringInterner::NONE });
+                    }
+                }
+            }
+        }
+        // The file changes recorded while loading only repeat the files, so
+        // they are dropped and each fork is compared with its upstream once.
+        for (Repository* repo : catalog.prefixScan("")) {
+            repo->clearFileChanges();
+        }
+        for (const auto& fork : forks) {
+            fork.first->clearFileChanges();
+            Repository* upstream = catalog.find(fork.first->getName());
+            if (upstream && (fork.second == StringInterner::NONE || upstream->getOwnerId() == userIds[fork.second])) {
+                fork.first->resetUpstream(*upstream);
+            }
+        }
+        for (size_t i = 0; i < followCount && !corrupt; i++) {
+            const SnapshotFollow& follow = followRecords[i];
+            if (follow.follower < userCount && follow.followee < userCount) {
+                socialGraph.followUser(userIds[follow.follower], userIds[follow.followee]);
+            }
+        }
+
+        snapshotJournalSequence = header.journalSequence;
+        if (corrupt) {
+            cout << "Snapshot is corrupt, stopped loading early: " << snapshotFile << endl;
+        }
+        else {
+            cout << "All user data loaded from snapshot: " << snapshotFile << endl;
+        }
+        return true;
+    }
+
+
+    // Journal records up to this sequence number are already in the loaded snapshot.
+    uint64_t getSnapshotJournalSequence() const { return snapshotJournalSequence; }
+
+};
+
+// One commit as it appears in feeds.
+struct Activity {
+    uint64_t sequence; // order the feed saw it in
+    uint32_t author;
+    int64_t timestamp;
+    string repository;
+    string message;
+};
+
+// "Recent activity from people I follow", built with hybrid fan-out. A
+// commit by an ordinary author is pushed onto a bounded timeline for each
+// of the author's followers, so reading a feed is mostly reading one
+// list. Authors with celebrityThreshold or more followers are not pushed:
+// they keep their recent commits on their own timeline and readers pull
+// those and merge them in, so one commit never costs a write per follower
+// of a huge account. An author stops being pulled again only below half
+// the threshold, so accounts near it do not flip back and forth.
+//
+// A follow shows the followee's commits from then on; an unfollow drops
+// theirs from the follower's timeline straight away.
+class FeedService {
+public:
+    static constexpr size_t TIMELINE_CAPACITY = 256;
+    static constexpr int DEFAULT_CELEBRITY_THRESHOLD = 10000;
+
+private:
+    // Newest TIMELINE_CAPACITY activities in sequence order. Grows up to
+    // capacity before it starts overwriting, so idle users cost little.
+    class Ring {
+    private:
+        vector<shared_ptr<const Activity>> items;
+        size_t oldest = 0; // once full, the slot to overwrite next
+
+        shared_ptr<const Activity>& slot(size_t position) { return items[(oldest + position) % items.size()]; }
+
+    public:
+        void push(shared_ptr<const Activity> activity) {
+            if (items.size() < TIMELINE_CAPACITY) {
+                items.push_back(move(activity));
+            }
+            else {
+                items[oldest] = move(activity);
+                oldest = (oldest + 1) % items.size();
+            }
+            // Concurrent publishers can arrive slightly out of order; the
+            // newest entry sinks to its place, almost always at once.
+            for (size_t position = items.size() - 1; position > 0 && slot(position - 1)->sequence > slot(position)->sequence; position--) {
+                swap(slot(position - 1), slot(position));
+            }
+        }
+
+        void removeAuthor(uint32_t author) {
+            vector<shared_ptr<const Activity>> kept;
+            for (size_t position = 0; position < items.size(); position++) {
+                if (slot(position)->author != author) {
+                    kept.push_back(move(slot(position)));
+                }
+            }
+            items = move(kept);
+            oldest = 0;
+        }
+
+        // Appends the newest count activities to out, newest first.
+        void copyNewest(size_t count, vector<shared_ptr<const Activity>>& out) {
+            for (size_t position = items.size(); position > 0 && count > 0; position--, count--) {
+                out.push_back(slot(position - 1));
+            }
+        }
+    };
+
+    struct Timeline {
+        mutex lock;
+        Ring inbox;  // pushed by the ordinary accounts this user follows
+        Ring outbox; // this user's own commits, for followers who pull
+    };
+
+    SocialGraph& graph;
+    PagedArray<atomic<Timeline*>> timelines; // by interned username, created on first use
+    atomic<uint64_t> nextSequence{ 0 };
+    atomic<int> celebrityThreshold{ DEFAULT_CELEBRITY_THRESHOLD };
+    mutable shared_mutex celebrityLock;
+    vector<uint32_t> celebrities; // authors whose followers pull, sorted
+
+    Timeline& timeline(uint32_t id) {
+        atomic<Timeline*>& slot = timelines.at(id);
+        Timeline* existing = slot.load(memory_order_acquire);
+        if (existing) {
+            return *existing;
+        }
+        Timeline* created = new Timeline();
+        if (!slot.compare_exchange_strong(existing, created, memory_order_acq_rel)) {
+            delete created;
+            return *existing;
+        }
+        return *created;
+    }
+
+    bool isCelebrity(uint32_t author) const {
+        shared_lock<shared_mutex> guard(celebrityLock);
+        return binary_search(celebrities.begin(), celebrities.end(), author);
+    }
+
+    void updateCelebrity(uint32_t author) {
+        int followers = graph.getFollowerCount(author);
+        int threshold = celebrityThreshold.load();
+        unique_lock<shared_mutex> guard(celebrityLock);
+        auto it = lower_bound(celebrities.begin(), celebrities.end(), author);
+        bool listed = it != celebrities.end() && *it == author;
+        if (!listed && followers >= threshold) {
+            celebrities.insert(it, author);
+        }
+        else if (listed && followers < threshold / 2) {
+            celebrities.erase(it);
+        }
+    }
+
+public:
+    FeedService(SocialGraph& socialGraph) : graph(socialGraph) {}
+
+    FeedService(const FeedService&) = delete;
+    FeedService& operator=(const FeedService&) = delete;
+
+    ~FeedService() {
+        for (size_t id = 0; id < timelines.size(); id++) {
+            const atomic<Timeline*>* slot = timelines.find(id);
+            if (slot) {
+                delete slot->load();
+            }
+        }
+    }
+
+    // Applies to follower counts reached from now on.
+    void setCelebrityThreshold(int followers) { celebrityThreshold = followers; }
+
+    // Re-reads the follower count of every id below idLimit, for graphs
+    // that were loaded rather than built through followed().
+    void recountFollowers(uint32_t idLimit) {
+        for (uint32_t id = 0; id < idLimit; id++) {
+            updateCelebrity(id);
+        }
+    }
+
+    void publish(uint32_t author, string_view repository, string_view message, int64_t timestamp) {
+        auto activity = make_shared<const Activity>(Activity{ nextSequence++, author, timestamp, string(repository), string(message) });
+        {
+            Timeline& own = timeline(author);
+            lock_guard<mutex> guard(own.lock);
+            own.outbox.push(activity);
+        }
+        if (isCelebrity(author)) {
+            return;
+        }
+        for (uint32_t follower : graph.getFollowers(author)) {
+            Timeline& target = timeline(follower);
+            lock_guard<mutex> guard(target.lock);
+            target.inbox.push(activity);
+        }
+    }
+
+    // Call these after the social graph has changed.
+    void followed(uint32_t followee) {
+        updateCelebrity(followee);
+    }
+
+    void unfollowed(uint32_t follower, uint32_t followee) {
+        updateCelebrity(followee);
+        Timeline& own = timeline(follower);
+        lock_guard<mutex> guard(own.lock);
+        own.inbox.removeAuthor(followee);
+    }
+
+    // The newest limit activities from the accounts reader follows, newest
+    // first: the reader's timeline k-way merged with the recent commits of
+    // each followed celebrity.
+    vector<shared_ptr<const Activity>> read(uint32_t reader, size_t limit) {
+        limit = min(limit, TIMELINE_CAPACITY);
+        vector<uint32_t> pulled;
+        {
+            shared_lock<shared_mutex> guard(celebrityLock);
+            pulled = graph.followedAmong(reader, celebrities);
+        }
+        vector<vector<shared_ptr<const Activity>>> streams(pulled.size() + 1);
+        {
+            Timeline& own = timeline(reader);
+            lock_guard<mutex> guard(own.lock);
+            own.inbox.copyNewest(limit, streams[0]);
+        }
+        for (size_t i = 0; i < pulled.size(); i++) {
+            Timeline& author = timeline(pulled[i]);
+            lock_guard<mutex> guard(author.lock);
+            author.outbox.copyNewest(limit, streams[i + 1]);
+        }
+        // A publisher that read the follower list just before an unfollow
+        // can still push afterwards, so pushed authors are checked again.
+        vector<uint32_t> pushedAuthors;
+        for (const shared_ptr<const Activity>& activity : streams[0]) {
+            pushedAuthors.push_back(activity->author);
+        }
+        sort(pushedAuthors.begin(), pushedAuthors.end());
+        pushedAuthors.erase(unique(pushedAuthors.begin(), pushedAuthors.end()), pushedAuthors.end());
+        vector<uint32_t> stillFollowed = graph.followedAmong(reader, pushedAuthors);
+        streams[0].erase(remove_if(streams[0].begin(), streams[0].end(), [&](const shared_ptr<const Activity>& activity) {
+            return !binary_search(stillFollowed.begin(), stillFollowed.end(), activity->author);
+        }), streams[0].end());
+
+        // Heap of (next sequence, stream); an activity pushed before its
+        // author became a celebrity can come from both sides, so equal
+        // sequences are taken once.
+        vector<pair<uint64_t, size_t>> heap;
+        vector<size_t> positions(streams.size(), 0);
+        for (size_t i = 0; i < streams.size(); i++) {
+            if (!streams[i].empty()) {
+                heap.push_back({ streams[i][0]->sequence, i });
+            }
+        }
+        make_heap(heap.begin(), heap.end());
+        vector<shared_ptr<const Activity>> feed;
+        while (!heap.empty() && feed.size() < limit) {
+            pop_heap(heap.begin(), heap.end());
+            size_t stream = heap.back().second;
+            heap.pop_back();
+            const shared_ptr<const Activity>& next = streams[stream][positions[stream]++];
+            if (feed.empty() || feed.back()->sequence != next->sequence) {
+                feed.push_back(next);
+            }
+            if (positions[stream] < streams[stream].size()) {
+                heap.push_back({ streams[stream][positions[stream]]->sequence, stream });
+                push_heap(heap.begin(), heap.end());
+            }
+        }
+        return feed;
+    }
+};
+
+// Outcome of a PlatformService operation. Front ends turn these into
+// their own messages; nothing below prints or touches the console.
+enum ServiceStatus {
+    STATUS_OK,
+    STATUS_MALFORMED,
+    STATUS_INVALID_CREDENTIALS,
+    STATUS_USER_EXISTS,
+    STATUS_USER_NOT_FOUND,
+    STATUS_CANNOT_FOLLOW_SELF,
+    STATUS_ALREADY_FOLLOWING,
+    STATUS_NOT_FOLLOWING,
+    STATUS_REPOSITORY_EXISTS,
+    STATUS_REPOSITORY_NOT_FOUND,
+    STATUS_NOT_OWNER,
+    STATUS_FILE_EXISTS,
+    STATUS_FILE_NOT_FOUND,
+    STATUS_INVALID_SESSION,
+    STATUS_STORAGE_ERROR,
+    STATUS_UP_TO_DATE,
+    STATUS_NO_UPSTREAM,
+    STATUS_INVALID_NAME,
+    STATUS_COUNT
+};
+
+const char* statusName(ServiceStatus status) {
+    static const char* names[] = { "ok", "malformed", "invalid credentials", "user exists", "user not found",
+        "cannot follow self", "already following", "not following", "repository exists", "repository not found",
+        "not owner", "file exists", "file not found", "invalid session", "storage error", "up to date",
+        "no upstream", "invalid name" };
+    return status < STATUS_COUNT ? names[status] : "unknown";
+}
+
+// Login is accepted by the batch protocol but changes nothing, so it sits
+// outside the range of journal operations. It answers with a session token
+// that later commands may give as "@<token>" in place of the username.
+const int COMMAND_LOGIN = 100;
+
+// Writing a file stores its content in the blob store and is journaled as
+// JOURNAL_ADD_FILE with the blob id, so it too sits outside the range.
+const int COMMAND_WRITE_FILE = 101; // username, repository, file, content
+
+// Every platform operation, independent of how it is driven. Successful
+// changes are appended to the journal, so the interactive menu, batch
+// files and journal replay all go through the same code.
+//
+// Operations may run on many threads at once. Locks are always taken in
+// this order, and each change is journaled before its locks are released
+// so the journal order matches the order the changes were applied in:
+//   stateLock  shared by every operation, exclusive while a snapshot is cut
+//   indexLock  the repository catalogue: shared to look up, exclusive to add or remove
+//   User lock  the user's repository maps, and the order of its follows;
+//              held as well while working on one of the user's forks
+//   Repository lock  commits, files, visibility and fork count; a merge
+//                    or a comparison with upstream holds two, taken
+//                    together by scoped_lock; a merge of two users'
+//                    forks likewise takes both user locks with lock()
+// The interner, the social graph, the commit graph and the blob store
+// lock themselves.
+class PlatformService {
+private:
+    static constexpr size_t JOURNAL_COMPACTION_RECORDS = 10000;
+
+    UserManager& userManager;
+    RepositoryCatalog& catalog;
+    SocialGraph& socialGraph;
+    Journal* journal;
+    BlobStore* blobs; // file contents; without one, files can only be added empty
+    bool recording;
+    FeedService feeds;
+    mutable mutex analyticsLock;
+    mutable shared_ptr<const GraphAnalytics> analytics;
+    mutable uint64_t analyticsVersion = 0;
+    mutable shared_mutex stateLock;
+    mutable shared_mutex indexLock;
+
+    void record(JournalOperation operation, initializer_list<string_view> fields) {
+        if (journal && recording) {
+            journal->append(operation, fields);
+        }
+    }
+
+    // A name the catalogue does not have may be "owner/name", for owner's
+    // fork of name. Returns the owner, or nullptr for any other name; call
+    // with indexLock held.
+    User* forkOwner(const string& repoName, string_view& forkName) const {
+        size_t slash = repoName.find('/');
+        if (slash == string::npos || catalog.find(repoName)) {
+            return nullptr;
+        }
+        forkName = string_view(repoName).substr(slash + 1);
+        return userManager.getUser(string_view(repoName).substr(0, slash));
+    }
+
+    // Call with owner locked.
+    static Repository* findFork(User* owner, string_view forkName) {
+        Repository* const* fork = owner->getForkedRepositories().find(forkName);
+        return fork ? *fork : nullptr;
+    }
+
+    // Runs change on the named repository with its lock held. Forks are
+    // named "owner/name" and run with their owner locked too. Given an
+    // actor, only the repository's owner may run it; replay skips the
+    // check, since the journal holds only changes that passed it.
+    ServiceStatus withRepository(const string& repoName, const function<ServiceStatus(Repository*)>& change,
+        User* actor = nullptr) {
+        shared_lock<shared_mutex> state(stateLock);
+        shared_lock<shared_mutex> index(indexLock);
+        string_view forkName;
+        User* owner = forkOwner(repoName, forkName);
+        unique_lock<mutex> ownerGuard;
+        Repository* repo = nullptr;
+        if (owner) {
+            ownerGuard = unique_lock<mutex>(owner->getLock());
+            repo = findFork(owner, forkName);
+        }
+        else {
+            repo = catalog.find(repoName);
+        }
+        if (!repo) {
+            return STATUS_REPOSITORY_NOT_FOUND;
+        }
+        lock_guard<mutex> guard(repo->getLock());
+        if (actor && recording && repo->getOwnerId() != actor->getId()) {
+            return STATUS_NOT_OWNER;
+        }
+        return change(repo);
+    }
+
+public:
+    PlatformService(UserManager& manager, RepositoryCatalog& repositories, SocialGraph& graph, Journal* operationJournal = nullptr, BlobStore* blobStore = nullptr)
+        : userManager(manager), catalog(repositories), socialGraph(graph), journal(operationJournal), blobs(blobStore), recording(true), feeds(graph) {}
+
+    User* findUser(string_view username) const { return userManager.getUser(username); }
+
+    // Only for checking that a name exists; use viewRepository to read one.
+    Repository* findRepository(const string& repoName) const {
+        shared_lock<shared_mutex> index(indexLock);
+        string_view forkName;
+        User* owner = forkOwner(repoName, forkName);
+        if (!owner) {
+            return catalog.find(repoName);
+        }
+        lock_guard<mutex> guard(owner->getLock());
+        return findFork(owner, forkName);
+    }
+
+    // Names of the repositories user owns, read from the owner's own index.
+    vector<string> listRepositories(User* user) const {
+        lock_guard<mutex> guard(user->getLock());
+        vector<string> names;
+        names.reserve(user->getRepositories().size());
+        for (const auto& owned : user->getRepositories()) {
+            names.push_back(owned.first);
+        }
+        sort(names.begin(), names.end());
+        return names;
+    }
+
+    // The count most forked public repositories, or with trending set,
+    // those forked most in recent days.
+    vector<TrendingIndex::Ranking> topRepositories(size_t count, bool trending) const {
+        return trending ? catalog.getRankings().trending(count) : catalog.getRankings().mostForked(count);
+    }
+
+    // Commits and files matching query that user (or nobody, if null) may
+    // see, newest first. See SearchIndex for the query syntax.
+    vector<SearchIndex::Hit> search(User* user, string_view query, size_t limit) const {
+        return catalog.getSearchIndex().search(query, user ? user->getId() : StringInterner::NONE, limit);
+    }
+
+    // Calls view with the repository locked against concurrent changes.
+    ServiceStatus viewRepository(const string& repoName, const function<void(const Repository&)>& view) {
+        return withRepository(repoName, [&view](Repository* repo) {
+            view(*repo);
+            return STATUS_OK;
+        });
+    }
+
+    ServiceStatus registerUser(const string& username, const string& password) {
+        shared_lock<shared_mutex> state(stateLock);
+        // Journaled before the user is visible, so no record about them can precede it.
+        bool registered = userManager.registerUser(username, password, [&](User* user) {
+            record(JOURNAL_REGISTER, { username, user->getPasswordHash() });
+        });
+        return registered ? STATUS_OK : STATUS_USER_EXISTS;
+    }
+
+    User* login(const string& username, const string& password) const {
+        return userManager.loginUser(username, password);
+    }
+
+    // Token for authenticate(), or an empty string if the login fails.
+    string startSession(const string& username, const string& password) {
+        return userManager.startSession(username, password);
+    }
+
+    // The session's user, or nullptr once the session expired or ended.
+    User* authenticate(string_view token) { return userManager.getSessionUser(token); }
+    void endSession(string_view token) { userManager.endSession(token); }
+
+    ServiceStatus follow(User* user, string_view followeeName) {
+        shared_lock<shared_mutex> state(stateLock);
+        User* followee = userManager.getUser(followeeName);
+        if (!followee) {
+            return STATUS_USER_NOT_FOUND;
+        }
+        if (followee == user) {
+            return STATUS_CANNOT_FOLLOW_SELF;
+        }
+        lock_guard<mutex> guard(user->getLock());
+        if (!user->follow(followee->getId())) {
+            return STATUS_ALREADY_FOLLOWING;
+        }
+        feeds.followed(followee->getId());
+        record(JOURNAL_FOLLOW, { user->getUsername(), followeeName });
+        return STATUS_OK;
+    }
+
+    ServiceStatus unfollow(User* user, string_view followeeName) {
+        shared_lock<shared_mutex> state(stateLock);
+        User* followee = userManager.getUser(followeeName);
+        if (!followee || !socialGraph.hasUser(followee->getId())) {
+            return STATUS_USER_NOT_FOUND;
+        }
+        lock_guard<mutex> guard(user->getLock());
+        if (!user->unfollow(followee->getId())) {
+            return STATUS_NOT_FOLLOWING;
+        }
+        feeds.unfollowed(user->getId(), followee->getId());
+        record(JOURNAL_UNFOLLOW, { user->getUsername(), followeeName });
+        return STATUS_OK;
+    }
+
+    ServiceStatus createRepository(User* user, const string& repoName, bool isPublic) {
+        if (!RepositoryCatalog::isValidName(repoName)) {
+            return STATUS_INVALID_NAME;
+        }
+        Repository* newRepo = new Repository(repoName, isPublic);
+        shared_lock<shared_mutex> state(stateLock);
+        unique_lock<shared_mutex> index(indexLock);
+        lock_guard<mutex> guard(user->getLock());
+        if (!catalog.add(user, newRepo)) {
+            delete newRepo;
+            return STATUS_REPOSITORY_EXISTS;
+        }
+        record(JOURNAL_CREATE_REPOSITORY, { user->getUsername(), repoName, isPublic ? "1" : "0" });
+        return STATUS_OK;
+    }
+
+    ServiceStatus deleteRepository(User* user, const string& repoName) {
+        shared_lock<shared_mutex> state(stateLock);
+        unique_lock<shared_mutex> index(indexLock);
+        lock_guard<mutex> guard(user->getLock());
+        if (!catalog.remove(user, repoName)) {
+            return catalog.find(repoName) ? STATUS_NOT_OWNER : STATUS_REPOSITORY_NOT_FOUND;
+        }
+        record(JOURNAL_DELETE_REPOSITORY, { user->getUsername(), repoName });
+        return STATUS_OK;
+    }
+
+    // A timestamp of 0 means now. Commits to public repositories reach
+    // the author's followers' feeds once the repository lock is released.
+    ServiceStatus addCommit(User* user, const string& repoName, string_view message, int64_t timestamp = 0) {
+        if (timestamp == 0) {
+            timestamp = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+        }
+        bool isPublic = false;
+        ServiceStatus status = withRepository(repoName, [&](Repository* repo) {
+            repo->addCommit(catalog.getCommitGraph(), message, user->getId(), timestamp);
+            catalog.committed(repo, message);
+            isPublic = repo->isRepositoryPublic();
+            record(JOURNAL_COMMIT, { user->getUsername(), repoName, message, to_string(timestamp) });
+            return STATUS_OK;
+        }, user);
+        if (status == STATUS_OK && isPublic && recording) {
+            feeds.publish(user->getId(), repoName, message, timestamp);
+        }
+        return status;
+    }
+
+    // Merges source's history into target with a commit whose parents are
+    // both heads. Either may be a fork, named "owner/name". Files only
+    // source has are added to target; files both have keep target's
+    // content. Only target's owner may merge. Nothing changes if
+    // target's history already contains source's head. filesAdded, if
+    // given, gets the count.
+    ServiceStatus mergeRepository(User* user, const string& targetName, const string& sourceName, string_view message,
+        int64_t timestamp = 0, int* filesAdded = nullptr) {
+        if (timestamp == 0) {
+            timestamp = chrono::duration_cast<chrono::seconds>(chrono::system_clock::now().time_since_epoch()).count();
+        }
+        bool isPublic = false;
+        {
+            shared_lock<shared_mutex> state(stateLock);
+            shared_lock<shared_mutex> index(indexLock);
+            string_view forkNames[2];
+            User* owners[2] = { forkOwner(targetName, forkNames[0]), forkOwner(sourceName, forkNames[1]) };
+            unique_lock<mutex> ownerGuards[2];
+            for (int i = 0; i < 2; i++) {
+                if (owners[i] && (i == 0 || owners[1] != owners[0])) {
+                    ownerGuards[i] = unique_lock<mutex>(owners[i]->getLock(), defer_lock);
+                }
+            }
+            if (ownerGuards[0].mutex() && ownerGuards[1].mutex()) {
+                lock(ownerGuards[0], ownerGuards[1]);
+            }
+            else if (ownerGuards[0].mutex() || ownerGuards[1].mutex()) {
+                (ownerGuards[0].mutex() ? ownerGuards[0] : ownerGuards[1]).lock();
+            }
+            Repository* target = owners[0] ? findFork(owners[0], forkNames[0]) : catalog.find(targetName);
+            Repository* source = owners[1] ? findFork(owners[1], forkNames[1]) : catalog.find(sourceName);
+            if (!target || !source) {
+                return STATUS_REPOSITORY_NOT_FOUND;
+            }
+            if (target == source) {
+                return STATUS_UP_TO_DATE;
+            }
+            scoped_lock guard(target->getLock(), source->getLock());
+            if (recording && target->getOwnerId() != user->getId()) {
+                return STATUS_NOT_OWNER;
+            }
+            CommitGraph& graph = catalog.getCommitGraph();
+            uint32_t sourceHead = source->getHead();
+            if (graph.isAncestor(sourceHead, target->getHead())) {
+                return STATUS_UP_TO_DATE;
+            }
+            int added = 0;
+            const File* files = source->getFiles();
+            for (int i = 0; i < source->getFileCount(); i++) {
+                if (target->addFile(files[i].getName(), files[i].getContent())) {
+                    catalog.fileAdded(target, files[i].getName());
+                    added++;
+                }
+            }
+            if (filesAdded) {
+                *filesAdded = added;
+            }
+            target->addCommit(graph, message, user->getId(), timestamp, nullptr, sourceHead);
+            catalog.committed(target, message);
+            isPublic = target->isRepositoryPublic();
+            record(JOURNAL_MERGE, { user->getUsername(), targetName, sourceName, message, to_string(timestamp) });
+        }
+        if (isPublic && recording) {
+            feeds.publish(user->getId(), targetName, message, timestamp);
+        }
+        return STATUS_OK;
+    }
+
+    // How the histories of two repositories relate.
+    struct HistoryComparison {
+        bool firstContainsSecond; // the first's history includes the second's head
+        bool secondContainsFirst;
+        vector<BlobId> mergeBases; // see CommitGraph::mergeBases
+    };
+
+    ServiceStatus compareHistories(const string& firstName, const string& secondName, HistoryComparison& comparison) {
+        uint32_t heads[2];
+        for (int i = 0; i < 2; i++) {
+            ServiceStatus status = withRepository(i == 0 ? firstName : secondName, [&](Repository* repo) {
+                heads[i] = repo->getHead();
+                return STATUS_OK;
+            });
+            if (status != STATUS_OK) {
+                return status;
+            }
+        }
+        const CommitGraph& graph = catalog.getCommitGraph();
+        comparison.firstContainsSecond = graph.isAncestor(heads[1], heads[0]);
+        comparison.secondContainsFirst = graph.isAncestor(heads[0], heads[1]);
+        comparison.mergeBases.clear();
+        for (uint32_t base : graph.mergeBases(heads[0], heads[1])) {
+            comparison.mergeBases.push_back(graph.get(base).id);
+        }
+        return STATUS_OK;
+    }
+
+    // One difference between a fork and its upstream.
+    struct ForkChange {
+        bool isFile;
+        bool inFork;      // only the fork has it, or for a modified file, the fork's side
+        bool modified;    // a file both have, with different content
+        BlobId id;        // the commit id, or the file's content
+        string_view text; // the commit message or file name; empty for a commit brought in only by a merge
+        uint32_t author;  // commits only
+        int64_t timestamp;
+    };
+
+    // Streams what the fork "owner/name" and its upstream do not share to
+    // emit, until it returns false: the commits each has that the other
+    // lacks, newest first, then the files either added, removed or
+    // changed. The cost follows the divergence rather than the size of the
+    // repositories. Both stay locked while emit runs, as does the commit
+    // graph while commits are streamed; the views last only for the call.
+    ServiceStatus compareWithUpstream(const string& forkName, const function<bool(const ForkChange&)>& emit) {
+        shared_lock<shared_mutex> state(stateLock);
+        shared_lock<shared_mutex> index(indexLock);
+        string_view name;
+        User* owner = forkOwner(forkName, name);
+        if (!owner) {
+            return STATUS_REPOSITORY_NOT_FOUND;
+        }
+        lock_guard<mutex> ownerGuard(owner->getLock());
+        Repository* fork = findFork(owner, name);
+        if (!fork) {
+            return STATUS_REPOSITORY_NOT_FOUND;
+        }
+        Repository* upstream = catalog.find(fork->getName());
+        if (!upstream || upstream->getSerial() != fork->getUpstreamSerial()) {
+            return STATUS_NO_UPSTREAM;
+        }
+        scoped_lock guard(fork->getLock(), upstream->getLock());
+
+        // Both logs follow first parents, as the difference does, so each
+        // side's commits are met in the order of a walk back from its head.
+        const CommitLog* logs[2] = { &fork->getCommits(), &upstream->getCommits() };
+        int cursors[2] = { logs[0]->size(), logs[1]->size() };
+        bool stopped = false;
+        catalog.getCommitGraph().difference(fork->getHead(), upstream->getHead(), [&](uint32_t node, const CommitGraph::Node& commit, bool inFork) {
+            ForkChange change = { false, inFork, false, commit.id, string_view(), StringInterner::NONE, 0 };
+            int& cursor = cursors[inFork ? 0 : 1];
+            const CommitLog& log = *logs[inFork ? 0 : 1];
+            if (cursor > 0 && log[cursor - 1].getNode() == node) {
+                cursor--;
+                change.text = log[cursor].getMessage();
+                change.author = log[cursor].getAuthor();
+                change.timestamp = log[cursor].getTimestamp();
+            }
+            stopped = !emit(change);
+            return !stopped;
+        });
+        if (stopped || fork->getFiles() == upstream->getFiles()) {
+            return STATUS_OK;
+        }
+
+        unordered_set<string_view> seen;
+        for (string_view fileName : fork->filesChangedSinceFork(*upstream)) {
+            if (!seen.insert(fileName).second) {
+                continue;
+            }
+            const File* mine = fork->getFile(fileName);
+            const File* theirs = upstream->getFile(fileName);
+            if ((!mine && !theirs) || (mine && theirs && mine->getContent() == theirs->getContent())) {
+                continue;
+            }
+            const File* file = mine ? mine : theirs;
+            ForkChange change = { true, mine != nullptr, mine && theirs, file->getContent(), file->getName(), StringInterner::NONE, 0 };
+            if (!emit(change)) {
+                break;
+            }
+        }
+        return STATUS_OK;
+    }
+
+    // Recent commits to public repositories by the accounts user follows, newest first.
+    vector<shared_ptr<const Activity>> readFeed(User* user, size_t limit) {
+        return feeds.read(user->getId(), limit);
+    }
+
+    void setCelebrityThreshold(int followers) { feeds.setCelebrityThreshold(followers); }
+
+    // Analytics over the follow graph as it is now. The snapshot is shared
+    // and only rebuilt once the graph has changed.
+    shared_ptr<const GraphAnalytics> graphAnalytics() const {
+        uint64_t version = socialGraph.getVersion();
+        lock_guard<mutex> guard(analyticsLock);
+        if (!analytics || analyticsVersion != version) {
+            analytics = make_shared<const GraphAnalytics>(socialGraph.snapshot());
+            analyticsVersion = version;
+        }
+        return analytics;
+    }
+
+    // Fewest follow hops from user to the named user, -1 if unreachable.
+    ServiceStatus separation(User* user, string_view otherName, int* hops) const {
+        User* other = userManager.getUser(otherName);
+        if (!other) {
+            return STATUS_USER_NOT_FOUND;
+        }
+        *hops = graphAnalytics()->separation(user->getId(), other->getId());
+        return STATUS_OK;
+    }
+
+    vector<GraphAnalytics::Ranked> suggestFollows(User* user, size_t count) const {
+        return graphAnalytics()->suggestions(user->getId(), count);
+    }
+
+    vector<GraphAnalytics::Ranked> topInfluencers(size_t count) const { return graphAnalytics()->topByPageRank(count); }
+    vector<GraphAnalytics::Ranked> topFollowed(size_t count) const { return graphAnalytics()->topByFollowers(count); }
+
+    // Refills every feed from the commits in the catalogue, for after a
+    // load. Each author's newest TIMELINE_CAPACITY commits are all any
+    // feed can show, so only those are published, oldest first.
+    void rebuildFeeds() {
+        feeds.recountFollowers(userManager.getIdLimit());
+        struct Published {
+            int64_t timestamp;
+            size_t order; // commits in the same second keep their history order
+            uint32_t author;
+            const Repository* repo;
+            string_view message;
+            bool operator<(const Published& other) const {
+                return timestamp != other.timestamp ? timestamp < other.timestamp : order < other.order;
+            }
+        };
+        auto newer = [](const Published& a, const Published& b) { return b < a; }; // keeps the oldest on top of each heap
+        size_t order = 0;
+        unordered_map<uint32_t, vector<Published>> newest; // per author
+        vector<Repository*> repositories = catalog.prefixScan("");
+        for (const Repository* repo : repositories) {
+            if (!repo->isRepositoryPublic()) {
+                continue;
+            }
+            for (const Commit& commit : repo->getCommits()) {
+                if (commit.getAuthor() == StringInterner::NONE) {
+                    continue;
+                }
+                vector<Published>& kept = newest[commit.getAuthor()];
+                kept.push_back({ commit.getTimestamp(), order++, commit.getAuthor(), repo, commit.getMessage() });
+                push_heap(kept.begin(), kept.end(), newer);
+                if (kept.size() > FeedService::TIMELINE_CAPACITY) {
+                    pop_heap(kept.begin(), kept.end(), newer);
+                    kept.pop_back();
+                }
+            }
+        }
+        vector<Published> all;
+        for (auto& pair : newest) {
+            all.insert(all.end(), pair.second.begin(), pair.second.end());
+        }
+        sort(all.begin(), all.end());
+        for (const Published& commit : all) {
+            feeds.publish(commit.author, commit.repo->getName(), commit.message, commit.timestamp);
+        }
+    }
+
+    // Adds a file whose content is already in the blob store, or an empty one.
+    ServiceStatus addFile(User* user, const string& repoName, string_view fileName, const BlobId& content = BlobId()) {
+        return withRepository(repoName, [&](Repository* repo) {
+            if (!repo->addFile(fileName, content)) {
+                return STATUS_FILE_EXISTS;
+            }
+            catalog.fileAdded(repo, fileName);
+            if (content.isNull()) {
+                record(JOURNAL_ADD_FILE, { user->getUsername(), repoName, fileName });
+            }
+            else {
+                record(JOURNAL_ADD_FILE, { user->getUsername(), repoName, fileName, content.toHex() });
+            }
+            return STATUS_OK;
+        }, user);
+    }
+
+    // Stores the content, before any lock is taken, and adds a file that
+    // refers to it. Content the store already holds is not written again.
+    ServiceStatus writeFile(User* user, const string& repoName, string_view fileName, string_view content) {
+        BlobId id;
+        if (!blobs || !blobs->put(content, id)) {
+            return STATUS_STORAGE_ERROR;
+        }
+        return addFile(user, repoName, fileName, id);
+    }
+
+    // Fills blob with the file's content. Files added without any read as empty.
+    ServiceStatus readFile(const string& repoName, string_view fileName, BlobStore::Blob& blob) {
+        BlobId id;
+        ServiceStatus status = withRepository(repoName, [&](Repository* repo) {
+            const File* file = repo->getFile(fileName);
+            if (!file) {
+                return STATUS_FILE_NOT_FOUND;
+            }
+            id = file->getContent();
+            return STATUS_OK;
+        });
+        if (status == STATUS_OK && !id.isNull() && (!blobs || !blobs->read(id, blob))) {
+            return STATUS_STORAGE_ERROR;
+        }
+        return status;
+    }
+
+    ServiceStatus deleteFile(User* user, const string& repoName, string_view fileName) {
+        return withRepository(repoName, [&](Repository* repo) {
+            if (!repo->deleteFile(fileName)) {
+                return STATUS_FILE_NOT_FOUND;
+            }
+            catalog.fileDeleted(repo, fileName);
+            record(JOURNAL_DELETE_FILE, { user->getUsername(), repoName, fileName });
+            return STATUS_OK;
+        }, user);
+    }
+
+    // The user lock is taken before the repository lock, as everywhere else.
+    ServiceStatus forkRepository(User* user, const string& repoName) {
+        shared_lock<shared_mutex> state(stateLock);
+        shared_lock<shared_mutex> index(indexLock);
+        Repository* repo = catalog.find(repoName);
+        if (!repo) {
+            return STATUS_REPOSITORY_NOT_FOUND;
+        }
+        lock_guard<mutex> userGuard(user->getLock());
+        lock_guard<mutex> repoGuard(repo->getLock());
+        if (!user->forkRepository(repo)) {
+            return STATUS_REPOSITORY_EXISTS;
+        }
+        catalog.forked(repo);
+        record(JOURNAL_FORK, { user->getUsername(), repoName });
+        return STATUS_OK;
+    }
+
+    ServiceStatus setVisibility(User* user, const string& repoName, bool isPublic) {
+        return withRepository(repoName, [&](Repository* repo) {
+            repo->setPublic(isPublic);
+            catalog.visibilityChanged(repo);
+            record(JOURNAL_SET_VISIBILITY, { user->getUsername(), repoName, isPublic ? "1" : "0" });
+            return STATUS_OK;
+        }, user);
+    }
+
+    // Runs one operation given in journal form: a journal operation (or
+    // COMMAND_LOGIN or COMMAND_WRITE_FILE) and its fields, the acting user
+    // first, either by name or as "@<session token>". A login puts its
+    // token in sessionToken. Untrusted callers, such as server clients,
+    // must name the user by session token.
+    ServiceStatus execute(int operation, const vector<string_view>& fields, string* sessionToken = nullptr,
+        bool trusted = true) {
+        static const size_t fieldCounts[] = { 0, 2, 3, 2, 3, 3, 3, 2, 2, 2, 3, 4 };
+        if (operation == COMMAND_LOGIN) {
+            if (fields.size() < 2) {
+                return STATUS_MALFORMED;
+            }
+            string token = startSession(string(fields[0]), string(fields[1]));
+            if (token.empty()) {
+                return STATUS_INVALID_CREDENTIALS;
+            }
+            if (sessionToken) {
+                *sessionToken = token;
+            }
+            return STATUS_OK;
+        }
+        if (operation == COMMAND_WRITE_FILE ? fields.size() < 4 :
+            operation < JOURNAL_REGISTER || operation > JOURNAL_MERGE || fields.size() < fieldCounts[operation]) {
+            return STATUS_MALFORMED;
+        }
+        if (operation == JOURNAL_REGISTER) {
+            return registerUser(string(fields[0]), string(fields[1]));
+        }
+
+        User* user = nullptr;
+        if (!fields[0].empty() && fields[0][0] == '@') {
+            user = authenticate(fields[0].substr(1));
+            if (!user) {
+                return STATUS_INVALID_SESSION;
+            }
+        }
+        else if (!trusted) {
+            return STATUS_INVALID_SESSION;
+        }
+        else {
+            user = userManager.getUser(fields[0]);
+            if (!user) {
+                return STATUS_USER_NOT_FOUND;
+            }
+        }
+        switch (operation) {
+        case JOURNAL_FOLLOW:
+            return follow(user, fields[1]);
+        case JOURNAL_UNFOLLOW:
+            return unfollow(user, fields[1]);
+        case JOURNAL_CREATE_REPOSITORY:
+            return createRepository(user, string(fields[1]), fields[2] == "1");
+        case JOURNAL_DELETE_REPOSITORY:
+            return deleteRepository(user, string(fields[1]));
+        case JOURNAL_COMMIT:
+            return addCommit(user, string(fields[1]), fields[2], fields.size() > 3 ? atoll(string(fields[3]).c_str()) : 0);
+        case JOURNAL_ADD_FILE: {
+            BlobId content;
+            if (fields.size() > 3 && !BlobId::fromHex(fields[3], content)) {
+                return STATUS_MALFORMED;
+            }
+            return addFile(user, string(fields[1]), fields[2], content);
+        }
+        case COMMAND_WRITE_FILE:
+            return writeFile(user, string(fields[1]), fields[2], fields[3]);
+        case JOURNAL_DELETE_FILE:
+            return deleteFile(user, string(fields[1]), fields[2]);
+        case JOURNAL_FORK:
+            return forkRepository(user, string(fields[1]));
+        case JOURNAL_SET_VISIBILITY:
+            return setVisibility(user, string(fields[1]), fields[2] == "1");
+        case JOURNAL_MERGE:
+            return mergeRepository(user, string(fields[1]), string(fields[2]), fields[3], fields.size() > 4 ? atoll(string(fields[4]).c_str()) : 0);
+        default:
+            return STATUS_MALFORMED;
+        }
+    }
+
+    // Re-applies journal records newer than the loaded snapshot without
+    // journaling them a second time. Registrations carry the credential,
+    // which is restored as is rather than hashed again.
+    size_t replayJournal() {
+        if (!journal) {
+            return 0;
+        }
+        recording = false;
+        size_t replayed = journal->replay(userManager.getSnapshotJournalSequence(), [this](JournalOperation operation, const vector<string_view>& fields) {
+            if (operation == JOURNAL_REGISTER && fields.size() >= 2) {
+                userManager.restoreUser(string(fields[0]), string(fields[1]));
+            }
+            else {
+                execute(operation, fields);
+            }
+        });
+        recording = true;
+        rebuildFeeds();
+        return replayed;
+    }
+
+    // Makes buffered journal records durable, along with the blobs they
+    // refer to, and folds the journal into a fresh snapshot once it has
+    // grown long.
+    void checkpoint() {
+        if (blobs) {
+            blobs->sync();
+        }
+        if (!journal) {
+            return;
+        }
+        journal->flush();
+        if (journal->getRecordCount() >= JOURNAL_COMPACTION_RECORDS) {
+            unique_lock<shared_mutex> state(stateLock);
+            if (journal->getRecordCount() >= JOURNAL_COMPACTION_RECORDS && userManager.saveSnapshot(journal->getLastSequence())) {
+                journal->truncate();
+            }
+        }
+    }
+};
+
+// Command stream for driving a PlatformService without the menu.
+//
+// Text form, one command per line, fields separated by spaces; the last
+// field takes the rest of the line, so commit messages may contain spaces.
+// Empty lines and lines starting with '#' are ignored.
+//   register <user> <password>        login <user> <password>
+//   follow <user> <followee>          unfollow <user> <followee>
+//   create <user> <repo> <1|0>        delete <user> <repo>
+//   commit <user> <repo> <message>    fork <user> <repo>
+//   add-file <user> <repo> <file>     delete-file <user> <repo> <file>
+//   write-file <user> <repo> <file> <content>
+//   merge <user> <repo> <source repo> <message>
+//   visibility <user> <repo> <1|0>
+// The acting <user> may also be given as @<token>, a session token
+// returned by login.
+//
+// Binary form, a sequence of records, each
+//   uint32 payload length | payload
+// with the payload laid out exactly as in the journal: operation byte,
+// field count byte, then each field as uint32 length + bytes.
+struct BatchCommandName {
+    const char* name;
+    int operation;
+    size_t fieldCount;
+};
+
+const BatchCommandName batchCommandNames[] = {
+    { "register", JOURNAL_REGISTER, 2 },
+    { "login", COMMAND_LOGIN, 2 },
+    { "follow", JOURNAL_FOLLOW, 2 },
+    { "unfollow", JOURNAL_UNFOLLOW, 2 },
+    { "create", JOURNAL_CREATE_REPOSITORY, 3 },
+    { "delete", JOURNAL_DELETE_REPOSITORY, 2 },
+    { "commit", JOURNAL_COMMIT, 3 },
+    { "add-file", JOURNAL_ADD_FILE, 3 },
+    { "write-file", COMMAND_WRITE_FILE, 4 },
+    { "delete-file", JOURNAL_DELETE_FILE, 3 },
+    { "fork", JOURNAL_FORK, 2 },
+    { "visibility", JOURNAL_SET_VISIBILITY, 3 },
+    { "merge", JOURNAL_MERGE, 4 },
+};
+
+// Splits one text command into its operation and fields. The views point
+// into line. Returns false for unknown commands or missing fields.
+bool parseBatchLine(string_view line, int& operation, vector<string_view>& fields) {
+    auto nextToken = [&line]() {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string_view::npos) {
+            line = string_view();
+            return string_view();
+        }
+        line.remove_prefix(start);
+        size_t end = line.find_first_of(" \t");
+        string_view token = line.substr(0, end);
+        line.remove_prefix(end == string_view::npos ? line.size() : end);
+        return token;
+    };
+
+    string_view command = nextToken();
+    for (const BatchCommandName& entry : batchCommandNames) {
+        if (command != entry.name) {
+            continue;
+        }
+        operation = entry.operation;
+        fields.clear();
+        for (size_t i = 0; i + 1 < entry.fieldCount; i++) {
+            string_view token = nextToken();
+            if (token.empty()) {
+                return false;
+            }
+            fields.push_back(token);
+        }
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string_view::npos) {
+            return false;
+        }
+        line.remove_prefix(start);
+        fields.push_back(line);
+        return true;
+    }
+    return false;
+}
+
+// Decodes one binary batch payload. The views point into data.
+bool parseBatchRecord(const char* data, size_t length, int& operation, vector<string_view>& fields) {
+    if (length < 2) {
+        return false;
+    }
+    operation = (unsigned char)data[0];
+    int fieldCount = (unsigned char)data[1];
+    fields.clear();
+    size_t offset = 2;
+    for (int i = 0; i < fieldCount; i++) {
+        if (length - offset < 4) {
+            return false;
+        }
+        uint32_t fieldLength = 0;
+        for (int b = 0; b < 4; b++) {
+            fieldLength |= (uint32_t)(unsigned char)data[offset + b] << (8 * b);
+        }
+        if (fieldLength > length - offset - 4) {
+            return false;
+        }
+        fields.push_back(string_view(data + offset + 4, fieldLength));
+        offset += 4 + fieldLength;
+    }
+    return true;
+}
+
+// Executes every command in a batch stream and prints a summary with the
+// count per outcome. Malformed commands are reported with their position.
+void runBatch(istream& input, bool binary, PlatformService& service) {
+    const size_t CHECKPOINT_INTERVAL = 10000;
+    const int MAX_REPORTED_ERRORS = 20;
+    size_t statusCounts[STATUS_COUNT] = {};
+    size_t commands = 0;
+    int reportedErrors = 0;
+    int operation = 0;
+    vector<string_view> fields;
+    string buffer;
+    auto start = chrono::steady_clock::now();
+
+    auto run = [&](bool parsed, size_t position) {
+        ServiceStatus status = parsed ? service.execute(operation, fields) : STATUS_MALFORMED;
+        statusCounts[status]++;
+        if (status == STATUS_MALFORMED && reportedErrors++ < MAX_REPORTED_ERRORS) {
+            cout << "Malformed command at " << (binary ? "record " : "line ") << position << endl;
+        }
+        if (++commands % CHECKPOINT_INTERVAL == 0) {
+            service.checkpoint();
+        }
+    };
+
+    if (binary) {
+        size_t record = 0;
+        char header[4];
+        while (input.read(header, 4)) {
+            uint32_t length = 0;
+            for (int b = 0; b < 4; b++) {
+                length |= (uint32_t)(unsigned char)header[b] << (8 * b);
+            }
+            buffer.resize(length);
+            if (!input.read(&buffer[0], length)) {
+                cout << "Batch input ends inside record " << (record + 1) << endl;
+                break;
+            }
+            run(parseBatchRecord(buffer.data(), buffer.size(), operation, fields), ++record);
+        }
+    }
+    else {
+        size_t lineNumber = 0;
+        while (getline(input, buffer)) {
+            lineNumber++;
+            if (!buffer.empty() && buffer.back() == '\r') {
+                buffer.pop_back();
+            }
+            size_t first = buffer.find_first_not_of(" \t");
+            if (first == string::npos || buffer[first] == '#') {
+                continue;
+            }
+            run(parseBatchLine(buffer, operation, fields), lineNumber);
+        }
+    }
+    service.checkpoint();
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    cout << "Batch: " << commands << " commands in " << seconds << " s";
+    if (seconds > 0) {
+        cout << " (" << (size_t)(commands / seconds) << " per second)";
+    }
+    cout << "\n";
+    for (int status = 0; status < STATUS_COUNT; status++) {
+        if (statusCounts[status] > 0) {
+            cout << "  " << statusName((ServiceStatus)status) << ": " << statusCounts[status] << "\n";
+        }
+    }
+}
+
+// Converts a text batch into the binary form, which skips tokenizing when
+// the same load is replayed many times.
+bool encodeBatch(istream& input, ostream& output) {
+    string line;
+    string record;
+    int operation = 0;
+    vector<string_view> fields;
+    size_t lineNumber = 0;
+    bool clean = true;
+    auto appendInt = [&record](uint32_t value) {
+        for (int b = 0; b < 4; b++) {
+            record.push_back((char)(value >> (8 * b)));
+        }
+    };
+    while (getline(input, line)) {
+        lineNumber++;
+        if (!line.empty() && line.back() == '\r') {
+            line.pop_back();
+        }
+        size_t first = line.find_first_not_of(" \t");
+        if (first == string::npos || line[first] == '#') {
+            continue;
+        }
+        if (!parseBatchLine(line, operation, fields)) {
+            cout << "Skipping malformed command at line " << lineNumber << endl;
+            clean = false;
+            continue;
+        }
+        record.clear();
+        appendInt(0); // payload length, patched below
+        record.push_back((char)operation);
+        record.push_back((char)fields.size());
+        for (string_view field : fields) {
+            appendInt((uint32_t)field.size());
+            record.append(field.data(), field.size());
+        }
+        uint32_t payloadLength = (uint32_t)(record.size() - 4);
+        for (int b = 0; b < 4; b++) {
+            record[b] = (char)(payloadLength >> (8 * b));
+        }
+        output.write(record.data(), record.size());
+    }
+    return clean && (bool)output;
+}
+
+#ifndef _WIN32
+volatile sig_atomic_t serverStopRequested = 0;
+
+void requestServerStop(int) {
+    serverStopRequested = 1;
+}
+
+// Serves the batch text protocol to many clients over a Unix domain
+// socket. Each request is one command line; each reply is one line, "OK"
+// ("OK <token>" for a login) or "ERR <reason>", sent in request order.
+// Apart from register and login, commands must name the user as
+// "@<session token>". Clients may pipeline: every complete line that has
+// arrived is queued on the connection at once.
+//
+// One thread runs an epoll loop that accepts, reads and writes. The
+// commands themselves run on a pool of workers. A connection is handed to
+// at most one worker at a time, so its commands execute in the order they
+// were sent, while different connections run in parallel.
+class PlatformServer {
+private:
+    struct Connection {
+        int fd;
+        string input;          // event loop only: bytes after the last complete line
+        mutex lock;            // guards the fields below
+        string queued;         // complete lines waiting for a worker
+        string output;         // replies waiting to be written
+        bool busy = false;       // a worker owns the queued lines
+        bool peerClosed = false; // the client will send nothing more
+        bool failed = false;     // the socket broke; drop everything
+        bool detached = false;   // removed from epoll after a hangup
+        uint32_t interest = EPOLLIN;
+
+        Connection(int socket) : fd(socket) {}
+    };
+
+    PlatformService& service;
+    string socketPath;
+    int workerCount;
+    int listenFd;
+    int epollFd;
+    int wakeFd; // eventfd the workers use to hand finished connections back
+    unordered_map<int, shared_ptr<Connection>> connections;
+
+    mutex queueLock;
+    condition_variable queueReady;
+    vector<shared_ptr<Connection>> workQueue;
+    bool stopping;
+
+    mutex finishedLock;
+    vector<shared_ptr<Connection>> finished;
+
+    static bool setNonBlocking(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+    }
+
+    void schedule(const shared_ptr<Connection>& connection) {
+        {
+            lock_guard<mutex> guard(queueLock);
+            workQueue.push_back(connection);
+        }
+        queueReady.notify_one();
+    }
+
+    void workerLoop() {
+        int operation = 0;
+        vector<string_view> fields;
+        string commands;
+        string replies;
+        string token;
+        while (true) {
+            shared_ptr<Connection> connection;
+            {
+                unique_lock<mutex> guard(queueLock);
+                queueReady.wait(guard, [this] { return stopping || !workQueue.empty(); });
+                if (workQueue.empty()) {
+                    return;
+                }
+                connection = workQueue.back();
+                workQueue.pop_back();
+            }
+
+            while (true) {
+                {
+                    lock_guard<mutex> guard(connection->lock);
+                    if (connection->queued.empty() || connection->failed) {
+                        connection->queued.clear();
+                        connection->busy = false;
+                        break;
+                    }
+                    commands.swap(connection->queued);
+                }
+                replies.clear();
+                size_t start = 0;
+                while (start < commands.size()) {
+                    size_t end = commands.find('\n', start);
+                    string_view line(commands.data() + start, end - start);
+                    start = end + 1;
+                    if (!line.empty() && line.back() == '\r') {
+                        line.remove_suffix(1);
+                    }
+                    token.clear();
+                    ServiceStatus status = parseBatchLine(line, operation, fields) ? service.execute(operation, fields, &token, false) : STATUS_MALFORMED;
+                    if (status == STATUS_OK) {
+                        replies += token.empty() ? "OK\n" : "OK " + token + "\n";
+                    }
+                    else {
+                        replies += "ERR ";
+                        replies += statusName(status);
+                        replies += "\n";
+                    }
+                }
+                commands.clear();
+                lock_guard<mutex> guard(connection->lock);
+                connection->output += replies;
+            }
+
+            {
+                lock_guard<mutex> guard(finishedLock);
+                finished.push_back(connection);
+            }
+            uint64_t one = 1;
+            if (::write(wakeFd, &one, sizeof(one)) < 0) {
+                // The loop also polls on a timer, so a lost wakeup only delays the reply.
+            }
+        }
+    }
+
+    // Polls for input until the client stops sending, and for output while
+    // replies are backed up. The caller holds the connection lock.
+    void updateInterest(Connection& connection) {
+        if (connection.detached) {
+            return;
+        }
+        uint32_t interest = (connection.peerClosed || connection.failed ? 0 : (uint32_t)EPOLLIN) |
+            (!connection.output.empty() && !connection.failed ? (uint32_t)EPOLLOUT : 0);
+        if (interest != connection.interest) {
+            epoll_event event = {};
+            event.events = interest;
+            event.data.fd = connection.fd;
+            epoll_ctl(epollFd, EPOLL_CTL_MOD, connection.fd, &event);
+            connection.interest = interest;
+        }
+    }
+
+    // Finished once the socket broke, or once the client hung up and every
+    // command it sent has been answered.
+    static bool isFinished(const Connection& connection) {
+        return !connection.busy && (connection.failed || (connection.peerClosed && connection.queued.empty() && connection.output.empty()));
+    }
+
+    void closeConnection(const shared_ptr<Connection>& connection) {
+        if (!connection->detached) {
+            epoll_ctl(epollFd, EPOLL_CTL_DEL, connection->fd, nullptr);
+        }
+        ::close(connection->fd);
+        connections.erase(connection->fd);
+    }
+
+    // Writes as much pending output as the socket takes.
+    void flushConnection(const shared_ptr<Connection>& connection) {
+        lock_guard<mutex> guard(connection->lock);
+        while (!connection->output.empty() && !connection->failed) {
+            ssize_t written = ::send(connection->fd, connection->output.data(), connection->output.size(), MSG_NOSIGNAL);
+            if (written > 0) {
+                connection->output.erase(0, (size_t)written);
+            }
+            else if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            else {
+                connection->failed = true;
+            }
+        }
+        updateInterest(*connection);
+    }
+
+    void acceptConnections() {
+        while (true) {
+            int fd = ::accept(listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                return;
+            }
+            setNonBlocking(fd);
+            epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+            connections[fd] = make_shared<Connection>(fd);
+        }
+    }
+
+    void readConnection(const shared_ptr<Connection>& connection) {
+        char buffer[16384];
+        bool hungUp = false;
+        bool broken = false;
+        while (true) {
+            ssize_t received = ::recv(connection->fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                connection->input.append(buffer, (size_t)received);
+            }
+            else if (received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                break;
+            }
+            else {
+                hungUp = true;
+                broken = received < 0;
+                break;
+            }
+        }
+
+        // Commands that arrived before a half-close still run, and their
+        // replies are written before the connection goes away.
+        size_t lastNewline = connection->input.rfind('\n');
+        bool startWorker = false;
+        {
+            lock_guard<mutex> guard(connection->lock);
+            if (lastNewline != string::npos) {
+                connection->queued.append(connection->input, 0, lastNewline + 1);
+                connection->input.erase(0, lastNewline + 1);
+                if (!connection->busy) {
+                    connection->busy = true;
+                    startWorker = true;
+                }
+            }
+            connection->peerClosed = connection->peerClosed || hungUp;
+            connection->failed = connection->failed || broken;
+            updateInterest(*connection);
+        }
+        if (startWorker) {
+            schedule(connection);
+        }
+    }
+
+public:
+    PlatformServer(PlatformService& platform, const string& path, int workers)
+        : service(platform), socketPath(path), workerCount(max(1, workers)), listenFd(-1), epollFd(-1), wakeFd(-1), stopping(false) {}
+
+    PlatformServer(const PlatformServer&) = delete;
+    PlatformServer& operator=(const PlatformServer&) = delete;
+
+    // Serves until SIGINT or SIGTERM. Returns false if the socket could not be set up.
+    bool run() {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        if (socketPath.size() >= sizeof(address.sun_path)) {
+            cout << "Socket path is too long: " << socketPath << endl;
+            return false;
+        }
+        strcpy(address.sun_path, socketPath.c_str());
+        ::unlink(socketPath.c_str());
+        listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listenFd < 0 || ::bind(listenFd, (sockaddr*)&address, sizeof(address)) != 0 || ::listen(listenFd, SOMAXCONN) != 0) {
+            cout << "Unable to listen on socket: " << socketPath << endl;
+            if (listenFd >= 0) {
+                ::close(listenFd);
+            }
+            return false;
+        }
+        setNonBlocking(listenFd);
+        epollFd = epoll_create1(0);
+        wakeFd = eventfd(0, EFD_NONBLOCK);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+        event.data.fd = wakeFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event);
+
+        signal(SIGINT, requestServerStop);
+        signal(SIGTERM, requestServerStop);
+        signal(SIGPIPE, SIG_IGN);
+
+        vector<thread> workers;
+        for (int i = 0; i < workerCount; i++) {
+            workers.emplace_back(&PlatformServer::workerLoop, this);
+        }
+        cout << "Serving on " << socketPath << " with " << workerCount << " workers\n";
+
+        // The timeout bounds how long journal records wait for a group commit.
+        const int CHECKPOINT_INTERVAL_MS = 50;
+        epoll_event events[256];
+        while (!serverStopRequested) {
+            int count = epoll_wait(epollFd, events, 256, CHECKPOINT_INTERVAL_MS);
+            for (int i = 0; i < count; i++) {
+                int fd = events[i].data.fd;
+                if (fd == listenFd) {
+                    acceptConnections();
+                    continue;
+                }
+                if (fd == wakeFd) {
+                    uint64_t ignored;
+                    while (::read(wakeFd, &ignored, sizeof(ignored)) > 0) {
+                    }
+                    vector<shared_ptr<Connection>> done;
+                    {
+                        lock_guard<mutex> guard(finishedLock);
+                        done.swap(finished);
+                    }
+                    for (const shared_ptr<Connection>& connection : done) {
+                        if (connections.count(connection->fd) && connections[connection->fd] == connection) {
+                            flushConnection(connection);
+                        }
+                    }
+                    continue;
+                }
+                auto it = connections.find(fd);
+                if (it == connections.end()) {
+                    continue;
+                }
+                shared_ptr<Connection> connection = it->second;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR) && connection->interest & EPOLLIN) {
+                    readConnection(connection);
+                }
+                if (events[i].events & EPOLLOUT) {
+                    flushConnection(connection);
+                }
+                // A hangup keeps being reported while a worker finishes the
+                // connection's last commands, so stop polling it.
+                if (events[i].events & (EPOLLHUP | EPOLLERR)) {
+                    lock_guard<mutex> guard(connection->lock);
+                    connection->peerClosed = true;
+                    if (!connection->detached) {
+                        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+                        connection->detached = true;
+                    }
+                }
+            }
+
+            vector<shared_ptr<Connection>> closable;
+            for (const auto& entry : connections) {
+                lock_guard<mutex> guard(entry.second->lock);
+                if (isFinished(*entry.second)) {
+                    closable.push_back(entry.second);
+                }
+            }
+            for (const shared_ptr<Connection>& connection : closable) {
+                closeConnection(connection);
+            }
+            service.checkpoint();
+        }
+
+        {
+            lock_guard<mutex> guard(queueLock);
+            stopping = true;
+        }
+        queueReady.notify_all();
+        for (thread& worker : workers) {
+            worker.join();
+        }
+        vector<shared_ptr<Connection>> remaining;
+        for (const auto& entry : connections) {
+            remaining.push_back(entry.second);
+        }
+        for (const shared_ptr<Connection>& connection : remaining) {
+            closeConnection(connection);
+        }
+        service.checkpoint();
+        ::close(wakeFd);
+        ::close(epollFd);
+        ::close(listenFd);
+        ::unlink(socketPath.c_str());
+        cout << "Server stopped.\n";
+        return true;
+    }
+};
+
+// Opens clientCount connections to a running server and has each send
+// requestsPerClient commands, keeping up to pipelineDepth of them in
+// flight. Each client first registers, logs in and creates a repository,
+// untimed; the timed commands then act through the session token. Prints
+// throughput and request latency percentiles.
+bool runLoadGenerator(const string& socketPath, int clientCount, int requestsPerClient, int pipelineDepth) {
+    pipelineDepth = max(1, pipelineDepth);
+    vector<vector<double>> latencies(clientCount);
+    atomic<int> failedClients(0);
+    atomic<long long> errorReplies(0);
+    atomic<int> clientsReady(0);
+    atomic<bool> go(false);
+
+    auto client = [&](int clientIndex) {
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        strncpy(address.sun_path, socketPath.c_str(), sizeof(address.sun_path) - 1);
+        string incoming;
+        char buffer[16384];
+        auto exchange = [&](const string& command, string& reply) {
+            if (::send(fd, command.data(), command.size(), MSG_NOSIGNAL) != (ssize_t)command.size()) {
+                return false;
+            }
+            size_t end;
+            while ((end = incoming.find('\n')) == string::npos) {
+                ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+                if (received <= 0) {
+                    return false;
+                }
+                incoming.append(buffer, (size_t)received);
+            }
+            reply = incoming.substr(0, end);
+            incoming.erase(0, end + 1);
+            return true;
+        };
+
+        string user = "load" + to_string(clientIndex);
+        string repo = user + "-bench";
+        string reply;
+        bool connected = fd >= 0 && ::connect(fd, (sockaddr*)&address, sizeof(address)) == 0 &&
+            exchange("register " + user + " secret\n", reply) && exchange("login " + user + " secret\n", reply) && reply.compare(0, 3, "OK ") == 0;
+        string actor = connected ? "@" + reply.substr(3) : string();
+        connected = connected && exchange("create " + actor + " " + repo + " 1\n", reply);
+        clientsReady++;
+        if (!connected) {
+            failedClients++;
+            if (fd >= 0) {
+                ::close(fd);
+            }
+            return;
+        }
+        while (!go) {
+            this_thread::yield();
+        }
+
+        mt19937 random(clientIndex);
+        auto makeCommand = [&](int n) {
+            int choice = random() % 100;
+            if (choice < 65) {
+                return "commit " + actor + " " + repo + " change " + to_string(n) + "\n";
+            }
+            if (choice < 90) {
+                return "add-file " + actor + " " + repo + " src/file" + to_string(n) + ".cpp\n";
+            }
+            return "follow " + actor + " load" + to_string(random() % clientCount) + "\n";
+        };
+
+        vector<chrono::steady_clock::time_point> sentAt(requestsPerClient);
+        vector<double>& samples = latencies[clientIndex];
+        samples.reserve(requestsPerClient);
+        string outgoing;
+        int sent = 0;
+        int answered = 0;
+        while (answered < requestsPerClient) {
+            outgoing.clear();
+            auto now = chrono::steady_clock::now();
+            while (sent < requestsPerClient && sent - answered < pipelineDepth) {
+                outgoing += makeCommand(sent);
+                sentAt[sent++] = now;
+            }
+            size_t offset = 0;
+            while (offset < outgoing.size()) {
+                ssize_t written = ::send(fd, outgoing.data() + offset, outgoing.size() - offset, MSG_NOSIGNAL);
+                if (written <= 0) {
+                    failedClients++;
+                    ::close(fd);
+                    return;
+                }
+                offset += (size_t)written;
+            }
+            ssize_t received = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (received <= 0) {
+                failedClients++;
+                ::close(fd);
+                return;
+            }
+            incoming.append(buffer, (size_t)received);
+            now = chrono::steady_clock::now();
+            size_t start = 0;
+            size_t end;
+            while ((end = incoming.find('\n', start)) != string::npos) {
+                if (incoming.compare(start, 3, "ERR") == 0) {
+                    errorReplies++;
+                }
+                samples.push_back(chrono::duration<double, micro>(now - sentAt[answered++]).count());
+                start = end + 1;
+            }
+            incoming.erase(0, start);
+        }
+        ::close(fd);
+    };
+
+    vector<thread> clients;
+    for (int i = 0; i < clientCount; i++) {
+        clients.emplace_back(client, i);
+    }
+    while (clientsReady < clientCount) {
+        this_thread::sleep_for(chrono::milliseconds(1));
+    }
+    auto start = chrono::steady_clock::now();
+    go = true;
+    for (thread& t : clients) {
+        t.join();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    vector<double> all;
+    for (const vector<double>& samples : latencies) {
+        all.insert(all.end(), samples.begin(), samples.end());
+    }
+    if (all.empty()) {
+        cout << "No requests completed; is the server running on " << socketPath << "?\n";
+        return false;
+    }
+    sort(all.begin(), all.end());
+    auto percentile = [&all](double p) { return all[min(all.size() - 1, (size_t)(p * all.size()))]; };
+    cout << "Load test: " << clientCount << " clients, pipeline depth " << pipelineDepth << "\n";
+    cout << "  " << all.size() << " requests in " << seconds << " s (" << (size_t)(all.size() / seconds) << " per second)\n";
+    cout << "  latency p50 " << percentile(0.50) << " us, p99 " << percentile(0.99) << " us, max " << all.back() << " us\n";
+    if (errorReplies > 0) {
+        cout << "  " << errorReplies << " requests answered with an error\n";
+    }
+    if (failedClients > 0) {
+        cout << "  " << failedClients << " clients failed to connect or were disconnected\n";
+    }
+    return failedClients == 0;
+}
+#endif
+
+void printAllocatorStats() {
+    cout << "Allocator statistics\n";
+    cout << left << setw(18) << "  slab" << right << setw(8) << "size" << setw(12) << "live" << setw(12) << "peak"
+        << setw(14) << "allocations" << setw(8) << "blocks" << setw(14) << "reserved" << "\n";
+    for (const SlabAllocatorBase* allocator : SlabAllocatorBase::registry()) {
+        AllocatorStats stats = allocator->stats();
+        cout << left << setw(18) << ("  " + stats.name) << right << setw(8) << stats.objectSize << setw(12) << stats.liveObjects
+            << setw(12) << stats.peakObjects << setw(14) << stats.totalAllocations << setw(8) << stats.blocks << setw(14) << stats.bytesReserved << "\n";
+    }
+    cout << "  string pools: " << StringPool::totalChunks << " chunks, " << StringPool::totalBytesReserved << " bytes reserved\n";
+}
+
+// Builds an index of org-prefixed repositories and times three ways of
+// deleting half of it: one key at a time, one range, and one predicate pass.
+void benchmarkMassDeletion(int repositoryCount) {
+    auto buildIndex = [repositoryCount](Tree& tree) {
+        for (int i = 0; i < repositoryCount; i++) {
+            string number = to_string(i);
+            tree.addRepository(new Repository("org-" + to_string(i % 4) + "/repo-" + string(8 - number.size(), '0') + number, true));
+        }
+    };
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    cout << "Mass deletion benchmark, " << repositoryCount << " repositories\n";
+
+    {
+        Tree tree;
+        buildIndex(tree);
+        vector<string> names;
+        for (Repository* repo : tree.prefixScan("org-1/")) names.push_back(repo->getName());
+        for (Repository* repo : tree.prefixScan("org-2/")) names.push_back(repo->getName());
+        shuffle(names.begin(), names.end(), mt19937(42));
+        auto start = chrono::steady_clock::now();
+        int removed = 0;
+        for (const string& name : names) {
+            removed += tree.deleteRepository(name) ? 1 : 0;
+        }
+        cout << "  per-key deleteRepository: " << removed << " removed in " << elapsedMs(start) << " ms\n";
+    }
+
+    {
+        Tree tree;
+        buildIndex(tree);
+        auto start = chrono::steady_clock::now();
+        int removed = tree.deleteRepositories("org-1/", "org-3/");
+        cout << "  range deleteRepositories: " << removed << " removed in " << elapsedMs(start) << " ms\n";
+    }
+
+    {
+        Tree tree;
+        buildIndex(tree);
+        auto start = chrono::steady_clock::now();
+        int removed = tree.deleteRepositories([](const Repository* repo) {
+            return repo->getName().compare(0, 6, "org-1/") == 0 || repo->getName().compare(0, 6, "org-2/") == 0;
+        });
+        cout << "  predicate deleteRepositories: " << removed << " removed in " << elapsedMs(start) << " ms\n";
+    }
+
+    // Through the catalogue, which also unlinks owners, rankings and search.
+    {
+        const int OWNERS = 4;
+        StringInterner usernames;
+        SocialGraph graph(usernames);
+        RepositoryCatalog catalog;
+        UserManager users(usernames, graph, catalog);
+        users.setHashIterations(1000);
+        for (int o = 0; o < OWNERS; o++) {
+            users.registerUser("org" + to_string(o), "pw");
+        }
+        for (int i = 0; i < repositoryCount; i++) {
+            string number = to_string(i);
+            Repository* repo = new Repository("org" + to_string(i % OWNERS) + "-repo-" + string(8 - number.size(), '0') + number, true);
+            catalog.add(users.getUser("org" + to_string(i % OWNERS)), repo);
+            repo->addFile("readme", BlobId());
+            catalog.fileAdded(repo, "readme");
+        }
+        auto ownerOf = [&users](uint32_t id) { return users.getUser(id); };
+        auto start = chrono::steady_clock::now();
+        int removed = catalog.removeRepositories("org1-", "org2-", ownerOf);
+        removed += catalog.removeRepositories([](const Repository* repo) { return repo->getName().compare(0, 5, "org2-") == 0; }, ownerOf);
+        double removeMs = elapsedMs(start);
+        bool consistent = catalog.size() == repositoryCount - removed && users.getUser("org1")->getRepositories().size() == 0 &&
+            users.getUser("org2")->getRepositories().size() == 0 && catalog.getRankings().mostForked(repositoryCount).size() == (size_t)catalog.size() &&
+            catalog.getSearchIndex().search("readme", StringInterner::NONE, SIZE_MAX).size() == (size_t)catalog.size();
+        cout << "  catalogue removeRepositories: " << removed << " removed in " << removeMs << " ms" << (consistent ? "" : "   INCONSISTENT") << "\n";
+    }
+    printAllocatorStats();
+}
+
+// Per-operation cost of the string-keyed tables: std::unordered_map used
+// the way the code used to (count, then operator[], with a temporary
+// string for every string_view key) against FlatHashMap with one probe.
+void benchmarkMaps(int keyCount) {
+    vector<string> keys;
+    for (int i = 0; i < keyCount; i++) {
+        keys.push_back("owner" + to_string(i % 1000) + "/repository-" + to_string(i));
+    }
+    vector<string_view> lookups(keys.begin(), keys.end());
+    shuffle(lookups.begin(), lookups.end(), mt19937(7));
+    vector<string> misses;
+    for (int i = 0; i < keyCount; i++) {
+        misses.push_back("missing" + to_string(i) + "/repository");
+    }
+    Repository* marker = (Repository*)&keys;
+    const int ROUNDS = 5;
+    size_t checksum = 0;
+    auto nsPerOp = [keyCount](chrono::steady_clock::time_point start, int rounds) {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / ((double)keyCount * rounds);
+    };
+
+    unordered_map<string, Repository*> standard;
+    FlatHashMap<string, Repository*> flat;
+    auto start = chrono::steady_clock::now();
+    for (const string& key : keys) {
+        standard[key] = marker;
+    }
+    double standardInsert = nsPerOp(start, 1);
+    start = chrono::steady_clock::now();
+    for (const string& key : keys) {
+        flat[key] = marker;
+    }
+    double flatInsert = nsPerOp(start, 1);
+
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (string_view key : lookups) {
+            string name(key);
+            if (standard.count(name)) {
+                checksum += (size_t)standard[name];
+            }
+        }
+    }
+    double standardCountThenIndex = nsPerOp(start, ROUNDS);
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (string_view key : lookups) {
+            auto it = standard.find(string(key));
+            if (it != standard.end()) {
+                checksum += (size_t)it->second;
+            }
+        }
+    }
+    double standardFind = nsPerOp(start, ROUNDS);
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (string_view key : lookups) {
+            Repository* const* found = flat.find(key);
+            if (found) {
+                checksum += (size_t)*found;
+            }
+        }
+    }
+    double flatFind = nsPerOp(start, ROUNDS);
+
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (const string& key : misses) {
+            checksum += standard.count(key);
+        }
+    }
+    double standardMiss = nsPerOp(start, ROUNDS);
+    start = chrono::steady_clock::now();
+    for (int round = 0; round < ROUNDS; round++) {
+        for (const string& key : misses) {
+            checksum += flat.find(key) != nullptr;
+        }
+    }
+    double flatMiss = nsPerOp(start, ROUNDS);
+
+    start = chrono::steady_clock::now();
+    for (string_view key : lookups) {
+        standard.erase(string(key));
+    }
+    double standardErase = nsPerOp(start, 1);
+    start = chrono::steady_clock::now();
+    for (string_view key : lookups) {
+        flat.erase(key);
+    }
+    double flatErase = nsPerOp(start, 1);
+
+    cout << "Map benchmark, " << keyCount << " keys, ns per operation\n";
+    cout << fixed << setprecision(1);
+    cout << "  insert                 unordered_map " << setw(7) << standardInsert << "   FlatHashMap " << setw(7) << flatInsert << "\n";
+    cout << "  lookup (count + [])    unordered_map " << setw(7) << standardCountThenIndex << "\n";
+    cout << "  lookup (find)          unordered_map " << setw(7) << standardFind << "   FlatHashMap " << setw(7) << flatFind << "\n";
+    cout << "  lookup miss            unordered_map " << setw(7) << standardMiss << "   FlatHashMap " << setw(7) << flatMiss << "\n";
+    cout << "  erase                  unordered_map " << setw(7) << standardErase << "   FlatHashMap " << setw(7) << flatErase << "\n";
+    cout << defaultfloat << "  (checksum " << checksum % 1000 << ")\n";
+}
+
+// Records skewed forks spread over a month, then compares reading the
+// top 100 from the rankings with finding them by walking the tree.
+void benchmarkTrending(int repositoryCount, int forkCount) {
+    const size_t TOP = 100;
+    const int QUERIES = 100;
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    Tree tree;
+    TrendingIndex rankings(24 * 3600.0);
+    vector<Repository*> repositories;
+    for (int i = 0; i < repositoryCount; i++) {
+        Repository* repo = new Repository("repo-" + to_string(i), i % 4 != 0);
+        tree.addRepository(repo);
+        rankings.track(repo, 0, repo->isRepositoryPublic());
+        repositories.push_back(repo);
+    }
+
+    mt19937 random(11);
+    uniform_real_distribution<double> unit(0, 1);
+    double now = TrendingIndex::currentTime();
+    double spacing = 30 * 24 * 3600.0 / forkCount;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < forkCount; i++) {
+        double u = unit(random);
+        Repository* repo = repositories[(size_t)(repositoryCount * u * u * u)];
+        repo->incrementForkCount();
+        rankings.recordFork(repo, now + i * spacing);
+    }
+    double forkNs = elapsedMs(start) * 1e6 / forkCount;
+    now += forkCount * spacing;
+
+    vector<TrendingIndex::Ranking> ranked;
+    start = chrono::steady_clock::now();
+    for (int q = 0; q < QUERIES; q++) {
+        ranked = rankings.mostForked(TOP);
+    }
+    double indexMs = elapsedMs(start) / QUERIES;
+
+    vector<Repository*> walked;
+    start = chrono::steady_clock::now();
+    for (int q = 0; q < QUERIES; q++) {
+        walked.clear();
+        for (Repository* repo : tree.prefixScan("")) {
+            if (repo->isRepositoryPublic()) {
+                walked.push_back(repo);
+            }
+        }
+        size_t count = min(TOP, walked.size());
+        partial_sort(walked.begin(), walked.begin() + count, walked.end(), [](const Repository* a, const Repository* b) {
+            return a->getForkCount() != b->getForkCount() ? a->getForkCount() > b->getForkCount() : a->getName() < b->getName();
+        });
+        walked.resize(count);
+    }
+    double walkMs = elapsedMs(start) / QUERIES;
+
+    bool same = ranked.size() == walked.size();
+    for (size_t i = 0; same && i < ranked.size(); i++) {
+        same = ranked[i].name == walked[i]->getName() && ranked[i].forks == walked[i]->getForkCount();
+    }
+    vector<TrendingIndex::Ranking> hot = rankings.trending(5, now);
+
+    cout << "Trending benchmark, " << repositoryCount << " repositories, " << forkCount << " forks\n";
+    cout << "  record fork:            " << forkNs << " ns\n";
+    cout << "  top " << TOP << " from rankings:  " << indexMs << " ms\n";
+    cout << "  top " << TOP << " by tree walk:   " << walkMs << " ms\n";
+    cout << "  results " << (same ? "match" : "DIFFER") << "\n";
+    cout << "  trending now (one-day half-life):\n";
+    for (const TrendingIndex::Ranking& entry : hot) {
+        cout << "    " << entry.name << "  " << entry.forks << " forks, score " << entry.score << "\n";
+    }
+}
+
+// Indexes synthetic commit messages drawn from a skewed vocabulary, then
+// times a few query shapes against scanning every message for the terms.
+void benchmarkSearch(int repositoryCount, int commitCount) {
+    const int VOCABULARY = 20000;
+    const int QUERIES = 20;
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    vector<string> words;
+    for (int i = 0; i < VOCABULARY; i++) {
+        words.push_back("w" + to_string(i));
+    }
+    mt19937 random(5);
+    uniform_real_distribution<double> unit(0, 1);
+    auto word = [&]() -> const string& {
+        double u = unit(random);
+        return words[(size_t)(VOCABULARY * u * u * u)];
+    };
+
+    vector<unique_ptr<Repository>> repositories;
+    SearchIndex index;
+    for (int i = 0; i < repositoryCount; i++) {
+        repositories.emplace_back(new Repository("repo-" + to_string(i), true));
+        index.track(repositories.back().get(), StringInterner::NONE);
+    }
+    vector<string> messages;
+    for (int i = 0; i < commitCount; i++) {
+        string message;
+        for (int w = 0; w < 8; w++) {
+            message += (w ? " " : "") + word();
+        }
+        messages.push_back(move(message));
+    }
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < commitCount; i++) {
+        index.addCommit(repositories[i % repositoryCount].get(), messages[i]);
+    }
+    double indexMs = elapsedMs(start);
+    SearchIndex::Stats stats = index.getStats();
+
+    cout << "Search benchmark, " << commitCount << " commits in " << repositoryCount << " repositories\n";
+    cout << "  indexing: " << indexMs << " ms (" << (commitCount / indexMs * 1000) << " commits/s)\n";
+    cout << "  " << stats.terms << " terms, postings " << stats.postingBytes / 1024 << " KiB ("
+        << (double)stats.postingBytes / commitCount << " bytes per commit of 8 words)\n";
+
+    struct Shape {
+        const char* label;
+        string query;
+        vector<string> required; // for the scan
+    };
+    vector<Shape> shapes = {
+        { "two common terms", "w1 w2", { "w1", "w2" } },
+        { "common and rare", "w0 w15000", { "w0", "w15000" } },
+        { "three terms", "w3 w4 w5", { "w3", "w4", "w5" } },
+    };
+    for (const Shape& shape : shapes) {
+        size_t found = 0;
+        start = chrono::steady_clock::now();
+        for (int q = 0; q < QUERIES; q++) {
+            found = index.search(shape.query, StringInterner::NONE, SIZE_MAX).size();
+        }
+        double indexedMs = elapsedMs(start) / QUERIES;
+        size_t scanned = 0;
+        start = chrono::steady_clock::now();
+        for (const string& message : messages) {
+            bool all = true;
+            for (const string& term : shape.required) {
+                size_t at = 0;
+                bool seen = false;
+                while (!seen && (at = message.find(term, at)) != string::npos) {
+                    size_t end = at + term.size();
+                    seen = (at == 0 || message[at - 1] == ' ') && (end == message.size() || message[end] == ' ');
+                    at = end;
+                }
+                all = all && seen;
+            }
+            scanned += all;
+        }
+        double scanMs = elapsedMs(start);
+        cout << "  " << left << setw(18) << shape.label << right << setw(8) << found << " hits  index " << setw(9) << indexedMs
+            << " ms   scan " << setw(9) << scanMs << " ms" << (found == scanned ? "" : "   MISMATCH") << "\n";
+    }
+    start = chrono::steady_clock::now();
+    size_t prefixHits = 0;
+    for (int q = 0; q < QUERIES; q++) {
+        prefixHits = index.search("w12* w7", StringInterner::NONE, SIZE_MAX).size();
+    }
+    cout << "  prefix \"w12* w7\"   " << setw(8) << prefixHits << " hits  index " << setw(9) << elapsedMs(start) / QUERIES << " ms\n";
+}
+
+// Builds a graph where every user follows followCount others plus a few
+// accounts everyone follows, publishes commits, then times feed reads.
+void benchmarkFeed(int userCount, int followCount) {
+    const int CELEBRITIES = 5;
+    const int COMMITS = 200000;
+    const int READS = 20000;
+    auto elapsedUs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    };
+    StringInterner usernames;
+    SocialGraph graph(usernames);
+    vector<uint32_t> ids;
+    for (int i = 0; i < userCount; i++) {
+        ids.push_back(usernames.intern("user" + to_string(i)));
+        graph.addUser(ids.back());
+    }
+    mt19937 random(3);
+    for (int i = 0; i < userCount; i++) {
+        for (int c = 0; c < CELEBRITIES; c++) {
+            graph.followUser(ids[i], ids[c]);
+        }
+        for (int f = 0; f < followCount; f++) {
+            graph.followUser(ids[i], ids[random() % userCount]);
+        }
+    }
+    FeedService feeds(graph);
+    feeds.setCelebrityThreshold(userCount / 2);
+    feeds.recountFollowers((uint32_t)usernames.size());
+
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < COMMITS; i++) {
+        uint32_t author = random() % 20 == 0 ? ids[random() % CELEBRITIES] : ids[random() % userCount];
+        feeds.publish(author, "repo", "commit " + to_string(i), i);
+    }
+    double publishUs = elapsedUs(start) / COMMITS;
+
+    vector<double> latencies;
+    size_t entries = 0;
+    for (int i = 0; i < READS; i++) {
+        uint32_t reader = ids[random() % userCount];
+        start = chrono::steady_clock::now();
+        entries += feeds.read(reader, 50).size();
+        latencies.push_back(elapsedUs(start));
+    }
+    sort(latencies.begin(), latencies.end());
+
+    cout << "Feed benchmark, " << userCount << " users following " << followCount << " others and " << CELEBRITIES << " celebrities\n";
+    cout << "  publish: " << publishUs << " us per commit (average over ordinary and celebrity authors)\n";
+    cout << "  read 50: p50 " << latencies[READS / 2] << " us, p99 " << latencies[READS * 99 / 100] << " us, max " << latencies.back()
+        << " us (" << entries / READS << " entries per feed)\n";
+}
+
+// Builds a skewed follow graph, then times each analytic on it. The
+// direction-optimizing BFS is checked against a plain serial one.
+void benchmarkGraph(int userCount, int averageFollows) {
+    const int SOURCES = 5;
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    StringInterner usernames;
+    SocialGraph graph(usernames);
+    vector<uint32_t> ids;
+    for (int i = 0; i < userCount; i++) {
+        ids.push_back(usernames.intern("user" + to_string(i)));
+        graph.addUser(ids.back());
+    }
+    mt19937 random(17);
+    uniform_real_distribution<double> unit(0, 1);
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < userCount; i++) {
+        int follows = (int)(random() % (2 * averageFollows + 1));
+        for (int f = 0; f < follows; f++) {
+            double u = unit(random);
+            graph.followUser(ids[i], ids[(size_t)(userCount * u * u)]);
+        }
+    }
+    double buildGraphMs = elapsedMs(start);
+
+    start = chrono::steady_clock::now();
+    GraphAnalytics analytics(graph.snapshot());
+    double snapshotMs = elapsedMs(start);
+    const CompactFollowGraph& compact = analytics.getGraph();
+
+    double parallelMs = 0;
+    double serialMs = 0;
+    bool same = true;
+    int reached = 0;
+    for (int s = 0; s < SOURCES; s++) {
+        uint32_t source = ids[random() % userCount];
+        start = chrono::steady_clock::now();
+        vector<int32_t> distance = analytics.distancesFrom(source);
+        parallelMs += elapsedMs(start) / SOURCES;
+
+        start = chrono::steady_clock::now();
+        vector<int32_t> expected(compact.nodeCount(), -1);
+        vector<uint32_t> queue = { source };
+        expected[source] = 0;
+        for (size_t head = 0; head < queue.size(); head++) {
+            uint32_t id = queue[head];
+            for (uint32_t e = compact.outOffsets[id]; e < compact.outOffsets[id + 1]; e++) {
+                uint32_t next = compact.outEdges[e];
+                if (expected[next] < 0) {
+                    expected[next] = expected[id] + 1;
+                    queue.push_back(next);
+                }
+            }
+        }
+        serialMs += elapsedMs(start) / SOURCES;
+        same = same && distance == expected;
+        reached = (int)queue.size();
+    }
+
+    start = chrono::steady_clock::now();
+    size_t suggested = 0;
+    for (int s = 0; s < 100; s++) {
+        suggested += analytics.suggestions(ids[random() % userCount], 10).size();
+    }
+    double suggestMs = elapsedMs(start) / 100;
+
+    int iterations = 0;
+    start = chrono::steady_clock::now();
+    vector<double> rank = analytics.pageRank(0.85, 50, 1e-9, &iterations);
+    double rankMs = elapsedMs(start);
+    vector<GraphAnalytics::Ranked> influencers = analytics.topByPageRank(5);
+
+    cout << "Graph benchmark, " << userCount << " users, " << graph.getEdgeCount() << " follows, "
+        << max(1u, thread::hardware_concurrency()) << " hardware threads\n";
+    cout << "  build SocialGraph:      " << buildGraphMs << " ms\n";
+    cout << "  CSR snapshot:           " << snapshotMs << " ms\n";
+    cout << "  BFS, direction-opt.:    " << parallelMs << " ms   serial queue: " << serialMs << " ms   ("
+        << reached << " reached, " << (same ? "distances match" : "DISTANCES DIFFER") << ")\n";
+    cout << "  who to follow (top 10): " << suggestMs << " ms\n";
+    cout << "  PageRank:               " << rankMs << " ms, " << iterations << " iterations\n";
+    cout << "  most influential:";
+    for (const GraphAnalytics::Ranked& user : influencers) {
+        cout << " " << usernames.name(user.id) << " (" << compact.inDegree(user.id) << " followers)";
+    }
+    cout << "\n";
+}
+
+// Builds a commitCount-long main line with a short branch merged back
+// every thousand commits and a long-lived fork, then times ancestry and
+// merge-base queries against a plain walk over the parents.
+void benchmarkCommitGraph(int commitCount) {
+    const int QUERIES = 1000;
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+    CommitGraph graph;
+    vector<uint32_t> mainLine;
+    vector<uint32_t> branchTips;
+    auto start = chrono::steady_clock::now();
+    uint32_t head = CommitGraph::NONE;
+    uint32_t branch = CommitGraph::NONE;
+    for (int i = 0; i < commitCount; i++) {
+        if (i % 1000 == 0 && head != CommitGraph::NONE) {
+            branch = head;
+            for (int b = 0; b < 50; b++) {
+                branch = graph.add(branch, CommitGraph::NONE, "branch work", 1, i * 100 + b);
+            }
+            branchTips.push_back(branch);
+        }
+        uint32_t merged = i % 1000 == 500 && branch != CommitGraph::NONE ? branch : CommitGraph::NONE;
+        head = graph.add(head, merged, merged != CommitGraph::NONE ? "merge" : "main work", 0, i);
+        mainLine.push_back(head);
+    }
+    uint32_t fork = mainLine[commitCount / 2];
+    for (int i = 0; i < commitCount / 10; i++) {
+        fork = graph.add(fork, CommitGraph::NONE, "fork work", 2, i);
+    }
+    double buildMs = elapsedMs(start);
+
+    // Breadth-first over the parents, for comparison.
+    auto walk = [&graph](uint32_t ancestor, uint32_t descendant) {
+        vector<char> seen(graph.size(), 0);
+        vector<uint32_t> queue = { descendant };
+        seen[descendant] = 1;
+        for (size_t at = 0; at < queue.size(); at++) {
+            if (queue[at] == ancestor) {
+                return true;
+            }
+            CommitGraph::Node node = graph.get(queue[at]);
+            for (uint32_t parent : node.parents) {
+                if (parent != CommitGraph::NONE && !seen[parent]) {
+                    seen[parent] = 1;
+                    queue.push_back(parent);
+                }
+            }
+        }
+        return false;
+    };
+
+    cout << "Commit graph benchmark, " << graph.size() << " commits in " << graph.chainCount() << " chains, built in " << buildMs << " ms\n";
+    mt19937 random(3);
+    struct Shape {
+        const char* label;
+        function<pair<uint32_t, uint32_t>()> pick;
+    };
+    vector<Shape> shapes = {
+        { "main line, old in new", [&]() { return make_pair(mainLine[random() % (commitCount / 10)], head); } },
+        { "merged branch in head", [&]() { return make_pair(branchTips[random() % branchTips.size()], head); } },
+        { "fork tip in head", [&]() { return make_pair(fork, head); } },
+        { "head in fork tip", [&]() { return make_pair(head, fork); } },
+    };
+    for (Shape& shape : shapes) {
+        vector<pair<uint32_t, uint32_t>> pairs;
+        for (int q = 0; q < QUERIES; q++) {
+            pairs.push_back(shape.pick());
+        }
+        size_t yes = 0;
+        start = chrono::steady_clock::now();
+        for (const auto& query : pairs) {
+            yes += graph.isAncestor(query.first, query.second);
+        }
+        double indexedUs = elapsedMs(start) * 1000 / QUERIES;
+        int walked = min(QUERIES, 20);
+        size_t walkedYes = 0;
+        start = chrono::steady_clock::now();
+        for (int q = 0; q < walked; q++) {
+            walkedYes += walk(pairs[q].first, pairs[q].second);
+        }
+        double walkUs = elapsedMs(start) * 1000 / walked;
+        size_t indexedYes = 0;
+        for (int q = 0; q < walked; q++) {
+            indexedYes += graph.isAncestor(pairs[q].first, pairs[q].second);
+        }
+        cout << "  " << left << setw(24) << shape.label << right << setw(5) << yes << " of " << QUERIES << " ancestors   index "
+            << setw(8) << indexedUs << " us   walk " << setw(9) << walkUs << " us" << (walkedYes == indexedYes ? "" : "   MISMATCH") << "\n";
+    }
+    start = chrono::steady_clock::now();
+    vector<uint32_t> bases;
+    for (int q = 0; q < QUERIES; q++) {
+        bases = graph.mergeBases(fork, head);
+    }
+    cout << "  merge base of fork and head: " << elapsedMs(start) * 1000 / QUERIES << " us"
+        << (bases.size() == 1 && bases[0] == mainLine[commitCount / 2] ? "" : "   WRONG") << "\n";
+}
+
+// Builds an upstream with commitCount commits and fileCount files, forks
+// it, lets both sides diverge a little, then times comparing the fork with
+// its upstream against a diff of the full histories and file lists.
+void benchmarkForkDiff(int commitCount, int fileCount) {
+    const int DIVERGENCE = 20;
+    const int RUNS = 200;
+    auto elapsedUs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    };
+    StringInterner usernames;
+    SocialGraph socialGraph(usernames);
+    RepositoryCatalog repositories;
+    UserManager userManager(usernames, socialGraph, repositories);
+    userManager.setHashIterations(1000);
+    PlatformService service(userManager, repositories, socialGraph);
+    service.registerUser("owner", "pw");
+    service.registerUser("forker", "pw");
+    User* owner = service.findUser("owner");
+    User* forker = service.findUser("forker");
+    service.createRepository(owner, "big", true);
+    for (int i = 0; i < commitCount; i++) {
+        service.addCommit(owner, "big", "commit " + to_string(i), i + 1);
+    }
+    for (int i = 0; i < fileCount; i++) {
+        service.addFile(owner, "big", "src/file" + to_string(i) + ".cpp", BlobId::of(to_string(i)));
+    }
+    service.forkRepository(forker, "big");
+    for (int i = 0; i < DIVERGENCE; i++) {
+        service.addCommit(forker, "forker/big", "fork commit " + to_string(i), commitCount + i + 1);
+        service.addCommit(owner, "big", "upstream commit " + to_string(i), commitCount + i + 1);
+        service.addFile(forker, "forker/big", "fork/new" + to_string(i), BlobId::of("new"));
+        service.deleteFile(forker, "forker/big", "src/file" + to_string(i) + ".cpp");
+        service.addFile(owner, "big", "upstream/new" + to_string(i), BlobId::of("new"));
+    }
+
+    size_t changes = 0;
+    auto start = chrono::steady_clock::now();
+    for (int run = 0; run < RUNS; run++) {
+        changes = 0;
+        service.compareWithUpstream("forker/big", [&changes](const PlatformService::ForkChange&) {
+            changes++;
+            return true;
+        });
+    }
+    double streamedUs = elapsedUs(start) / RUNS;
+
+    // Everything each head reaches, and every file on each side.
+    const CommitGraph& history = repositories.getCommitGraph();
+    auto reachable = [&history](uint32_t head) {
+        unordered_set<uint32_t> seen = { head };
+        vector<uint32_t> queue = { head };
+        for (size_t at = 0; at < queue.size(); at++) {
+            for (uint32_t parent : history.get(queue[at]).parents) {
+                if (parent != CommitGraph::NONE && seen.insert(parent).second) {
+                    queue.push_back(parent);
+                }
+            }
+        }
+        return seen;
+    };
+    size_t fullChanges = 0;
+    int fullRuns = max(1, RUNS / 20);
+    start = chrono::steady_clock::now();
+    for (int run = 0; run < fullRuns; run++) {
+        fullChanges = 0;
+        service.viewRepository("forker/big", [&](const Repository& fork) {
+            const Repository* upstream = repositories.find("big");
+            unordered_set<uint32_t> mine = reachable(fork.getHead());
+            unordered_set<uint32_t> theirs = reachable(upstream->getHead());
+            for (uint32_t node : mine) {
+                fullChanges += !theirs.count(node);
+            }
+            for (uint32_t node : theirs) {
+                fullChanges += !mine.count(node);
+            }
+            for (int f = 0; f < fork.getFileCount(); f++) {
+                const File* other = upstream->getFile(fork.getFiles()[f].getName());
+                fullChanges += !other || other->getContent() != fork.getFiles()[f].getContent();
+            }
+            for (int f = 0; f < upstream->getFileCount(); f++) {
+                fullChanges += !fork.hasFile(upstream->getFiles()[f].getName());
+            }
+        });
+    }
+    double fullUs = elapsedUs(start) / fullRuns;
+
+    cout << "Fork diff benchmark, " << commitCount << " commits and " << fileCount << " files upstream, " << DIVERGENCE
+        << " commits and " << DIVERGENCE * 2 << " file changes on the fork, " << DIVERGENCE << " and " << DIVERGENCE << " upstream\n";
+    cout << "  streamed comparison " << setw(10) << streamedUs << " us   " << changes << " changes\n";
+    cout << "  full comparison     " << setw(10) << fullUs << " us   " << fullChanges << " changes"
+        << (fullChanges == changes ? "" : "   MISMATCH") << "\n";
+}
+
+// Writes fileCount distinct small files and a few large ones, then writes
+// them all again as forks would, and times each path through the store.
+void benchmarkBlobs(int fileCount) {
+    const size_t SMALL_BYTES = 4096;
+    const size_t LARGE_BYTES = 4 * 1024 * 1024;
+    const int LARGE_COUNT = 8;
+    const int COPIES = 4;
+    string path = (filesystem::temp_directory_path() / "platform-bench.objects").string();
+    error_code error;
+    filesystem::remove_all(path, error);
+    auto elapsedMs = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    };
+
+    mt19937_64 random(9);
+    vector<string> contents(fileCount + LARGE_COUNT);
+    for (size_t i = 0; i < contents.size(); i++) {
+        contents[i].resize(i < (size_t)fileCount ? SMALL_BYTES : LARGE_BYTES);
+        for (size_t b = 0; b + 8 <= contents[i].size(); b += 8) {
+            uint64_t word = random();
+            memcpy(&contents[i][b], &word, 8);
+        }
+    }
+    vector<BlobId> ids(contents.size());
+
+    cout << "Blob store benchmark, " << fileCount << " files of " << SMALL_BYTES << " bytes and " << LARGE_COUNT << " of "
+        << LARGE_BYTES / 1024 << " KiB, each added " << (COPIES + 1) << " times\n";
+    {
+        BlobStore store;
+        store.open(path);
+        auto start = chrono::steady_clock::now();
+        for (int i = 0; i < fileCount; i++) {
+            store.put(contents[i], ids[i]);
+        }
+        double smallMs = elapsedMs(start);
+        start = chrono::steady_clock::now();
+        for (size_t i = fileCount; i < contents.size(); i++) {
+            store.put(contents[i], ids[i]);
+        }
+        double largeMs = elapsedMs(start);
+        store.sync();
+        start = chrono::steady_clock::now();
+        BlobId id;
+        for (int copy = 0; copy < COPIES; copy++) {
+            for (int i = 0; i < fileCount; i++) {
+                store.put(contents[i], id);
+            }
+        }
+        double duplicateMs = elapsedMs(start);
+        start = chrono::steady_clock::now();
+        for (int copy = 0; copy < COPIES; copy++) {
+            for (size_t i = fileCount; i < contents.size(); i++) {
+                store.put(contents[i], id);
+            }
+        }
+        double largeDuplicateMs = elapsedMs(start);
+
+        cout << "  new small:       " << setw(8) << smallMs * 1000 / fileCount << " us per put\n";
+        cout << "  new large:       " << setw(8) << largeMs * 1000 / LARGE_COUNT << " us per put (written loose and synced)\n";
+        cout << "  duplicate small: " << setw(8) << duplicateMs * 1000 / ((double)fileCount * COPIES) << " us per put (hash and probe)\n";
+        cout << "  duplicate large: " << setw(8) << largeDuplicateMs * 1000 / (LARGE_COUNT * COPIES) << " us per put ("
+            << LARGE_BYTES * LARGE_COUNT * COPIES / 1048576.0 / largeDuplicateMs * 1000 << " MiB/s hashed)\n";
+        BlobStore::Stats stats = store.getStats();
+        uint64_t logicalBytes = (uint64_t)(SMALL_BYTES * fileCount + LARGE_BYTES * LARGE_COUNT) * (COPIES + 1);
+        cout << "  " << stats.blobs << " blobs (" << stats.looseBlobs << " loose) in " << stats.packs << " packs, "
+            << stats.storedBytes / 1048576 << " MiB stored for " << logicalBytes / 1048576 << " MiB added, "
+            << stats.duplicates << " duplicate puts\n";
+    }
+
+    BlobStore store;
+    auto start = chrono::steady_clock::now();
+    store.open(path);
+    cout << "  reopen:          " << setw(8) << elapsedMs(start) << " ms to load the index\n";
+    size_t mismatches = 0;
+    BlobStore::Blob blob;
+    start = chrono::steady_clock::now();
+    for (int i = 0; i < fileCount; i++) {
+        int pick = (int)(random() % fileCount);
+        mismatches += !store.read(ids[pick], blob) || blob.data != contents[pick];
+    }
+    double smallReadMs = elapsedMs(start);
+    start = chrono::steady_clock::now();
+    uint64_t touched = 0;
+    for (int i = 0; i < LARGE_COUNT; i++) {
+        mismatches += !store.read(ids[fileCount + i], blob) || blob.data.size() != LARGE_BYTES;
+        touched += (unsigned char)blob.data[blob.data.size() / 2];
+    }
+    double largeReadMs = elapsedMs(start);
+    cout << "  read small:      " << setw(8) << smallReadMs * 1000 / fileCount << " us per read (includes the compare)\n";
+    cout << "  read large:      " << setw(8) << largeReadMs * 1000 / LARGE_COUNT << " us per read (mapped, one page touched; " << touched % 2 << ")\n";
+    if (mismatches > 0) {
+        cout << "  " << mismatches << " blobs did not read back intact\n";
+    }
+    filesystem::remove_all(path, error);
+}
+
+// Times password logins at several hash costs, then session lookups,
+// which is what an authenticated request pays once logged in.
+void benchmarkLogin() {
+    auto elapsedSeconds = [](chrono::steady_clock::time_point start) {
+        return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    };
+    StringInterner usernames;
+    SocialGraph socialGraph(usernames);
+    RepositoryCatalog repositories;
+    UserManager userManager(usernames, socialGraph, repositories);
+
+    cout << "Login benchmark\n";
+    cout << right << setw(12) << "iterations" << setw(14) << "logins/s" << setw(14) << "ms/login" << "\n";
+    for (int iterations : { 1000, 10000, 100000, 300000 }) {
+        string username = "bench" + to_string(iterations);
+        userManager.setHashIterations(iterations);
+        userManager.registerUser(username, "correct horse battery staple");
+        int logins = 0;
+        auto start = chrono::steady_clock::now();
+        while (logins < 3 || elapsedSeconds(start) < 0.5) {
+            if (!userManager.loginUser(username, "correct horse battery staple")) {
+                cout << "Login failed at " << iterations << " iterations\n";
+                return;
+            }
+            logins++;
+        }
+        double seconds = elapsedSeconds(start);
+        cout << setw(12) << iterations << setw(14) << fixed << setprecision(1) << logins / seconds
+            << setw(14) << setprecision(3) << seconds * 1000 / logins << "\n" << defaultfloat;
+    }
+
+    string token = userManager.startSession("bench1000", "correct horse battery staple");
+    const int LOOKUPS = 1000000;
+    int found = 0;
+    auto start = chrono::steady_clock::now();
+    for (int i = 0; i < LOOKUPS; i++) {
+        found += userManager.getSessionUser(token) ? 1 : 0;
+    }
+    double seconds = elapsedSeconds(start);
+    cout << "Session lookups: " << (size_t)(LOOKUPS / seconds) << " per second (" << found << " of " << LOOKUPS << " valid)\n";
+}
+
+// Runs random operations from many threads against one PlatformService,
+// then checks that the counts every thread observed add up, that the
+// follow graph is symmetric, and that replaying the journal reproduces
+// the same state. Returns false if any invariant is broken.
+bool stressTest(int threadCount, int operationsPerThread) {
+    const int USER_COUNT = 64;
+    const int REPOSITORY_COUNT = 32;
+    const int FILE_NAMES = 16;
+    const int CONTESTED_NAMES = 32;
+    string journalPath = (filesystem::temp_directory_path() / "platform-stress.journal").string();
+    string blobPath = (filesystem::temp_directory_path() / "platform-stress.objects").string();
+    error_code error;
+    filesystem::remove(journalPath, error);
+    filesystem::remove_all(blobPath, error);
+    // Every file with the same name gets the same content, so most writes are duplicates.
+    auto contentOf = [](string_view file) { return "contents of " + string(file) + "\n"; };
+    auto contentsMatch = [&](PlatformService& service, const string& name) {
+        vector<string> files;
+        service.viewRepository(name, [&files](const Repository& repo) {
+            for (int f = 0; f < repo.getFileCount(); f++) {
+                files.push_back(string(repo.getFiles()[f].getName()));
+            }
+        });
+        for (const string& file : files) {
+            BlobStore::Blob blob;
+            if (service.readFile(name, file, blob) != STATUS_OK || blob.data != contentOf(file)) {
+                return false;
+            }
+        }
+        return true;
+    };
+
+    struct RepositoryCounters {
+        atomic<int> commits{ 0 };
+        atomic<int> files{ 0 };
+        atomic<int> forks{ 0 };
+    };
+    vector<RepositoryCounters> expected(REPOSITORY_COUNT);
+    vector<atomic<int>> registrationWins(CONTESTED_NAMES);
+    vector<atomic<int>> creationWins(CONTESTED_NAMES);
+    vector<atomic<int>> deletionWins(CONTESTED_NAMES);
+    atomic<long long> expectedEdges(0);
+    atomic<int> merges(0);
+    atomic<int> strangerChanges(0);
+    auto userName = [](int i) { return "user" + to_string(i); };
+    auto repoName = [](int i) { return "repo" + to_string(i); };
+
+    StringInterner usernames;
+    SocialGraph socialGraph(usernames);
+    RepositoryCatalog repositories;
+    UserManager userManager(usernames, socialGraph, repositories);
+    userManager.setHashIterations(1000); // registration cost is not what is under test
+    JournalPolicy policy;
+    policy.syncToDisk = false;
+    bool ok = true;
+    {
+        Journal journal(journalPath, policy);
+        journal.replay(0, [](JournalOperation, const vector<string_view>&) {});
+        BlobStore blobs;
+        blobs.open(blobPath);
+        PlatformService service(userManager, repositories, socialGraph, &journal, &blobs);
+        service.setCelebrityThreshold(USER_COUNT / 3); // so some accounts move between push and pull
+        for (int i = 0; i < USER_COUNT; i++) {
+            service.registerUser(userName(i), "pw");
+        }
+        for (int i = 0; i < REPOSITORY_COUNT; i++) {
+            service.createRepository(service.findUser(userName(i % USER_COUNT)), repoName(i), true);
+        }
+
+        auto worker = [&](int threadIndex) {
+            mt19937 random(threadIndex);
+            for (int n = 0; n < operationsPerThread; n++) {
+                User* user = service.findUser(userName(random() % USER_COUNT));
+                int repo = random() % REPOSITORY_COUNT;
+                User* owner = service.findUser(userName(repo % USER_COUNT)); // only the owner may change it
+                string file = "file" + to_string(random() % FILE_NAMES);
+                int choice = random() % 100;
+                if (choice < 1) {
+                    service.search(user, "file" + to_string(random() % FILE_NAMES) + " -readme", 10);
+                }
+                else if (choice < 2) {
+                    service.readFeed(user, 20);
+                    service.suggestFollows(user, 5);
+                    int shown = 0; // a page, as a front end would show; merges can bring in whole histories
+                    service.compareWithUpstream(user->getUsername() + "/" + repoName(repo), [&shown](const PlatformService::ForkChange&) { return ++shown < 100; });
+                }
+                else if (choice < 8) {
+                    // The user's own fork, if they have one; forks are not counted.
+                    service.addCommit(user, user->getUsername() + "/" + repoName(repo), "fork commit " + to_string(threadIndex) + "-" + to_string(n));
+                }
+                else if (choice < 39) {
+                    if (service.addCommit(owner, repoName(repo), "commit " + to_string(threadIndex) + "-" + to_string(n)) == STATUS_OK) {
+                        expected[repo].commits++;
+                    }
+                    if (user != owner && service.addCommit(user, repoName(repo), "stranger commit") != STATUS_NOT_OWNER) {
+                        strangerChanges++;
+                    }
+                }
+                else if (choice < 40) {
+                    int added = 0;
+                    if (service.mergeRepository(owner, repoName(repo), repoName(random() % REPOSITORY_COUNT), "merge", 0, &added) == STATUS_OK) {
+                        expected[repo].commits++;
+                        expected[repo].files += added;
+                        merges++;
+                    }
+                }
+                else if (choice < 43) {
+                    service.writeFile(user, user->getUsername() + "/" + repoName(repo), file, contentOf(file));
+                }
+                else if (choice < 55) {
+                    if (service.writeFile(owner, repoName(repo), file, contentOf(file)) == STATUS_OK) {
+                        expected[repo].files++;
+                    }
+                }
+                else if (choice < 57) {
+                    service.deleteFile(user, user->getUsername() + "/" + repoName(repo), file);
+                }
+                else if (choice < 65) {
+                    if (service.deleteFile(owner, repoName(repo), file) == STATUS_OK) {
+                        expected[repo].files--;
+                    }
+                    if (user != owner && service.deleteFile(user, repoName(repo), file) != STATUS_NOT_OWNER) {
+                        strangerChanges++;
+                    }
+                }
+                else if (choice < 78) {
+                    if (service.follow(user, userName(random() % USER_COUNT)) == STATUS_OK) {
+                        expectedEdges++;
+                    }
+                }
+                else if (choice < 88) {
+                    if (service.unfollow(user, userName(random() % USER_COUNT)) == STATUS_OK) {
+                        expectedEdges--;
+                    }
+                }
+                else if (choice < 93) {
+                    if (service.forkRepository(user, repoName(repo)) == STATUS_OK) {
+                        expected[repo].forks++;
+                    }
+                }
+                else if (choice < 97) {
+                    int name = random() % CONTESTED_NAMES;
+                    if (service.registerUser("contested" + to_string(name), "pw") == STATUS_OK) {
+                        registrationWins[name]++;
+                    }
+                }
+                else if (choice < 99) {
+                    int name = random() % CONTESTED_NAMES;
+                    if (service.createRepository(user, "contested" + to_string(name), false) == STATUS_OK) {
+                        creationWins[name]++;
+                    }
+                }
+                else {
+                    int name = random() % CONTESTED_NAMES;
+                    if (service.deleteRepository(user, "contested" + to_string(name)) == STATUS_OK) {
+                        deletionWins[name]++;
+                    }
+                }
+            }
+        };
+
+        auto start = chrono::steady_clock::now();
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.emplace_back(worker, t);
+        }
+        for (thread& t : threads) {
+            t.join();
+        }
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        cout << "Stress test: " << threadCount << " threads, " << (long long)threadCount * operationsPerThread << " operations in "
+            << seconds << " s\n";
+
+        if (strangerChanges != 0) {
+            cout << "  " << strangerChanges << " changes to repositories were allowed to users who do not own them\n";
+            ok = false;
+        }
+        for (int name = 0; name < CONTESTED_NAMES; name++) {
+            int live = creationWins[name] - deletionWins[name];
+            if (registrationWins[name] > 1 || live < 0 || live > 1) {
+                cout << "  contested name " << name << " was claimed more than once\n";
+                ok = false;
+            }
+            if ((service.findRepository("contested" + to_string(name)) != nullptr) != (live == 1)) {
+                cout << "  contested repository " << name << " does not match its creates and deletes\n";
+                ok = false;
+            }
+        }
+        for (int i = 0; i < REPOSITORY_COUNT; i++) {
+            service.viewRepository(repoName(i), [&](const Repository& repo) {
+                if (repo.getCommitCount() != expected[i].commits || repo.getFileCount() != expected[i].files || repo.getForkCount() != expected[i].forks) {
+                    cout << "  " << repo.getName() << " does not match the operations that succeeded on it\n";
+                    ok = false;
+                }
+            });
+        }
+        long long followeeTotal = 0;
+        long long followerTotal = 0;
+        int ownedTotal = 0;
+        for (int i = 0; i < USER_COUNT; i++) {
+            User* user = service.findUser(userName(i));
+            for (const auto& owned : user->getRepositories()) {
+                Repository* indexed = repositories.find(owned.first);
+                if (indexed != owned.second || indexed->getOwnerId() != user->getId()) {
+                    cout << "  " << user->getUsername() << " lists " << owned.first << " but the catalogue disagrees\n";
+                    ok = false;
+                }
+            }
+            ownedTotal += user->getRepositories().size();
+            vector<uint32_t> followees = user->getFollowing();
+            followeeTotal += followees.size();
+            followerTotal += user->getFollowerCount();
+            for (uint32_t followee : followees) {
+                vector<uint32_t> followers = socialGraph.getFollowers(followee);
+                if (find(followers.begin(), followers.end(), user->getId()) == followers.end()) {
+                    cout << "  " << user->getUsername() << " follows " << socialGraph.getUsername(followee) << " only one way\n";
+                    ok = false;
+                }
+            }
+        }
+        for (const TrendingIndex::Ranking& ranked : service.topRepositories(repositories.size(), false)) {
+            Repository* repo = repositories.find(ranked.name);
+            if (!repo || repo->getForkCount() != ranked.forks) {
+                cout << "  the fork rankings disagree about " << ranked.name << "\n";
+                ok = false;
+            }
+        }
+        int expectedCommits = 0;
+        for (int i = 0; i < REPOSITORY_COUNT; i++) {
+            expectedCommits += expected[i].commits;
+        }
+        if (service.search(nullptr, "commit", SIZE_MAX).size() + merges != (size_t)expectedCommits) {
+            cout << "  the search index does not hold every commit\n";
+            ok = false;
+        }
+        for (int i = 0; i < USER_COUNT; i++) {
+            User* user = service.findUser(userName(i));
+            vector<shared_ptr<const Activity>> feed = service.readFeed(user, FeedService::TIMELINE_CAPACITY);
+            for (size_t k = 0; k < feed.size(); k++) {
+                if (!user->isFollowing(feed[k]->author) || (k > 0 && feed[k]->sequence >= feed[k - 1]->sequence)) {
+                    cout << "  " << user->getUsername() << "'s feed has a commit it should not, or is out of order\n";
+                    ok = false;
+                    break;
+                }
+            }
+        }
+        // Ancestry through the chain index must agree with a walk over the parents.
+        const CommitGraph& history = repositories.getCommitGraph();
+        mt19937 pairs(17);
+        for (int q = 0; q < 200 && history.size() > 0; q++) {
+            uint32_t ancestor = pairs() % history.size();
+            uint32_t descendant = pairs() % history.size();
+            vector<uint32_t> queue = { descendant };
+            set<uint32_t> seen = { descendant };
+            bool reached = false;
+            for (size_t at = 0; at < queue.size() && !reached; at++) {
+                reached = queue[at] == ancestor;
+                for (uint32_t parent : history.get(queue[at]).parents) {
+                    if (parent != CommitGraph::NONE && seen.insert(parent).second) {
+                        queue.push_back(parent);
+                    }
+                }
+            }
+            if (history.isAncestor(ancestor, descendant) != reached) {
+                cout << "  the commit graph disagrees with a walk about " << ancestor << " and " << descendant << "\n";
+                ok = false;
+                break;
+            }
+        }
+        for (int i = 0; i + 1 < REPOSITORY_COUNT; i++) {
+            uint32_t first = repositories.find(repoName(i))->getHead();
+            uint32_t second = repositories.find(repoName(i + 1))->getHead();
+            for (uint32_t base : history.mergeBases(first, second)) {
+                if (!history.isAncestor(base, first) || !history.isAncestor(base, second)) {
+                    cout << "  a merge base of " << repoName(i) << " and " << repoName(i + 1) << " is not a common ancestor\n";
+                    ok = false;
+                }
+            }
+        }
+        // Comparing a fork with its upstream must list exactly the commits
+        // only one side reaches, and the files in which the two differ.
+        auto reachable = [&history](uint32_t head) {
+            set<uint32_t> seen;
+            vector<uint32_t> queue;
+            if (head != CommitGraph::NONE) {
+                queue.push_back(head);
+                seen.insert(head);
+            }
+            for (size_t at = 0; at < queue.size(); at++) {
+                for (uint32_t parent : history.get(queue[at]).parents) {
+                    if (parent != CommitGraph::NONE && seen.insert(parent).second) {
+                        queue.push_back(parent);
+                    }
+                }
+            }
+            return seen;
+        };
+        int forksChecked = 0;
+        for (int i = 0; i < USER_COUNT && forksChecked < 20; i++) {
+            User* user = service.findUser(userName(i));
+            for (const auto& forked : user->getForkedRepositories()) {
+                Repository* fork = forked.second;
+                Repository* upstream = repositories.find(fork->getName());
+                unordered_map<BlobId, bool, BlobIdHash> expectedCommits; // whether only the fork has it
+                set<string> expectedFiles;
+                set<uint32_t> mine = reachable(fork->getHead());
+                set<uint32_t> theirs = reachable(upstream->getHead());
+                for (const set<uint32_t>* side : { &mine, &theirs }) {
+                    const set<uint32_t>& other = side == &mine ? theirs : mine;
+                    for (uint32_t node : *side) {
+                        if (!other.count(node)) {
+                            expectedCommits[history.get(node).id] = side == &mine;
+                        }
+                    }
+                }
+                for (const Repository* side : { fork, upstream }) {
+                    const Repository* other = side == fork ? upstream : fork;
+                    for (int f = 0; f < side->getFileCount(); f++) {
+                        const File& file = side->getFiles()[f];
+                        const File* counterpart = other->getFile(file.getName());
+                        if (!counterpart || counterpart->getContent() != file.getContent()) {
+                            expectedFiles.insert(string(file.getName()));
+                        }
+                    }
+                }
+                size_t commitsListed = 0;
+                size_t filesListed = 0;
+                bool matches = true;
+                // The views are read under the commit graph's lock, so nothing here calls into it.
+                service.compareWithUpstream(user->getUsername() + "/" + forked.first, [&](const PlatformService::ForkChange& change) {
+                    if (change.isFile) {
+                        filesListed++;
+                        matches = matches && expectedFiles.count(string(change.text)) && change.inFork == (fork->getFile(change.text) != nullptr);
+                    }
+                    else {
+                        commitsListed++;
+                        auto found = expectedCommits.find(change.id);
+                        matches = matches && found != expectedCommits.end() && found->second == change.inFork;
+                    }
+                    return true;
+                });
+                if (!matches || commitsListed != expectedCommits.size() || filesListed != expectedFiles.size()) {
+                    cout << "  comparing " << user->getUsername() << "/" << forked.first << " with upstream lists the wrong changes\n";
+                    ok = false;
+                }
+                if (++forksChecked >= 20) {
+                    break;
+                }
+            }
+        }
+        shared_ptr<const GraphAnalytics> analytics = service.graphAnalytics();
+        for (int i = 0; i < USER_COUNT; i++) {
+            User* user = service.findUser(userName(i));
+            if (analytics->getGraph().outDegree(user->getId()) != (uint32_t)user->getFollowingCount() ||
+                analytics->getGraph().inDegree(user->getId()) != (uint32_t)user->getFollowerCount() ||
+                (user->getFollowingCount() > 0 && analytics->separation(user->getId(), user->getFollowing()[0]) != 1)) {
+                cout << "  the analytics snapshot disagrees with the graph about " << user->getUsername() << "\n";
+                ok = false;
+            }
+        }
+        for (int i = 0; i < REPOSITORY_COUNT; i++) {
+            if (!contentsMatch(service, repoName(i))) {
+                cout << "  a file in " << repoName(i) << " does not read back its content\n";
+                ok = false;
+            }
+        }
+        if (blobs.getStats().blobs > (size_t)FILE_NAMES) {
+            cout << "  the blob store holds " << blobs.getStats().blobs << " blobs for " << FILE_NAMES << " distinct contents\n";
+            ok = false;
+        }
+        if (ownedTotal != repositories.size()) {
+            cout << "  the catalogue holds " << repositories.size() << " repositories but users own " << ownedTotal << "\n";
+            ok = false;
+        }
+        if (followeeTotal != expectedEdges || followerTotal != expectedEdges || (long long)socialGraph.getEdgeCount() != expectedEdges) {
+            cout << "  follow edge counts disagree\n";
+            ok = false;
+        }
+        // Repositories created apart share no history, even when their
+        // first commits have the same message, author and time.
+        {
+            User* user = service.findUser(userName(0));
+            service.createRepository(user, "apart0", true);
+            service.createRepository(user, "apart1", true);
+            service.addCommit(user, "apart0", "init", 1);
+            service.addCommit(user, "apart1", "init", 1);
+            service.addFile(user, "apart1", "onlyInApart1");
+            PlatformService::HistoryComparison comparison;
+            service.compareHistories("apart0", "apart1", comparison);
+            if (!comparison.mergeBases.empty() || comparison.firstContainsSecond ||
+                service.mergeRepository(user, "apart0", "apart1", "merge apart", 2) != STATUS_OK || !repositories.find("apart0")->hasFile("onlyInApart1")) {
+                cout << "  independently created repositories share history\n";
+                ok = false;
+            }
+        }
+    }
+
+    // The journal must rebuild exactly the state the threads produced.
+    StringInterner replayedNames;
+    SocialGraph replayedGraph(replayedNames);
+    RepositoryCatalog replayedRepositories;
+    UserManager replayedUsers(replayedNames, replayedGraph, replayedRepositories);
+    {
+        Journal journal(journalPath, policy);
+        BlobStore blobs;
+        blobs.open(blobPath);
+        PlatformService replayed(replayedUsers, replayedRepositories, replayedGraph, &journal, &blobs);
+        replayed.replayJournal();
+        for (int i = 0; i < REPOSITORY_COUNT; i++) {
+            Repository* original = repositories.find(repoName(i));
+            Repository* copy = replayedRepositories.find(repoName(i));
+            if (!copy || copy->getCommitCount() != original->getCommitCount() || copy->getFileCount() != original->getFileCount() ||
+                copy->getForkCount() != original->getForkCount() || !contentsMatch(replayed, repoName(i)) ||
+                (original->getHead() != CommitGraph::NONE &&
+                    replayedRepositories.getCommitGraph().get(copy->getHead()).id != repositories.getCommitGraph().get(original->getHead()).id)) {
+                cout << "  journal replay does not reproduce " << repoName(i) << "\n";
+                ok = false;
+            }
+        }
+        for (int i = 0; i < USER_COUNT; i++) {
+            User* user = userManager.getUser(userName(i));
+            User* copy = replayedUsers.getUser(userName(i));
+            for (const auto& forked : user->getForkedRepositories()) {
+                Repository* original = forked.second;
+                Repository* const* replayedFork = copy->getForkedRepositories().find(forked.first);
+                if (!replayedFork || (*replayedFork)->getFileCount() != original->getFileCount() || (*replayedFork)->getCommitCount() != original->getCommitCount() ||
+                    (original->getHead() != CommitGraph::NONE &&
+                        replayedRepositories.getCommitGraph().get((*replayedFork)->getHead()).id != repositories.getCommitGraph().get(original->getHead()).id)) {
+                    cout << "  journal replay does not reproduce " << user->getUsername() << "/" << forked.first << "\n";
+                    ok = false;
+                }
+            }
+        }
+        if (replayedGraph.getEdgeCount() != socialGraph.getEdgeCount() || replayedGraph.getUserCount() != socialGraph.getUserCount() ||
+            replayedRepositories.size() != repositories.size()) {
+            cout << "  journal replay does not reproduce the users, follows or repositories\n";
+            ok = false;
+        }
+    }
+    filesystem::remove(journalPath, error);
+    filesystem::remove_all(blobPath, error);
+
+    cout << (ok ? "  all invariants hold\n" : "  invariants broken\n");
+    return ok;
+}
+
+// "2026-10-17 09:30 UTC", for commit times.
+string formatTimestamp(int64_t timestamp) {
+    if (timestamp == 0) {
+        return "unknown time";
+    }
+    time_t seconds = (time_t)timestamp;
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M UTC", gmtime(&seconds));
+    return text;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && string(argv[1]) == "--bench-delete") {
+        benchmarkMassDeletion(argc > 2 ? atoi(argv[2]) : 200000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-maps") {
+        benchmarkMaps(argc > 2 ? atoi(argv[2]) : 200000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-trending") {
+        benchmarkTrending(argc > 2 ? atoi(argv[2]) : 100000, argc > 3 ? atoi(argv[3]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-search") {
+        benchmarkSearch(argc > 2 ? atoi(argv[2]) : 1000, argc > 3 ? atoi(argv[3]) : 1000000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-feed") {
+        benchmarkFeed(argc > 2 ? atoi(argv[2]) : 5000, argc > 3 ? atoi(argv[3]) : 2000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-graph") {
+        benchmarkGraph(argc > 2 ? atoi(argv[2]) : 500000, argc > 3 ? atoi(argv[3]) : 10);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-blobs") {
+        benchmarkBlobs(argc > 2 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-dag") {
+        benchmarkCommitGraph(argc > 2 ? atoi(argv[2]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-fork-diff") {
+        benchmarkForkDiff(argc > 2 ? atoi(argv[2]) : 200000, argc > 3 ? atoi(argv[3]) : 100000);
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--bench-login") {
+        benchmarkLogin();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--stress") {
+        return stressTest(argc > 2 ? atoi(argv[2]) : 8, argc > 3 ? atoi(argv[3]) : 100000) ? 0 : 1;
+    }
+    if (argc > 3 && string(argv[1]) == "--encode-batch") {
+        ifstream input(argv[2]);
+        ofstream output(argv[3], ios::binary);
+        if (!input || !output) {
+            cout << "Unable to open batch files.\n";
+            return 1;
+        }
+        return encodeBatch(input, output) ? 0 : 1;
+    }
+    if (argc > 1 && string(argv[1]) == "--load-test") {
+#ifndef _WIN32
+        return runLoadGenerator(argc > 2 ? argv[2] : "platform.sock", argc > 3 ? atoi(argv[3]) : 16,
+            argc > 4 ? atoi(argv[4]) : 10000, argc > 5 ? atoi(argv[5]) : 8) ? 0 : 1;
+#else
+        cout << "The load generator needs Unix domain sockets.\n";
+        return 1;
+#endif
+    }
+
+    StringInterner usernames;
+    SocialGraph socialGraph(usernames);
+    RepositoryCatalog repositories;
+    UserManager userManager(usernames, socialGraph, repositories);
+    Journal journal("platform.journal");
+    BlobStore blobs;
+    bool blobsOpen = blobs.open("platform.objects");
+    PlatformService service(userManager, repositories, socialGraph, &journal, blobsOpen ? &blobs : nullptr);
+    User* loggedInUser = nullptr;
+
+    auto replayJournal = [&]() {
+        size_t replayed = service.replayJournal();
+        if (replayed > 0) {
+            cout << "Replayed " << replayed << " journal records.\n";
+        }
+    };
+
+
+    // The text files are only an import/export format; the binary snapshot
+    // plus the journal is what normally gets loaded and saved.
+    if (argc > 1 && string(argv[1]) == "--import-text") {
+        userManager.loadUserData();
+        userManager.loadAllDataFromFile();
+        replayJournal();
+        if (!userManager.saveSnapshot(journal.getLastSequence())) {
+            return 1;
+        }
+        journal.truncate();
+        return 0;
+    }
+    if (argc > 1 && string(argv[1]) == "--export-text") {
+        userManager.loadSnapshot();
+        replayJournal();
+        userManager.saveUserData();
+        userManager.saveAllDataToFile();
+        return 0;
+    }
+
+    if (!userManager.loadSnapshot()) {
+        userManager.loadUserData();
+        userManager.loadAllDataFromFile();
+    }
+    replayJournal();
+    if (argc > 1 && string(argv[1]) == "--alloc-stats") {
+        printAllocatorStats();
+        return 0;
+    }
+
+    // --batch [file] reads text commands from the file or stdin;
+    // --batch-binary <file> reads records written by --encode-batch.
+    if (argc > 1 && (string(argv[1]) == "--batch" || string(argv[1]) == "--batch-binary")) {
+        bool binary = string(argv[1]) == "--batch-binary";
+        if (argc > 2 && string(argv[2]) != "-") {
+            ifstream input(argv[2], binary ? ios::binary : ios::in);
+            if (!input) {
+                cout << "Unable to open batch file: " << argv[2] << endl;
+                return 1;
+            }
+            runBatch(input, binary, service);
+        }
+        else {
+            runBatch(cin, binary, service);
+        }
+        return 0;
+    }
+
+    // --serve [socket] [workers] serves the batch text protocol to many clients.
+    if (argc > 1 && string(argv[1]) == "--serve") {
+#ifndef _WIN32
+        int workers = argc > 3 ? atoi(argv[3]) : (int)thread::hardware_concurrency();
+        PlatformServer server(service, argc > 2 ? argv[2] : "platform.sock", workers);
+        return server.run() ? 0 : 1;
+#else
+        cout << "Server mode needs epoll and Unix domain sockets.\n";
+        return 1;
+#endif
+    }
+
+
+
+    while (true) 
+    {
+
+        cout << "\n===== GitHub-like Platform =====\n";
+        cout << "1. Create Account\n";
+        cout << "2. Login\n";
+        cout << "3. Exit\n";
+        cout << "Enter your choice: ";
+        service.checkpoint();
+
+        int choice;
+        cin >> choice;
+        if (choice == 1) 
+        {
+           
+
+            // Create Account
+            string username, password;
+            cout << "Enter username: ";
+            cin >> username;
+            cout << "Enter password: ";
+            cin >> password;
+            if (service.registerUser(username, password) == STATUS_OK) {
+                cout << "Account created successfully!\n";
+            }
+            else {
+                cout << "Unable to create account. Username already taken.\n";
+            }
+        }
+        else if (choice == 2)
+        {
+
+            // Login
+            string username, password;
+            cout << "Enter username: ";
+            cin >> username;
+            cout << "Enter password: ";
+            cin >> password;
+            string sessionToken = service.startSession(username, password);
+            loggedInUser = sessionToken.empty() ? nullptr : service.authenticate(sessionToken);
+            if (loggedInUser) {
+                cout << "Login successful! Welcome, " << username << "!\n";
+                while (true) {
+                    cout << "\n===== User Menu =====\n";
+                    cout << "1. View Profile\n";
+                    cout << "2. Follow User\n";
+                    cout << "3. Unfollow User\n";
+                    cout << "4. Create Repository\n";
+                    cout << "5. Add Commit\n";
+                    cout << "6. Add File\n";
+                    cout << "7. View Repository Details\n";
+                    cout << "8. Fork Repository\n";
+                    cout << "9. Delete Repository\n";
+                    cout << "10. Change Repository Visibility\n";
+                    cout << "11. Delete File\n";
+                    cout << "12. Top Repositories\n";
+                    cout << "13. Search\n";
+                    cout << "14. View Feed\n";
+                    cout << "15. Explore Network\n";
+                    cout << "16. Merge Repository\n";
+                    cout << "17. Compare Fork with Upstream\n";
+                    cout << "18. Return to Main Menu\n";
+                    cout << "Enter your choice: ";
+                    service.checkpoint();
+
+                    int userChoice;
+                    cin >> userChoice;
+
+                    loggedInUser = service.authenticate(sessionToken);
+                    if (!loggedInUser) {
+                        cout << "Your session has expired. Please log in again.\n";
+                        break;
+                    }
+
+                    if (userChoice == 1) {
+                        // View profile
+                        if (loggedInUser) {
+                            cout << "Username: " << loggedInUser->getUsername() << endl;
+                            cout << "Followers: " << loggedInUser->getFollowerCount() << endl;
+                            cout << "Following: " << loggedInUser->getFollowingCount() << endl;
+                            vector<string> owned = service.listRepositories(loggedInUser);
+                            cout << "Repositories: " << owned.size() << endl;
+                            for (const string& repoName : owned) {
+                                cout << "  " << repoName << endl;
+                            }
+                            cout << "Forked Repositories: " << loggedInUser->getForkedRepositories().size() << endl;
+                        }
+                        else {
+                            cout << "Please log in to view your profile.\n";
+                        }
+                    }
+                    else if (userChoice == 2) {
+                        // Follow user
+                        if (loggedInUser) {
+                            string followeeUsername;
+                            cout << "Enter the username of the user you want to follow: ";
+                            cin >> followeeUsername;
+                            ServiceStatus status = service.follow(loggedInUser, followeeUsername);
+                            if (status == STATUS_OK) {
+                                cout << "You are now following " << followeeUsername << ".\n";
+                            }
+                            else if (status == STATUS_CANNOT_FOLLOW_SELF) {
+                                cout << "You cannot follow yourself.\n";
+                            }
+                            else if (status == STATUS_ALREADY_FOLLOWING) {
+                                cout << "You are already following " << followeeUsername << ".\n";
+                            }
+                            else {
+                                cout << "User not found.\n";
+                            }
+                        }
+                        else {
+                            cout << "Please log in to follow a user.\n";
+                        }
+                    }
+                    else if (userChoice == 3) {
+                        // Unfollow user
+                        if (loggedInUser) {
+                            string unfolloweeUsername;
+                            cout << "Enter the username of the user you want to unfollow: ";
+                            cin >> unfolloweeUsername;
+                            ServiceStatus status = service.unfollow(loggedInUser, unfolloweeUsername);
+                            if (status == STATUS_OK) {
+                                cout << "You have unfollowed " << unfolloweeUsername << ".\n";
+                            }
+                            else if (status == STATUS_NOT_FOLLOWING) {
+                                cout << "You are not following " << unfolloweeUsername << ".\n";
+                            }
+                            else {
+                                cout << "User not found.\n";
+                            }
+                        }
+                        else {
+                            cout << "Please log in to unfollow a user.\n";
+                        }
+                    }
+                    else if (userChoice == 4) {
+                        // Create Repository
+                        string repoName;
+                        bool isPublic;
+                        cout << "Enter repository name: ";
+                        cin >> repoName;
+                        cout << "Make the repository public? (1 for yes, 0 for no): ";
+                        cin >> isPublic;
+                        ServiceStatus status = service.createRepository(loggedInUser, repoName, isPublic);
+                        if (status == STATUS_OK) {
+                            cout << "Repository created successfully!\n";
+                        }
+                        else if (status == STATUS_INVALID_NAME) {
+                            cout << "Repository names cannot contain '/'.\n";
+                        }
+                        else {
+                            cout << "Repository with the same name already exists.\n";
+                        }
+                    }
+                    else if (userChoice == 5) {
+                        // Add Commit
+                        string repoName, commitMessage;
+                        cout << "Enter repository name: ";
+                        cin >> repoName;
+                        if (service.findRepository(repoName)) {
+                            cout << "Enter commit message: ";
+                            cin.ignore(); 
+                            getline(cin, commitMessage);
+                            ServiceStatus status = service.addCommit(loggedInUser, repoName, commitMessage);
+                            if (status == STATUS_OK) {
+                                cout << "Commit added successfully!\n";
+                            }
+                            else if (status == STATUS_NOT_OWNER) {
+                                cout << "You do not own that repository.\n";
+                            }
+                            else {
+                                cout << "Repository not found.\n";
+                            }
+                        }
+                        else {
+                            cout << "Repository not found.\n";
+                        }
+                    }
+                    else if (userChoice == 6) {
+                        // Add File
+                        string repoName, fileName;
+                        cout << "Enter repository name: ";
+                        cin >> repoName;
+                        if (service.findRepository(repoName)) {
+                            string content;
+                            cout << "Enter file name: ";
+                            cin >> fileName;
+                            cout << "Enter file content (one line): ";
+                            cin.ignore();
+                            getline(cin, content);
+                            ServiceStatus status = service.writeFile(loggedInUser, repoName, fileName, content);
+                            if (status == STATUS_OK) {
+                                cout << "File added successfully!\n";
+                            }
+                            else if (status == STATUS_FILE_EXISTS) {
+                                cout << "A file with that name already exists in the repository.\n";
+                            }
+                            else if (status == STATUS_NOT_OWNER) {
+                                cout << "You do not own that repository.\n";
+                            }
+                            else {
+                                cout << "Unable to store the file content.\n";
+                            }
+                        }
+                        else {
+                            cout << "Repository not found.\n";
+                        }
+                    }
+                    else if (userChoice == 7) {
+                        // View Repository Details
+                        string repoName;
+                        cout << "Enter repository name: ";
+                        cin >> repoName;
+                        ServiceStatus status = service.viewRepository(repoName, [&socialGraph, &blobs, &repositories](const Repository& repo) {
+                            cout << "Repository Name: " << repo.getName() << endl;
+                            cout << "Repo Visibility: " << (repo.isRepositoryPublic() ? "Public" : "Private") << endl;
+                            cout << "Repo Fork Count: " << repo.getForkCount() << endl;
+                            if (repo.isFork()) {
+                                cout << "Forked from: " << socialGraph.getUsername(repo.getUpstreamOwner()) << "'s " << repo.getName() << endl;
+                            }
+                            cout << "Commits:" << endl;
+                            for (const Commit& commit : repo.getCommits()) {
+                                CommitGraph::Node node = repositories.getCommitGraph().get(commit.getNode());
+                                cout << "- " << node.id.toHex().substr(0, 12) << " " << commit.getMessage();
+                                if (node.parents[1] != CommitGraph::NONE) {
+                                    cout << " [merge]";
+                                }
+                                if (commit.getAuthor() != StringInterner::NONE) {
+                                    cout << " (" << socialGraph.getUsername(commit.getAuthor()) << ", " << formatTimestamp(commit.getTimestamp()) << ")";
+                                }
+                                cout << endl;
+                            }
+                            cout << "Files:" << endl;
+                            const File* files = repo.getFiles();
+                            for (int i = 0; i < repo.getFileCount(); ++i) {
+                                uint64_t size;
+                                cout << "- " << files[i].getName();
+                                if (blobs.sizeOf(files[i].getContent(), size)) {
+                                    cout << " (" << size << " bytes)";
+                                }
+                                cout << endl;
+                            }
+                        });
+                        if (status != STATUS_OK) {
+                            cout << "Repository not found.\n";
+                        }
+                    }
+
+
+
+                    else if (userChoice == 8) {
+                        // Fork Repository
+                        string repoName;
+                        cout << "Enter the name of the repository you want to fork: ";
+                        cin >> repoName;
+                        if (!loggedInUser) {
+                            cout << "Please log in to fork a repository.\n";
+                        }
+                        else {
+                            ServiceStatus status = service.forkRepository(loggedInUser, repoName);
+                            if (status == STATUS_OK) {
+                                cout << "Repository forked successfully!\n";
+                            }
+                            else if (status == STATUS_REPOSITORY_EXISTS) {
+                                cout << "You already have a fork of " << repoName << ".\n";
+                            }
+                            else {
+                                cout << "Repository not found.\n";
+                            }
+                        }
+                    }
+                    else if (userChoice == 9) {
+                        // Delete Repository
+                        string repoName;
+                        cout << "Enter the name of the repository you want to delete: ";
+                        cin >> repoName;
+                        if (loggedInUser) {
+                            if (service.deleteRepository(loggedInUser, repoName) == STATUS_OK) {
+                                cout << "Repository deleted successfully!\n";
+                            }
+                            else {
+                                cout << "Repository not found in your repositories.\n";
+                            }
+                        }
+                        else {
+                            cout << "Please log in to delete a repository.\n";
+                        }
+                    }
+                    else if (userChoice == 10) {
+                        // Change Repository Visibility
+                        string repoName;
+                        cout << "Enter the name of the repository you want to change the visibility: ";
+                        cin >> repoName;
+                        if (service.findRepository(repoName)) {
+                            bool newVisibility;
+                            cout << "Enter the new visibility (1 for public, 0 for private): ";
+                            cin >> newVisibility;
+                            ServiceStatus status = service.setVisibility(loggedInUser, repoName, newVisibility);
+                            if (status == STATUS_OK) {
+                                cout << "Repository visibility updated successfully.\n";
+                            }
+                            else if (status == STATUS_NOT_OWNER) {
+                                cout << "You do not own that repository.\n";
+                            }
+                            else {
+                                cout << "Repository not found.\n";
+                            }
+                        }
+                        else {
+                            cout << "Repository not found.\n";
+                        }
+                    }
+
+                   
+
+
+                    else if (userChoice == 11) {
+                        // Delete File
+                        string repoName, fileName;
+                        cout << "Enter the name of the repository: ";
+                        cin >> repoName;
+                        cout << "Enter the name of the file you want to delete: ";
+                        cin >> fileName;
+                        ServiceStatus status = service.deleteFile(loggedInUser, repoName, fileName);
+                        if (status == STATUS_OK) {
+                            cout << "File '" << fileName << "' deleted successfully from repository '" << repoName << "'.\n";
+                        }
+                        else if (status == STATUS_FILE_NOT_FOUND) {
+                            cout << "File '" << fileName << "' not found in repository '" << repoName << "'.\n";
+                        }
+                        else if (status == STATUS_NOT_OWNER) {
+                            cout << "You do not own repository '" << repoName << "'.\n";
+                        }
+                        else {
+                            cout << "Repository '" << repoName << "' not found.\n";
+                        }
+                        }
+
+
+
+                    else if (userChoice == 12) {
+                        // Top repositories
+                        char trending;
+                        cout << "Rank by all-time forks or by recent forks? (f/r): ";
+                        cin >> trending;
+                        vector<TrendingIndex::Ranking> top = service.topRepositories(10, trending == 'r' || trending == 'R');
+                        if (top.empty()) {
+                            cout << "No public repositories to rank yet.\n";
+                        }
+                        for (size_t i = 0; i < top.size(); i++) {
+                            cout << (i + 1) << ". " << top[i].name << " (" << top[i].forks << " forks)" << endl;
+                        }
+                    }
+                    else if (userChoice == 13) {
+                        // Search commits and files
+                        string query;
+                        cout << "Enter search terms (OR between alternatives, -term to exclude, term* for prefixes): ";
+                        cin.ignore();
+                        getline(cin, query);
+                        vector<SearchIndex::Hit> hits = service.search(loggedInUser, query, 20);
+                        if (hits.empty()) {
+                            cout << "No matches.\n";
+                        }
+                        for (const SearchIndex::Hit& hit : hits) {
+                            cout << hit.repository << (hit.isFile ? "  file: " : "  commit: ") << hit.text << endl;
+                        }
+                    }
+                    else if (userChoice == 14) {
+                        // Recent commits from followed users
+                        vector<shared_ptr<const Activity>> feed = service.readFeed(loggedInUser, 20);
+                        if (feed.empty()) {
+                            cout << "Nothing new from the people you follow.\n";
+                        }
+                        for (const shared_ptr<const Activity>& activity : feed) {
+                            cout << formatTimestamp(activity->timestamp) << "  " << socialGraph.getUsername(activity->author) << " committed to "
+                                << activity->repository << ": " << activity->message << endl;
+                        }
+                    }
+                    else if (userChoice == 15) {
+                        // Follow graph analytics
+                        char kind;
+                        cout << "(d)egrees of separation, (s)uggested follows, (i)nfluential or most (f)ollowed users: ";
+                        cin >> kind;
+                        if (kind == 'd') {
+                            string otherName;
+                            int hops = -1;
+                            cout << "Enter the other username: ";
+                            cin >> otherName;
+                            if (service.separation(loggedInUser, otherName, &hops) != STATUS_OK) {
+                                cout << "User not found.\n";
+                            }
+                            else if (hops < 0) {
+                                cout << "No chain of follows leads from you to " << otherName << ".\n";
+                            }
+                            else {
+                                cout << otherName << " is " << hops << " follow" << (hops == 1 ? "" : "s") << " away.\n";
+                            }
+                        }
+                        else if (kind == 's' || kind == 'i' || kind == 'f') {
+                            vector<GraphAnalytics::Ranked> ranked = kind == 's' ? service.suggestFollows(loggedInUser, 10)
+                                : kind == 'i' ? service.topInfluencers(10) : service.topFollowed(10);
+                            if (ranked.empty()) {
+                                cout << "Nothing to show yet.\n";
+                            }
+                            for (size_t i = 0; i < ranked.size(); i++) {
+                                cout << (i + 1) << ". " << socialGraph.getUsername(ranked[i].id);
+                                if (kind == 's') {
+                                    cout << " (followed by " << ranked[i].score << " of the people you follow)";
+                                }
+                                else if (kind == 'f') {
+                                    cout << " (" << ranked[i].score << " followers)";
+                                }
+                                cout << endl;
+                            }
+                        }
+                        else {
+                            cout << "Invalid choice.\n";
+                        }
+                    }
+                    else if (userChoice == 16) {
+                        // Merge another repository's history into this one
+                        string targetName, sourceName, message;
+                        cout << "Enter the repository to merge into: ";
+                        cin >> targetName;
+                        cout << "Enter the repository to merge from: ";
+                        cin >> sourceName;
+                        PlatformService::HistoryComparison comparison;
+                        if (service.compareHistories(targetName, sourceName, comparison) != STATUS_OK) {
+                            cout << "Repository not found.\n";
+                        }
+                        else if (comparison.firstContainsSecond) {
+                            cout << targetName << " already has every commit of " << sourceName << ".\n";
+                        }
+                        else {
+                            if (comparison.mergeBases.empty()) {
+                                cout << "The histories share no commits.\n";
+                            }
+                            else {
+                                cout << "Common ancestor: " << comparison.mergeBases[0].toHex().substr(0, 12) << endl;
+                            }
+                            int added = 0;
+                            cout << "Enter merge message: ";
+                            cin.ignore();
+                            getline(cin, message);
+                            ServiceStatus status = service.mergeRepository(loggedInUser, targetName, sourceName, message, 0, &added);
+                            if (status == STATUS_OK) {
+                                cout << "Merged " << sourceName << " into " << targetName << ", adding " << added << " files.\n";
+                            }
+                            else if (status == STATUS_NOT_OWNER) {
+                                cout << "You do not own " << targetName << ".\n";
+                            }
+                            else {
+                                cout << "Nothing to merge.\n";
+                            }
+                        }
+                    }
+                    else if (userChoice == 17) {
+                        // What one of your forks and the repository it came from do not share
+                        const size_t shown = 50;
+                        string repoName;
+                        cout << "Enter the name of your forked repository: ";
+                        cin >> repoName;
+                        size_t changes = 0;
+                        ServiceStatus status = service.compareWithUpstream(loggedInUser->getUsername() + "/" + repoName,
+                            [&](const PlatformService::ForkChange& change) {
+                                if (++changes > shown) {
+                                    return false;
+                                }
+                                cout << (change.modified ? "~ " : change.inFork ? "+ " : "- ");
+                                if (change.isFile) {
+                                    cout << "file " << change.text << endl;
+                                }
+                                else {
+                                    cout << "commit " << change.id.toHex().substr(0, 12) << " " << change.text << endl;
+                                }
+                                return true;
+                            });
+                        if (status == STATUS_NO_UPSTREAM) {
+                            cout << "The repository it was forked from no longer exists.\n";
+                        }
+                        else if (status != STATUS_OK) {
+                            cout << "You have no fork named " << repoName << ".\n";
+                        }
+                        else if (changes == 0) {
+                            cout << "Your fork and " << repoName << " are identical.\n";
+                        }
+                        else if (changes > shown) {
+                            cout << "(showing the first " << shown << " differences)\n";
+                        }
+                    }
+                    else if (userChoice == 18) {
+                        cout << "Returning  to Main Menu" << endl;
+                        service.endSession(sessionToken);
+
+
+                        break; 
+                    }
+
+
+
+                    else {
+                        cout << "Invalid choice. Please enter a valid option.\n";
+                    }
+                }
+            }
+            else {
+                cout << "Invalid username or password. Please try again.\n";
+            }
+        }
+        else if (choice == 3)
+        {
+            // Everything is already in the snapshot or the journal, so exit
+            // only has to flush the last group of records and their blobs.
+            blobs.sync();
+            journal.flush();
+
+            cout << "Exiting program...\n";
+            return 0;
+        }
+        else {
+            cout << "Invalid choice. Please enter a valid option.\n";
+        }
+    }
+
+    return 0;
+}